@@ -22,13 +22,39 @@
 //          02-08-13: Start porting code, removed only linker declarations for Zilog's toolchain as they are not used here 
 //          13-08-13: Fixed bug on line 282- decrypt working perfect now.
 //          17-08-13: Adapted code to use selectable keys, where key index 0 is always the same regardless of firmware change
+//          Removed the global KeyGen- the schedule now lives in an aes128_ctx so the library is reentrant and thread safe.
+//          Define AES_TTABLE (see aes.h) for the 32-bit T-table engine with an equivalent inverse cipher for decryption.
+//          Define AES_NI on x86 hosts to add the AES-NI engine in aes_ni.c. The engine is picked once at startup from CPUID and every
+//          aes128_* call goes through the selected tAESBackend entry.
+//          Define AES_BITSLICE to use the constant-time bitsliced engine in aes_bitslice.c instead of the table engines when
+//          AES-NI is absent.
+//          Define AES_KEYSTORE to expand the KeyIndex 0/1 schedules once (pthread_once, link with -pthread) and share them read
+//          only instead of expanding them per call. No lock is taken after that; the aes_keystore.c cache is for dynamic key ids.
+//          Build with AES_THREAD_UT defined (and -pthread) to get the multi-threaded known answer test AESThreadUT. Build it with
+//          AES_KEYSTORE as well, ideally under a thread sanitizer, to check the shared schedules behind cipher_AES/decipher_AES.
 //
 //
 //
 //--------------------------------------------------------------------------------------------------------------------------------------
 
+#include "common.h"
 #include "aes.h"
+#include "aes_backend.h"
+#include "aes_gcm.h"
+#include "aes_xts.h"
+#include "aes_cmac.h"
 #include "crypto_keys.h"
+#ifdef AES_KEYSTORE
+#include <pthread.h>
+#endif
+#include <string.h>
+#include <stdio.h>
+#include "debug.h"
+
+#ifdef AES_THREAD_UT
+#include <pthread.h>
+#include <time.h>
+#endif
 
 
 
@@ -72,40 +98,96 @@ const unsigned char inv_S_Box[256] =
 0xa0, 0xe0, 0x3b, 0x4d, 0xae, 0x2a, 0xf5, 0xb0, 0xc8, 0xeb, 0xbb, 0x3c, 0x83, 0x53, 0x99, 0x61,
 0x17, 0x2b, 0x04, 0x7e, 0xba, 0x77, 0xd6, 0x26, 0xe1, 0x69, 0x14, 0x63, 0x55, 0x21, 0x0c, 0x7d };
 
+#ifdef AES_TTABLE
+// T-tables for the 32-bit round engine. Te0[x] = {02,01,01,03}.S_Box[x], Td0[x] = {0e,09,0d,0b}.inv_S_Box[x]
+// The other three columns of each table are byte rotations of these, done with ROTR32 to keep the data cache footprint at 2K
+static const uint32_t Te0[256] =
+{
+0xc66363a5U, 0xf87c7c84U, 0xee777799U, 0xf67b7b8dU, 0xfff2f20dU, 0xd66b6bbdU, 0xde6f6fb1U, 0x91c5c554U,
+0x60303050U, 0x02010103U, 0xce6767a9U, 0x562b2b7dU, 0xe7fefe19U, 0xb5d7d762U, 0x4dababe6U, 0xec76769aU,
+0x8fcaca45U, 0x1f82829dU, 0x89c9c940U, 0xfa7d7d87U, 0xeffafa15U, 0xb25959ebU, 0x8e4747c9U, 0xfbf0f00bU,
+0x41adadecU, 0xb3d4d467U, 0x5fa2a2fdU, 0x45afafeaU, 0x239c9cbfU, 0x53a4a4f7U, 0xe4727296U, 0x9bc0c05bU,
+0x75b7b7c2U, 0xe1fdfd1cU, 0x3d9393aeU, 0x4c26266aU, 0x6c36365aU, 0x7e3f3f41U, 0xf5f7f702U, 0x83cccc4fU,
+0x6834345cU, 0x51a5a5f4U, 0xd1e5e534U, 0xf9f1f108U, 0xe2717193U, 0xabd8d873U, 0x62313153U, 0x2a15153fU,
+0x0804040cU, 0x95c7c752U, 0x46232365U, 0x9dc3c35eU, 0x30181828U, 0x379696a1U, 0x0a05050fU, 0x2f9a9ab5U,
+0x0e070709U, 0x24121236U, 0x1b80809bU, 0xdfe2e23dU, 0xcdebeb26U, 0x4e272769U, 0x7fb2b2cdU, 0xea75759fU,
+0x1209091bU, 0x1d83839eU, 0x582c2c74U, 0x341a1a2eU, 0x361b1b2dU, 0xdc6e6eb2U, 0xb45a5aeeU, 0x5ba0a0fbU,
+0xa45252f6U, 0x763b3b4dU, 0xb7d6d661U, 0x7db3b3ceU, 0x5229297bU, 0xdde3e33eU, 0x5e2f2f71U, 0x13848497U,
+0xa65353f5U, 0xb9d1d168U, 0x00000000U, 0xc1eded2cU, 0x40202060U, 0xe3fcfc1fU, 0x79b1b1c8U, 0xb65b5bedU,
+0xd46a6abeU, 0x8dcbcb46U, 0x67bebed9U, 0x7239394bU, 0x944a4adeU, 0x984c4cd4U, 0xb05858e8U, 0x85cfcf4aU,
+0xbbd0d06bU, 0xc5efef2aU, 0x4faaaae5U, 0xedfbfb16U, 0x864343c5U, 0x9a4d4dd7U, 0x66333355U, 0x11858594U,
+0x8a4545cfU, 0xe9f9f910U, 0x04020206U, 0xfe7f7f81U, 0xa05050f0U, 0x783c3c44U, 0x259f9fbaU, 0x4ba8a8e3U,
+0xa25151f3U, 0x5da3a3feU, 0x804040c0U, 0x058f8f8aU, 0x3f9292adU, 0x219d9dbcU, 0x70383848U, 0xf1f5f504U,
+0x63bcbcdfU, 0x77b6b6c1U, 0xafdada75U, 0x42212163U, 0x20101030U, 0xe5ffff1aU, 0xfdf3f30eU, 0xbfd2d26dU,
+0x81cdcd4cU, 0x180c0c14U, 0x26131335U, 0xc3ecec2fU, 0xbe5f5fe1U, 0x359797a2U, 0x884444ccU, 0x2e171739U,
+0x93c4c457U, 0x55a7a7f2U, 0xfc7e7e82U, 0x7a3d3d47U, 0xc86464acU, 0xba5d5de7U, 0x3219192bU, 0xe6737395U,
+0xc06060a0U, 0x19818198U, 0x9e4f4fd1U, 0xa3dcdc7fU, 0x44222266U, 0x542a2a7eU, 0x3b9090abU, 0x0b888883U,
+0x8c4646caU, 0xc7eeee29U, 0x6bb8b8d3U, 0x2814143cU, 0xa7dede79U, 0xbc5e5ee2U, 0x160b0b1dU, 0xaddbdb76U,
+0xdbe0e03bU, 0x64323256U, 0x743a3a4eU, 0x140a0a1eU, 0x924949dbU, 0x0c06060aU, 0x4824246cU, 0xb85c5ce4U,
+0x9fc2c25dU, 0xbdd3d36eU, 0x43acacefU, 0xc46262a6U, 0x399191a8U, 0x319595a4U, 0xd3e4e437U, 0xf279798bU,
+0xd5e7e732U, 0x8bc8c843U, 0x6e373759U, 0xda6d6db7U, 0x018d8d8cU, 0xb1d5d564U, 0x9c4e4ed2U, 0x49a9a9e0U,
+0xd86c6cb4U, 0xac5656faU, 0xf3f4f407U, 0xcfeaea25U, 0xca6565afU, 0xf47a7a8eU, 0x47aeaee9U, 0x10080818U,
+0x6fbabad5U, 0xf0787888U, 0x4a25256fU, 0x5c2e2e72U, 0x381c1c24U, 0x57a6a6f1U, 0x73b4b4c7U, 0x97c6c651U,
+0xcbe8e823U, 0xa1dddd7cU, 0xe874749cU, 0x3e1f1f21U, 0x964b4bddU, 0x61bdbddcU, 0x0d8b8b86U, 0x0f8a8a85U,
+0xe0707090U, 0x7c3e3e42U, 0x71b5b5c4U, 0xcc6666aaU, 0x904848d8U, 0x06030305U, 0xf7f6f601U, 0x1c0e0e12U,
+0xc26161a3U, 0x6a35355fU, 0xae5757f9U, 0x69b9b9d0U, 0x17868691U, 0x99c1c158U, 0x3a1d1d27U, 0x279e9eb9U,
+0xd9e1e138U, 0xebf8f813U, 0x2b9898b3U, 0x22111133U, 0xd26969bbU, 0xa9d9d970U, 0x078e8e89U, 0x339494a7U,
+0x2d9b9bb6U, 0x3c1e1e22U, 0x15878792U, 0xc9e9e920U, 0x87cece49U, 0xaa5555ffU, 0x50282878U, 0xa5dfdf7aU,
+0x038c8c8fU, 0x59a1a1f8U, 0x09898980U, 0x1a0d0d17U, 0x65bfbfdaU, 0xd7e6e631U, 0x844242c6U, 0xd06868b8U,
+0x824141c3U, 0x299999b0U, 0x5a2d2d77U, 0x1e0f0f11U, 0x7bb0b0cbU, 0xa85454fcU, 0x6dbbbbd6U, 0x2c16163aU };
+
+static const uint32_t Td0[256] =
+{
+0x51f4a750U, 0x7e416553U, 0x1a17a4c3U, 0x3a275e96U, 0x3bab6bcbU, 0x1f9d45f1U, 0xacfa58abU, 0x4be30393U,
+0x2030fa55U, 0xad766df6U, 0x88cc7691U, 0xf5024c25U, 0x4fe5d7fcU, 0xc52acbd7U, 0x26354480U, 0xb562a38fU,
+0xdeb15a49U, 0x25ba1b67U, 0x45ea0e98U, 0x5dfec0e1U, 0xc32f7502U, 0x814cf012U, 0x8d4697a3U, 0x6bd3f9c6U,
+0x038f5fe7U, 0x15929c95U, 0xbf6d7aebU, 0x955259daU, 0xd4be832dU, 0x587421d3U, 0x49e06929U, 0x8ec9c844U,
+0x75c2896aU, 0xf48e7978U, 0x99583e6bU, 0x27b971ddU, 0xbee14fb6U, 0xf088ad17U, 0xc920ac66U, 0x7dce3ab4U,
+0x63df4a18U, 0xe51a3182U, 0x97513360U, 0x62537f45U, 0xb16477e0U, 0xbb6bae84U, 0xfe81a01cU, 0xf9082b94U,
+0x70486858U, 0x8f45fd19U, 0x94de6c87U, 0x527bf8b7U, 0xab73d323U, 0x724b02e2U, 0xe31f8f57U, 0x6655ab2aU,
+0xb2eb2807U, 0x2fb5c203U, 0x86c57b9aU, 0xd33708a5U, 0x302887f2U, 0x23bfa5b2U, 0x02036abaU, 0xed16825cU,
+0x8acf1c2bU, 0xa779b492U, 0xf307f2f0U, 0x4e69e2a1U, 0x65daf4cdU, 0x0605bed5U, 0xd134621fU, 0xc4a6fe8aU,
+0x342e539dU, 0xa2f355a0U, 0x058ae132U, 0xa4f6eb75U, 0x0b83ec39U, 0x4060efaaU, 0x5e719f06U, 0xbd6e1051U,
+0x3e218af9U, 0x96dd063dU, 0xdd3e05aeU, 0x4de6bd46U, 0x91548db5U, 0x71c45d05U, 0x0406d46fU, 0x605015ffU,
+0x1998fb24U, 0xd6bde997U, 0x894043ccU, 0x67d99e77U, 0xb0e842bdU, 0x07898b88U, 0xe7195b38U, 0x79c8eedbU,
+0xa17c0a47U, 0x7c420fe9U, 0xf8841ec9U, 0x00000000U, 0x09808683U, 0x322bed48U, 0x1e1170acU, 0x6c5a724eU,
+0xfd0efffbU, 0x0f853856U, 0x3daed51eU, 0x362d3927U, 0x0a0fd964U, 0x685ca621U, 0x9b5b54d1U, 0x24362e3aU,
+0x0c0a67b1U, 0x9357e70fU, 0xb4ee96d2U, 0x1b9b919eU, 0x80c0c54fU, 0x61dc20a2U, 0x5a774b69U, 0x1c121a16U,
+0xe293ba0aU, 0xc0a02ae5U, 0x3c22e043U, 0x121b171dU, 0x0e090d0bU, 0xf28bc7adU, 0x2db6a8b9U, 0x141ea9c8U,
+0x57f11985U, 0xaf75074cU, 0xee99ddbbU, 0xa37f60fdU, 0xf701269fU, 0x5c72f5bcU, 0x44663bc5U, 0x5bfb7e34U,
+0x8b432976U, 0xcb23c6dcU, 0xb6edfc68U, 0xb8e4f163U, 0xd731dccaU, 0x42638510U, 0x13972240U, 0x84c61120U,
+0x854a247dU, 0xd2bb3df8U, 0xaef93211U, 0xc729a16dU, 0x1d9e2f4bU, 0xdcb230f3U, 0x0d8652ecU, 0x77c1e3d0U,
+0x2bb3166cU, 0xa970b999U, 0x119448faU, 0x47e96422U, 0xa8fc8cc4U, 0xa0f03f1aU, 0x567d2cd8U, 0x223390efU,
+0x87494ec7U, 0xd938d1c1U, 0x8ccaa2feU, 0x98d40b36U, 0xa6f581cfU, 0xa57ade28U, 0xdab78e26U, 0x3fadbfa4U,
+0x2c3a9de4U, 0x5078920dU, 0x6a5fcc9bU, 0x547e4662U, 0xf68d13c2U, 0x90d8b8e8U, 0x2e39f75eU, 0x82c3aff5U,
+0x9f5d80beU, 0x69d0937cU, 0x6fd52da9U, 0xcf2512b3U, 0xc8ac993bU, 0x10187da7U, 0xe89c636eU, 0xdb3bbb7bU,
+0xcd267809U, 0x6e5918f4U, 0xec9ab701U, 0x834f9aa8U, 0xe6956e65U, 0xaaffe67eU, 0x21bccf08U, 0xef15e8e6U,
+0xbae79bd9U, 0x4a6f36ceU, 0xea9f09d4U, 0x29b07cd6U, 0x31a4b2afU, 0x2a3f2331U, 0xc6a59430U, 0x35a266c0U,
+0x744ebc37U, 0xfc82caa6U, 0xe090d0b0U, 0x33a7d815U, 0xf104984aU, 0x41ecdaf7U, 0x7fcd500eU, 0x1791f62fU,
+0x764dd68dU, 0x43efb04dU, 0xccaa4d54U, 0xe49604dfU, 0x9ed1b5e3U, 0x4c6a881bU, 0xc12c1fb8U, 0x4665517fU,
+0x9d5eea04U, 0x018c355dU, 0xfa877473U, 0xfb0b412eU, 0xb3671d5aU, 0x92dbd252U, 0xe9105633U, 0x6dd64713U,
+0x9ad7618cU, 0x37a10c7aU, 0x59f8148eU, 0xeb133c89U, 0xcea927eeU, 0xb761c935U, 0xe11ce5edU, 0x7a47b13cU,
+0x9cd2df59U, 0x55f2733fU, 0x1814ce79U, 0x73c737bfU, 0x53f7cdeaU, 0x5ffdaa5bU, 0xdf3d6f14U, 0x7844db86U,
+0xcaaff381U, 0xb968c43eU, 0x3824342cU, 0xc2a3405fU, 0x161dc372U, 0xbce2250cU, 0x283c498bU, 0xff0d9541U,
+0x39a80171U, 0x080cb3deU, 0xd8b4e49cU, 0x6456c190U, 0x7bcb8461U, 0xd532b670U, 0x486c5c74U, 0xd0b85742U };
+#endif
+
 // This is a turn constant for generating the 176 byte expanded key. DO NOT ALTER- it is correct!
 const unsigned char R_Con[11] = {0x8d, 0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1b, 0x36};
 
-unsigned char KeyGen[176];
-
 //------------------------------------------------------------------------------------------------
-// Name: Generate_Key
-// Function: Expands the R_Key
+// Name: Expand_Key
+// Function: Expands a 16 byte key into the 176 byte round key schedule
 //------------------------------------------------------------------------------------------------
-void Generate_Key(unsigned char KeyIndex)
+static void Expand_Key(unsigned char *KeyGen, const unsigned char *Key)
 {
 	unsigned char temp_byte0;
 	unsigned char ii;
 	unsigned char x;
 
-              
-          // Load key as per index...          
-          for (ii = 0; ii  <MAX_LENGTH; ii++){
-          
-                    switch(KeyIndex){
-                              case 0:
-                              KeyGen[ii] = Base_Key[ii];
-                              break;
-                              
-                              case 1:
-                              KeyGen[ii] = Key1[ii];
-                              break;
-                              
-                              default:
-                              KeyGen[ii] = Base_Key[ii];
-                                                                                         
-                    }                    
-          }
-	
+	for (ii = 0; ii < MAX_LENGTH; ii++)
+		KeyGen[ii] = Key[ii];
+
     for (ii=1;ii<11;ii++)
 	{
         temp_byte0 = KeyGen[ii*MAX_LENGTH - 4];
@@ -122,10 +204,57 @@ void Generate_Key(unsigned char KeyIndex)
   }
 }
 
+#ifdef AES_KEYSTORE
+// Both legacy keys, expanded once by Legacy_Expand and never written again- [0] Base_Key, [1] Key1
+static aes128_ctx Legacy_Keys[2];
+static pthread_once_t Legacy_Once = PTHREAD_ONCE_INIT;
+
+//------------------------------------------------------------------------------------------------
+// Name: Legacy_Expand
+// Function: pthread_once routine- expands both compiled-in keys. Every thread sees them fully written once pthread_once returns
+//------------------------------------------------------------------------------------------------
+static void Legacy_Expand(void)
+{
+	aes128_init(&Legacy_Keys[0], Base_Key);
+	aes128_init(&Legacy_Keys[1], Key1);
+}
+#endif
+
+//------------------------------------------------------------------------------------------------
+// Name: Generate_Key
+// Function: Returns the schedule of the R_Key selected by KeyIndex. With AES_KEYSTORE that is the shared read-only copy,
+//           expanded on first use, and ctx is left alone; otherwise the key is expanded into the caller's ctx
+//------------------------------------------------------------------------------------------------
+static const aes128_ctx *Generate_Key(aes128_ctx *ctx, unsigned char KeyIndex)
+{
+#ifdef AES_KEYSTORE
+          (void)ctx;
+          pthread_once(&Legacy_Once, Legacy_Expand);
+          return &Legacy_Keys[(KeyIndex == 1) ? 1 : 0];
+#else
+          // Load key as per index...          
+          switch(KeyIndex){
+                    case 1:
+                    aes128_init(ctx, Key1);
+                    break;
+
+                    case 0:
+                    default:
+                    aes128_init(ctx, Base_Key);
+          }
+          return ctx;
+#endif
+}
+
+#ifndef AES_TTABLE
+//--------------------------------------------------------------------------------------------------------------------------------------
+// Compact byte engine (default): one S_Box lookup per byte, MixColumns through G_Multiply
+//--------------------------------------------------------------------------------------------------------------------------------------
+
 // Name: G_Multiply
 // Function: x2 in galois field
 //-----------------------------------------
-unsigned char G_Multiply(unsigned char value)
+static unsigned char G_Multiply(unsigned char value)
 {
 	if (value & 0x80)
 	{
@@ -140,7 +269,7 @@ unsigned char G_Multiply(unsigned char value)
 // Name: mix_column
 // Function: Used in the encryption- TL;TEH - See Wikipedia
 //-------------------------------------------------------------
-void mix_column(unsigned char *Plain_Data)
+static void mix_column(unsigned char *Plain_Data)
 {
 	unsigned char x;
 	unsigned char temp_byte0, temp_byte1, temp_byte2;    //mixcolums
@@ -169,43 +298,46 @@ void mix_column(unsigned char *Plain_Data)
 
 // Name: add_S_Box_and_shift
 // Function: Add round key, shift rows and substitute byte. Done in 10 rounds
+// Parameters: State, the 16 byte round key for this turn- the caller steps through the schedule once per round rather than
+//             every byte access indexing it by turn
 //---------------------------------------------------------------------------------------------
-void add_S_Box_and_shift(unsigned char *Plain_Data, unsigned char turn)
+static void add_S_Box_and_shift(unsigned char *Plain_Data, const unsigned char *RoundKey)
 {
 	unsigned char x;
 	unsigned char temp_byte0, temp_byte1;
 	//row 0
 	for(x=0;x<15;x+=4)
 	{
-		Plain_Data[x]  = S_Box[(Plain_Data[x] ^ KeyGen[(turn*MAX_LENGTH) +  x])];
+		Plain_Data[x]  = S_Box[(Plain_Data[x] ^ RoundKey[x])];
 	}
     //row 1
-    temp_byte0 = Plain_Data[1] ^ KeyGen[(turn*MAX_LENGTH) + 1];
+    temp_byte0 = Plain_Data[1] ^ RoundKey[1];
 	for(x=1;x<12;x+=4)
 	{
-		Plain_Data[x]  = S_Box[(Plain_Data[x+4] ^ KeyGen[(turn*MAX_LENGTH) +  x+4])];
+		Plain_Data[x]  = S_Box[(Plain_Data[x+4] ^ RoundKey[x+4])];
 	}
     Plain_Data[13]  = S_Box[temp_byte0];
     //row 2
-    temp_byte0 = Plain_Data[2] ^ KeyGen[(turn*MAX_LENGTH) + 2];
-    temp_byte1 = Plain_Data[6] ^ KeyGen[(turn*MAX_LENGTH) + 6];
-    Plain_Data[ 2]  = S_Box[(Plain_Data[10] ^ KeyGen[(turn*MAX_LENGTH) + 10])];
-    Plain_Data[ 6]  = S_Box[(Plain_Data[14] ^ KeyGen[(turn*MAX_LENGTH) + 14])];
+    temp_byte0 = Plain_Data[2] ^ RoundKey[2];
+    temp_byte1 = Plain_Data[6] ^ RoundKey[6];
+    Plain_Data[ 2]  = S_Box[(Plain_Data[10] ^ RoundKey[10])];
+    Plain_Data[ 6]  = S_Box[(Plain_Data[14] ^ RoundKey[14])];
     Plain_Data[10]  = S_Box[temp_byte0];
     Plain_Data[14]  = S_Box[temp_byte1];
     //row 3
-	temp_byte0 = Plain_Data[15] ^ KeyGen[(turn*MAX_LENGTH) + 15];
+	temp_byte0 = Plain_Data[15] ^ RoundKey[15];
 	for(x=15;x>3;x-=4)
 	{
-		Plain_Data[x]  = S_Box[Plain_Data[x-4] ^ KeyGen[(turn*MAX_LENGTH) +  x-4]];
+		Plain_Data[x]  = S_Box[Plain_Data[x-4] ^ RoundKey[x-4]];
 	}
 	Plain_Data[ 3]  = S_Box[temp_byte0];
 }
 
 // Name:  inv_add_S_Box_and_shift
 // Function: inv of Add round key, shift rows and substitute byte. Done in 10 rounds
+// Parameters: State, the 16 byte round key for this turn
 //---------------------------------------------------------------------------------------------
-void inv_add_S_Box_and_shift(unsigned char *Plain_Data, unsigned char turn)
+static void inv_add_S_Box_and_shift(unsigned char *Plain_Data, const unsigned char *RoundKey)
 {
 	unsigned char x;
 	unsigned char temp_byte0, temp_byte1;
@@ -213,73 +345,64 @@ void inv_add_S_Box_and_shift(unsigned char *Plain_Data, unsigned char turn)
 	//row 0
 	for(x=0;x<15;x+=4)
 	{
-		Plain_Data[x]  = inv_S_Box[Plain_Data[x]] ^ KeyGen[(turn*MAX_LENGTH) +  x];
+		Plain_Data[x]  = inv_S_Box[Plain_Data[x]] ^ RoundKey[x];
 	}
 	//row 1
-	temp_byte0 = inv_S_Box[Plain_Data[13]] ^ KeyGen[(turn*MAX_LENGTH) +  1];
+	temp_byte0 = inv_S_Box[Plain_Data[13]] ^ RoundKey[1];
 	for(x=13;x>1;x-=4)
 	{
-		Plain_Data[x]  = inv_S_Box[Plain_Data[x-4]] ^ KeyGen[(turn*MAX_LENGTH) +  x];
+		Plain_Data[x]  = inv_S_Box[Plain_Data[x-4]] ^ RoundKey[x];
 	}
 	Plain_Data[ 1]  = temp_byte0;
 	//row 2
-	temp_byte0 = inv_S_Box[Plain_Data[ 2]] ^ KeyGen[(turn*MAX_LENGTH) + 10];
-	temp_byte1 = inv_S_Box[Plain_Data[ 6]] ^ KeyGen[(turn*MAX_LENGTH) + 14];
-	Plain_Data[ 2]  = inv_S_Box[Plain_Data[10]] ^ KeyGen[(turn*MAX_LENGTH) +  2];
-	Plain_Data[ 6]  = inv_S_Box[Plain_Data[14]] ^ KeyGen[(turn*MAX_LENGTH) +  6];
+	temp_byte0 = inv_S_Box[Plain_Data[ 2]] ^ RoundKey[10];
+	temp_byte1 = inv_S_Box[Plain_Data[ 6]] ^ RoundKey[14];
+	Plain_Data[ 2]  = inv_S_Box[Plain_Data[10]] ^ RoundKey[2];
+	Plain_Data[ 6]  = inv_S_Box[Plain_Data[14]] ^ RoundKey[6];
 	Plain_Data[10]  = temp_byte0;
 	Plain_Data[14]  = temp_byte1;
 	//row 3
-	temp_byte0 = inv_S_Box[Plain_Data[ 3]] ^ KeyGen[(turn*MAX_LENGTH) + 15];
+	temp_byte0 = inv_S_Box[Plain_Data[ 3]] ^ RoundKey[15];
 	for(x=3;x<15;x+=4)
 	{
-		Plain_Data[x]  = inv_S_Box[Plain_Data[x+4]] ^ KeyGen[(turn*MAX_LENGTH) +  x];
+		Plain_Data[x]  = inv_S_Box[Plain_Data[x+4]] ^ RoundKey[x];
 	}
 	Plain_Data[15]  = temp_byte0;
 }
 
-// CRYPTO FUNCTIONS PROPER
-//--------------------------------------------------------------------------------------------------------------------------------------
-
-// Name: cipher_AES
-// Function: Encrypts a byte array of 16 bytes using the AES standard
-// Parameters: Source/Destination array where data is to be encrypted to
-// Returns: void
+// Name: encrypt_rounds
+// Function: Runs the 10 AES rounds over a 16 byte block using an already expanded schedule
 //--------------------------------------------------------------------------
-
-void cipher_AES(unsigned char *Plain_Data, unsigned char KeyIndex)
+static void encrypt_rounds(unsigned char *Plain_Data, const unsigned char *KeyGen)
 {
 	unsigned char x;
 	unsigned char turn;
 
-	Generate_Key(KeyIndex);       //expand the R_Key into 176 bytes
 	for (turn = 0; turn < 9; turn ++)
 	{
 		//addturnkey, S_Box and shiftrows
-		add_S_Box_and_shift(Plain_Data, turn);
+		add_S_Box_and_shift(Plain_Data, KeyGen + (turn * MAX_LENGTH));
 		// mixcolums
 		mix_column(Plain_Data);
 
 	 }
 	  //10th turn without mixcols
-	 add_S_Box_and_shift(Plain_Data, turn);
+	 add_S_Box_and_shift(Plain_Data, KeyGen + (turn * MAX_LENGTH));
 	  //last addturnkey
 	 for(x = 0; x < 16; x++)
 	 {
 		 Plain_Data[ x]^=KeyGen[160+x];
 	 }
 }
-// Name: decipher_AES
-// Function: Decrypts a byte array of 16 bytes using the AES standard
-// Parameters: Source/Destination array where data is to be decrypted to
-// Returns: void
+
+// Name: decrypt_rounds
+// Function: Runs the 10 inverse AES rounds over a 16 byte block using an already expanded schedule
 //--------------------------------------------------------------------------
-void decipher_AES(unsigned char *Plain_Data, unsigned char KeyIndex)
+static void decrypt_rounds(unsigned char *Plain_Data, const unsigned char *KeyGen)
 {
 	unsigned char x, y;
 	unsigned char temp_byte0, turn;
 
-    Generate_Key(KeyIndex);       //expand the R_Key into 176 bytes
     turn = 9;
    
 	  //initial addturnkey
@@ -289,7 +412,7 @@ void decipher_AES(unsigned char *Plain_Data, unsigned char KeyIndex)
 	  }
 
 	  //10th turn without mixcols
-	  inv_add_S_Box_and_shift(Plain_Data, turn);
+	  inv_add_S_Box_and_shift(Plain_Data, KeyGen + (turn * MAX_LENGTH));
 
 	  for (turn = 8; turn >= 0; turn--){               // The compiler will throw a warning about this line of code- ignore it!
 			for(x = 0; x < 16; x+= 4)
@@ -305,11 +428,1248 @@ void decipher_AES(unsigned char *Plain_Data, unsigned char KeyIndex)
 			mix_column(Plain_Data);	
 
 			//addturnkey, inv_S_Box and shiftrows
-			inv_add_S_Box_and_shift(Plain_Data, turn);
+			inv_add_S_Box_and_shift(Plain_Data, KeyGen + (turn * MAX_LENGTH));
 			
 			if(turn == 0)
 				break;
 	  }
 }
 
+#endif
+
+#ifdef AES_TTABLE
+//--------------------------------------------------------------------------------------------------------------------------------------
+// 32-bit T-table engine: SubBytes, ShiftRows and MixColumns fused into four table lookups per column
+//--------------------------------------------------------------------------------------------------------------------------------------
+
+#define ROTR32(w, n)	(((w) >> (n)) | ((w) << (32 - (n))))
+#define GETU32(p)		(((uint32_t)(p)[0] << 24) ^ ((uint32_t)(p)[1] << 16) ^ ((uint32_t)(p)[2] << 8) ^ ((uint32_t)(p)[3]))
+#define PUTU32(p, w)	{ (p)[0] = (unsigned char)((w) >> 24); (p)[1] = (unsigned char)((w) >> 16); (p)[2] = (unsigned char)((w) >> 8); (p)[3] = (unsigned char)(w); }
+
+#define TE(a, b, c, d)	(Te0[(a) >> 24] ^ ROTR32(Te0[((b) >> 16) & 0xff], 8) ^ ROTR32(Te0[((c) >> 8) & 0xff], 16) ^ ROTR32(Te0[(d) & 0xff], 24))
+#define TD(a, b, c, d)	(Td0[(a) >> 24] ^ ROTR32(Td0[((b) >> 16) & 0xff], 8) ^ ROTR32(Td0[((c) >> 8) & 0xff], 16) ^ ROTR32(Td0[(d) & 0xff], 24))
+
+// One full round from state words i0..i3 into o0..o3 with the round key words at rk. The nine inner rounds are written out
+// one after the other with constant key offsets, and alternate between the s and t words, so there is no loop counter or
+// state copy between rounds
+#define TE_ROUND(i, o, rk) \
+	{ \
+		o##0 = TE(i##0, i##1, i##2, i##3) ^ (rk)[0]; \
+		o##1 = TE(i##1, i##2, i##3, i##0) ^ (rk)[1]; \
+		o##2 = TE(i##2, i##3, i##0, i##1) ^ (rk)[2]; \
+		o##3 = TE(i##3, i##0, i##1, i##2) ^ (rk)[3]; \
+	}
+#define TD_ROUND(i, o, rk) \
+	{ \
+		o##0 = TD(i##0, i##3, i##2, i##1) ^ (rk)[0]; \
+		o##1 = TD(i##1, i##0, i##3, i##2) ^ (rk)[1]; \
+		o##2 = TD(i##2, i##1, i##0, i##3) ^ (rk)[2]; \
+		o##3 = TD(i##3, i##2, i##1, i##0) ^ (rk)[3]; \
+	}
+
+#if AES128_ROUNDS != 10
+#error "TTable_Encrypt/TTable_Decrypt are unrolled for the 10 rounds of AES-128"
+#endif
+
+// Name: TTable_Expand
+// Function: Builds the word schedules from the byte schedule. The decrypt schedule is reversed and has InvMixColumns
+//           applied to the inner round keys, so decryption runs the same fused round structure as encryption
+//---------------------------------------------------------------------------------------------
+static void TTable_Expand(aes128_ctx *ctx)
+{
+	unsigned char ii, x;
+	uint32_t w;
+
+	for (ii = 0; ii < 4 * (AES128_ROUNDS + 1); ii++)
+		ctx->EncRK[ii] = GETU32(&ctx->KeyGen[4 * ii]);
+
+	for (ii = 0; ii <= AES128_ROUNDS; ii++)
+	{
+		for (x = 0; x < 4; x++)
+		{
+			w = ctx->EncRK[4 * (AES128_ROUNDS - ii) + x];
+			if ((ii != 0) && (ii != AES128_ROUNDS))
+				w = TD(((uint32_t)S_Box[w >> 24] << 24), ((uint32_t)S_Box[(w >> 16) & 0xff] << 16), ((uint32_t)S_Box[(w >> 8) & 0xff] << 8), S_Box[w & 0xff]);
+			ctx->DecRK[4 * ii + x] = w;
+		}
+	}
+}
+
+// Name: TTable_Encrypt
+// Function: Encrypts a 16 byte block with four T-table lookups per column per round
+//---------------------------------------------------------------------------------------------
+static void TTable_Encrypt(const aes128_ctx *ctx, unsigned char *Plain_Data)
+{
+	const uint32_t *rk = ctx->EncRK;
+	uint32_t s0, s1, s2, s3, t0, t1, t2, t3;
+
+	s0 = GETU32(Plain_Data     ) ^ rk[0];
+	s1 = GETU32(Plain_Data +  4) ^ rk[1];
+	s2 = GETU32(Plain_Data +  8) ^ rk[2];
+	s3 = GETU32(Plain_Data + 12) ^ rk[3];
+
+	TE_ROUND(s, t, rk +  4);
+	TE_ROUND(t, s, rk +  8);
+	TE_ROUND(s, t, rk + 12);
+	TE_ROUND(t, s, rk + 16);
+	TE_ROUND(s, t, rk + 20);
+	TE_ROUND(t, s, rk + 24);
+	TE_ROUND(s, t, rk + 28);
+	TE_ROUND(t, s, rk + 32);
+	TE_ROUND(s, t, rk + 36);
+	s0 = t0; s1 = t1; s2 = t2; s3 = t3;
+
+	// Last round without mixcols
+	rk += 4 * AES128_ROUNDS;
+	t0 = ((uint32_t)S_Box[s0 >> 24] << 24) ^ ((uint32_t)S_Box[(s1 >> 16) & 0xff] << 16) ^ ((uint32_t)S_Box[(s2 >> 8) & 0xff] << 8) ^ S_Box[s3 & 0xff];
+	t1 = ((uint32_t)S_Box[s1 >> 24] << 24) ^ ((uint32_t)S_Box[(s2 >> 16) & 0xff] << 16) ^ ((uint32_t)S_Box[(s3 >> 8) & 0xff] << 8) ^ S_Box[s0 & 0xff];
+	t2 = ((uint32_t)S_Box[s2 >> 24] << 24) ^ ((uint32_t)S_Box[(s3 >> 16) & 0xff] << 16) ^ ((uint32_t)S_Box[(s0 >> 8) & 0xff] << 8) ^ S_Box[s1 & 0xff];
+	t3 = ((uint32_t)S_Box[s3 >> 24] << 24) ^ ((uint32_t)S_Box[(s0 >> 16) & 0xff] << 16) ^ ((uint32_t)S_Box[(s1 >> 8) & 0xff] << 8) ^ S_Box[s2 & 0xff];
+	PUTU32(Plain_Data     , t0 ^ rk[0]);
+	PUTU32(Plain_Data +  4, t1 ^ rk[1]);
+	PUTU32(Plain_Data +  8, t2 ^ rk[2]);
+	PUTU32(Plain_Data + 12, t3 ^ rk[3]);
+}
+
+// Name: TTable_Decrypt
+// Function: Decrypts a 16 byte block using the equivalent inverse cipher and the precomputed DecRK schedule
+//---------------------------------------------------------------------------------------------
+static void TTable_Decrypt(const aes128_ctx *ctx, unsigned char *Plain_Data)
+{
+	const uint32_t *rk = ctx->DecRK;
+	uint32_t s0, s1, s2, s3, t0, t1, t2, t3;
+
+	s0 = GETU32(Plain_Data     ) ^ rk[0];
+	s1 = GETU32(Plain_Data +  4) ^ rk[1];
+	s2 = GETU32(Plain_Data +  8) ^ rk[2];
+	s3 = GETU32(Plain_Data + 12) ^ rk[3];
+
+	TD_ROUND(s, t, rk +  4);
+	TD_ROUND(t, s, rk +  8);
+	TD_ROUND(s, t, rk + 12);
+	TD_ROUND(t, s, rk + 16);
+	TD_ROUND(s, t, rk + 20);
+	TD_ROUND(t, s, rk + 24);
+	TD_ROUND(s, t, rk + 28);
+	TD_ROUND(t, s, rk + 32);
+	TD_ROUND(s, t, rk + 36);
+	s0 = t0; s1 = t1; s2 = t2; s3 = t3;
+
+	// Last round without inv mixcols
+	rk += 4 * AES128_ROUNDS;
+	t0 = ((uint32_t)inv_S_Box[s0 >> 24] << 24) ^ ((uint32_t)inv_S_Box[(s3 >> 16) & 0xff] << 16) ^ ((uint32_t)inv_S_Box[(s2 >> 8) & 0xff] << 8) ^ inv_S_Box[s1 & 0xff];
+	t1 = ((uint32_t)inv_S_Box[s1 >> 24] << 24) ^ ((uint32_t)inv_S_Box[(s0 >> 16) & 0xff] << 16) ^ ((uint32_t)inv_S_Box[(s3 >> 8) & 0xff] << 8) ^ inv_S_Box[s2 & 0xff];
+	t2 = ((uint32_t)inv_S_Box[s2 >> 24] << 24) ^ ((uint32_t)inv_S_Box[(s1 >> 16) & 0xff] << 16) ^ ((uint32_t)inv_S_Box[(s0 >> 8) & 0xff] << 8) ^ inv_S_Box[s3 & 0xff];
+	t3 = ((uint32_t)inv_S_Box[s3 >> 24] << 24) ^ ((uint32_t)inv_S_Box[(s2 >> 16) & 0xff] << 16) ^ ((uint32_t)inv_S_Box[(s1 >> 8) & 0xff] << 8) ^ inv_S_Box[s0 & 0xff];
+	PUTU32(Plain_Data     , t0 ^ rk[0]);
+	PUTU32(Plain_Data +  4, t1 ^ rk[1]);
+	PUTU32(Plain_Data +  8, t2 ^ rk[2]);
+	PUTU32(Plain_Data + 12, t3 ^ rk[3]);
+}
+#endif
+
+// CRYPTO FUNCTIONS PROPER
+//--------------------------------------------------------------------------------------------------------------------------------------
+
+// Name: Portable_Init
+// Function: Expands a 16 byte key for the byte or T-table engine
+//--------------------------------------------------------------------------
+static void Portable_Init(aes128_ctx *ctx, const unsigned char *Key)
+{
+	Expand_Key(ctx->KeyGen, Key);
+#ifdef AES_TTABLE
+	TTable_Expand(ctx);
+#endif
+}
+
+// Name: Portable_Encrypt
+// Function: Encrypts one block with the compiled-in portable engine
+//--------------------------------------------------------------------------
+static void Portable_Encrypt(const aes128_ctx *ctx, unsigned char *Plain_Data)
+{
+#ifdef AES_TTABLE
+	TTable_Encrypt(ctx, Plain_Data);
+#else
+	encrypt_rounds(Plain_Data, ctx->KeyGen);
+#endif
+}
+
+// Name: Portable_Decrypt
+// Function: Decrypts one block with the compiled-in portable engine
+//--------------------------------------------------------------------------
+static void Portable_Decrypt(const aes128_ctx *ctx, unsigned char *Plain_Data)
+{
+#ifdef AES_TTABLE
+	TTable_Decrypt(ctx, Plain_Data);
+#else
+	decrypt_rounds(Plain_Data, ctx->KeyGen);
+#endif
+}
+
+// Name: Portable_Encrypt_Blocks
+// Function: Encrypts consecutive blocks in place, one at a time
+//--------------------------------------------------------------------------
+static void Portable_Encrypt_Blocks(const aes128_ctx *ctx, unsigned char *Data, size_t Blocks)
+{
+	for (; Blocks > 0; Blocks--, Data += MAX_LENGTH)
+		Portable_Encrypt(ctx, Data);
+}
+
+// Name: Portable_Decrypt_Blocks
+// Function: Decrypts consecutive blocks in place, one at a time
+//--------------------------------------------------------------------------
+static void Portable_Decrypt_Blocks(const aes128_ctx *ctx, unsigned char *Data, size_t Blocks)
+{
+	for (; Blocks > 0; Blocks--, Data += MAX_LENGTH)
+		Portable_Decrypt(ctx, Data);
+}
+
+// Name: Portable_Encrypt_Multi
+// Function: Encrypts Count blocks, block x from in[x] to out[x] under ctx[x]
+//--------------------------------------------------------------------------
+static void Portable_Encrypt_Multi(const aes128_ctx *const *ctx, const unsigned char *const *in, unsigned char *const *out, unsigned int Count)
+{
+	unsigned int x;
+
+	for (x = 0; x < Count; x++)
+	{
+		if (out[x] != in[x])
+			memcpy(out[x], in[x], MAX_LENGTH);
+		Portable_Encrypt(ctx[x], out[x]);
+	}
+}
+
+// Name: Portable_Decrypt_Multi
+// Function: Decrypts Count blocks, block x from in[x] to out[x] under ctx[x]
+//--------------------------------------------------------------------------
+static void Portable_Decrypt_Multi(const aes128_ctx *const *ctx, const unsigned char *const *in, unsigned char *const *out, unsigned int Count)
+{
+	unsigned int x;
+
+	for (x = 0; x < Count; x++)
+	{
+		if (out[x] != in[x])
+			memcpy(out[x], in[x], MAX_LENGTH);
+		Portable_Decrypt(ctx[x], out[x]);
+	}
+}
+
+const tAESBackend Portable_Backend =
+{
+#ifdef AES_TTABLE
+	"t-table",
+#else
+	"byte",
+#endif
+	Portable_Init,
+	Portable_Encrypt,
+	Portable_Decrypt,
+	Portable_Encrypt_Blocks,
+	Portable_Decrypt_Blocks,
+	Portable_Encrypt_Multi,
+	Portable_Decrypt_Multi
+};
+
+// Engine used by every aes128_* call. Only written by AES_Select_Backend before main() runs
+#ifdef AES_BITSLICE
+static const tAESBackend *AES_Backend = &Bitslice_Backend;
+#else
+static const tAESBackend *AES_Backend = &Portable_Backend;
+#endif
+
+#ifdef AES_NI
+// Name: AES_Select_Backend
+// Function: Runs once at startup and switches to AES-NI when the CPU has it
+//--------------------------------------------------------------------------
+__attribute__((constructor)) static void AES_Select_Backend(void)
+{
+	if (AESNI_Supported())
+		AES_Backend = &AESNI_Backend;
+}
+#endif
+
+// Name: aes128_init
+// Function: Expands a 16 byte key into a reusable key context
+// Parameters: Context to fill, 16 byte key
+// Returns: void
+//--------------------------------------------------------------------------
+void aes128_init(aes128_ctx *ctx, const unsigned char *Key)
+{
+	AES_Backend->Init(ctx, Key);
+}
+
+// Name: aes128_encrypt_block
+// Function: Encrypts a byte array of 16 bytes in place with a prepared key context
+// Parameters: Key context, Source/Destination array
+// Returns: void
+//--------------------------------------------------------------------------
+void aes128_encrypt_block(const aes128_ctx *ctx, unsigned char *Plain_Data)
+{
+	AES_Backend->Encrypt(ctx, Plain_Data);
+}
+
+// Name: aes128_decrypt_block
+// Function: Decrypts a byte array of 16 bytes in place with a prepared key context
+// Parameters: Key context, Source/Destination array
+// Returns: void
+//--------------------------------------------------------------------------
+void aes128_decrypt_block(const aes128_ctx *ctx, unsigned char *Plain_Data)
+{
+	AES_Backend->Decrypt(ctx, Plain_Data);
+}
+
+// Name: aes128_encrypt_blocks
+// Function: Encrypts Blocks consecutive 16 byte blocks in place (ECB). Hardware engines interleave several blocks at once
+// Parameters: Key context, Source/Destination array of Blocks * 16 bytes, block count
+// Returns: void
+//--------------------------------------------------------------------------
+void aes128_encrypt_blocks(const aes128_ctx *ctx, unsigned char *Data, size_t Blocks)
+{
+	AES_Backend->EncryptBlocks(ctx, Data, Blocks);
+}
+
+// Name: aes128_decrypt_blocks
+// Function: Decrypts Blocks consecutive 16 byte blocks in place (ECB)
+// Parameters: Key context, Source/Destination array of Blocks * 16 bytes, block count
+// Returns: void
+//--------------------------------------------------------------------------
+void aes128_decrypt_blocks(const aes128_ctx *ctx, unsigned char *Data, size_t Blocks)
+{
+	AES_Backend->DecryptBlocks(ctx, Data, Blocks);
+}
+
+// Name: aes128_encrypt_multi
+// Function: Encrypts up to 8 independent blocks, each under its own key, interleaved through the rounds
+// Parameters: Arrays of Count key contexts, input blocks and output blocks (out[x] may equal in[x]), Count (1..8)
+// Returns: void
+//--------------------------------------------------------------------------
+void aes128_encrypt_multi(const aes128_ctx *const *ctx, const unsigned char *const *in, unsigned char *const *out, unsigned int Count)
+{
+	AES_Backend->EncryptMulti(ctx, in, out, Count);
+}
+
+// Name: aes128_decrypt_multi
+// Function: Decrypts up to 8 independent blocks, each under its own key, interleaved through the rounds
+// Parameters: Arrays of Count key contexts, input blocks and output blocks (out[x] may equal in[x]), Count (1..8)
+// Returns: void
+//--------------------------------------------------------------------------
+void aes128_decrypt_multi(const aes128_ctx *const *ctx, const unsigned char *const *in, unsigned char *const *out, unsigned int Count)
+{
+	AES_Backend->DecryptMulti(ctx, in, out, Count);
+}
+
+// Name: aes128_backend_name
+// Function: Reports which round engine was selected at startup
+// Returns: Engine name, e.g. "byte", "t-table", "bitslice" or "aes-ni"
+//--------------------------------------------------------------------------
+const char *aes128_backend_name(void)
+{
+	return AES_Backend->Name;
+}
+
+// Name: cipher_AES
+// Function: Encrypts a byte array of 16 bytes using the AES standard
+// Parameters: Source/Destination array where data is to be encrypted to
+// Returns: void
+// Note: Expands the key on every call (once in all with AES_KEYSTORE)- use aes128_init/aes128_encrypt_block for bulk data
+//--------------------------------------------------------------------------
+
+void cipher_AES(unsigned char *Plain_Data, unsigned char KeyIndex)
+{
+	aes128_ctx ctx;
+
+	aes128_encrypt_block(Generate_Key(&ctx, KeyIndex), Plain_Data);       //expand the R_Key into 176 bytes, or use the shared copy
+}
+// Name: decipher_AES
+// Function: Decrypts a byte array of 16 bytes using the AES standard
+// Parameters: Source/Destination array where data is to be decrypted to
+// Returns: void
+// Note: Expands the key on every call (once in all with AES_KEYSTORE)- use aes128_init/aes128_decrypt_block for bulk data
+//--------------------------------------------------------------------------
+void decipher_AES(unsigned char *Plain_Data, unsigned char KeyIndex)
+{
+    aes128_ctx ctx;
+
+    aes128_decrypt_block(Generate_Key(&ctx, KeyIndex), Plain_Data);       //expand the R_Key into 176 bytes, or use the shared copy
+}
+
+
+
+
+
+
+//-----------------------------------------------------------------------------------------------------------------------------------------------------
+// Unit Tests
+//-----------------------------------------------------------------------------------------------------------------------------------------------------
+
+// Known answer vectors: FIPS 197 C.1, FIPS 197 Appendix B, SP 800-38A F.1.1 block 1 and AESAVS GFSbox #1
+typedef struct
+{
+	unsigned char Key[MAX_LENGTH];
+	unsigned char Plain[MAX_LENGTH];
+	unsigned char Cipher[MAX_LENGTH];
+} tAESVector;
+
+static const tAESVector AES_Vectors[4] =
+{
+	{	{0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f},
+		{0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff},
+		{0x69, 0xc4, 0xe0, 0xd8, 0x6a, 0x7b, 0x04, 0x30, 0xd8, 0xcd, 0xb7, 0x80, 0x70, 0xb4, 0xc5, 0x5a} },
+	{	{0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6, 0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c},
+		{0x32, 0x43, 0xf6, 0xa8, 0x88, 0x5a, 0x30, 0x8d, 0x31, 0x31, 0x98, 0xa2, 0xe0, 0x37, 0x07, 0x34},
+		{0x39, 0x25, 0x84, 0x1d, 0x02, 0xdc, 0x09, 0xfb, 0xdc, 0x11, 0x85, 0x97, 0x19, 0x6a, 0x0b, 0x32} },
+	{	{0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6, 0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c},
+		{0x6b, 0xc1, 0xbe, 0xe2, 0x2e, 0x40, 0x9f, 0x96, 0xe9, 0x3d, 0x7e, 0x11, 0x73, 0x93, 0x17, 0x2a},
+		{0x3a, 0xd7, 0x7b, 0xb4, 0x0d, 0x7a, 0x36, 0x60, 0xa8, 0x9e, 0xca, 0xf3, 0x24, 0x66, 0xef, 0x97} },
+	{	{0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
+		{0xf3, 0x44, 0x81, 0xec, 0x3c, 0xc6, 0x27, 0xba, 0xcd, 0x5d, 0xc3, 0xfb, 0x08, 0xf2, 0x73, 0xe6},
+		{0x03, 0x36, 0x76, 0x3e, 0x96, 0x6d, 0x92, 0x59, 0x5a, 0x56, 0x7c, 0xc9, 0xce, 0x53, 0x7f, 0x5e} }
+};
+
+// Name: AES_Check_Vector
+// Function: Runs one known answer vector through encrypt and decrypt, returns TRUE on a match
+//-----------------------------------------------------------------------------------------------
+static unsigned char AES_Check_Vector(const tAESVector *Vector)
+{
+	aes128_ctx ctx;
+	unsigned char block[MAX_LENGTH];
+
+	aes128_init(&ctx, Vector->Key);
+	memcpy(block, Vector->Plain, MAX_LENGTH);
+	aes128_encrypt_block(&ctx, block);
+	if (memcmp(block, Vector->Cipher, MAX_LENGTH) != 0)
+		return FALSE;
+	aes128_decrypt_block(&ctx, block);
+	if (memcmp(block, Vector->Plain, MAX_LENGTH) != 0)
+		return FALSE;
+	return TRUE;
+}
+
+// SP 800-38A F.1.1 ECB-AES128, four blocks under the key of AES_Vectors[1]
+static const unsigned char AES_ECB_Plain[4][MAX_LENGTH] =
+{
+	{0x6b, 0xc1, 0xbe, 0xe2, 0x2e, 0x40, 0x9f, 0x96, 0xe9, 0x3d, 0x7e, 0x11, 0x73, 0x93, 0x17, 0x2a},
+	{0xae, 0x2d, 0x8a, 0x57, 0x1e, 0x03, 0xac, 0x9c, 0x9e, 0xb7, 0x6f, 0xac, 0x45, 0xaf, 0x8e, 0x51},
+	{0x30, 0xc8, 0x1c, 0x46, 0xa3, 0x5c, 0xe4, 0x11, 0xe5, 0xfb, 0xc1, 0x19, 0x1a, 0x0a, 0x52, 0xef},
+	{0xf6, 0x9f, 0x24, 0x45, 0xdf, 0x4f, 0x9b, 0x17, 0xad, 0x2b, 0x41, 0x7b, 0xe6, 0x6c, 0x37, 0x10}
+};
+
+static const unsigned char AES_ECB_Cipher[4][MAX_LENGTH] =
+{
+	{0x3a, 0xd7, 0x7b, 0xb4, 0x0d, 0x7a, 0x36, 0x60, 0xa8, 0x9e, 0xca, 0xf3, 0x24, 0x66, 0xef, 0x97},
+	{0xf5, 0xd3, 0xd5, 0x85, 0x03, 0xb9, 0x69, 0x9d, 0xe7, 0x85, 0x89, 0x5a, 0x96, 0xfd, 0xba, 0xaf},
+	{0x43, 0xb1, 0xcd, 0x7f, 0x59, 0x8e, 0xce, 0x23, 0x88, 0x1b, 0x00, 0xe3, 0xed, 0x03, 0x06, 0x88},
+	{0x7b, 0x0c, 0x78, 0x5e, 0x27, 0xe8, 0xad, 0x3f, 0x82, 0x23, 0x20, 0x71, 0x04, 0x72, 0x5d, 0xd4}
+};
+
+// Name: AES_Check_Engine
+// Function: Runs the known answer vectors through every entry of one round engine directly, whichever engine the
+//           dispatcher picked. The bulk counts reach every pass width of the bitsliced engine and both sizes of padded tail
+//-----------------------------------------------------------------------------------------------
+static unsigned char AES_Check_Engine(const tAESBackend *Engine)
+{
+	static const size_t Counts[5] = { 1, 3, 8, 13, 63 };
+	unsigned char data[63 * MAX_LENGTH];
+	unsigned char block[AES128_MULTI_LANES][MAX_LENGTH];
+	aes128_ctx ctx[4];
+	const aes128_ctx *keys[AES128_MULTI_LANES];
+	const unsigned char *in[AES128_MULTI_LANES];
+	unsigned char *out[AES128_MULTI_LANES];
+	unsigned int ii, n;
+	unsigned char pass = TRUE;
+
+	for (ii = 0; ii < 4; ii++)
+		Engine->Init(&ctx[ii], AES_Vectors[ii].Key);
+
+	for (ii = 0; ii < 4; ii++)
+	{
+		memcpy(block[0], AES_Vectors[ii].Plain, MAX_LENGTH);
+		Engine->Encrypt(&ctx[ii], block[0]);
+		pass &= (memcmp(block[0], AES_Vectors[ii].Cipher, MAX_LENGTH) == 0);
+		Engine->Decrypt(&ctx[ii], block[0]);
+		pass &= (memcmp(block[0], AES_Vectors[ii].Plain, MAX_LENGTH) == 0);
+	}
+
+	for (n = 0; n < 5; n++)
+	{
+		for (ii = 0; ii < Counts[n]; ii++)
+			memcpy(&data[ii * MAX_LENGTH], AES_ECB_Plain[ii & 3], MAX_LENGTH);
+		Engine->EncryptBlocks(&ctx[1], data, Counts[n]);
+		for (ii = 0; ii < Counts[n]; ii++)
+			pass &= (memcmp(&data[ii * MAX_LENGTH], AES_ECB_Cipher[ii & 3], MAX_LENGTH) == 0);
+		Engine->DecryptBlocks(&ctx[1], data, Counts[n]);
+		for (ii = 0; ii < Counts[n]; ii++)
+			pass &= (memcmp(&data[ii * MAX_LENGTH], AES_ECB_Plain[ii & 3], MAX_LENGTH) == 0);
+	}
+
+	// Multi-key- lane x under AES_Vectors[x & 3], then decrypted in place
+	for (ii = 0; ii < AES128_MULTI_LANES; ii++)
+	{
+		keys[ii] = &ctx[ii & 3];
+		in[ii] = AES_Vectors[ii & 3].Plain;
+		out[ii] = block[ii];
+	}
+	Engine->EncryptMulti(keys, in, out, AES128_MULTI_LANES);
+	for (ii = 0; ii < AES128_MULTI_LANES; ii++)
+	{
+		pass &= (memcmp(block[ii], AES_Vectors[ii & 3].Cipher, MAX_LENGTH) == 0);
+		in[ii] = block[ii];
+	}
+	Engine->DecryptMulti(keys, in, out, AES128_MULTI_LANES);
+	for (ii = 0; ii < AES128_MULTI_LANES; ii++)
+		pass &= (memcmp(block[ii], AES_Vectors[ii & 3].Plain, MAX_LENGTH) == 0);
+	return pass;
+}
+
+// SP 800-38A F.2.1 CBC-AES128 and F.5.1 CTR-AES128 over the AES_ECB_Plain blocks, under the key of AES_Vectors[1]. The carry
+// case runs the same plaintext from an all ones counter, which must wrap to zero (cross-checked against OpenSSL)
+static const unsigned char AES_CBC_IV[MAX_LENGTH] =
+{
+	0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f
+};
+
+static const unsigned char AES_CBC_Cipher[4][MAX_LENGTH] =
+{
+	{0x76, 0x49, 0xab, 0xac, 0x81, 0x19, 0xb2, 0x46, 0xce, 0xe9, 0x8e, 0x9b, 0x12, 0xe9, 0x19, 0x7d},
+	{0x50, 0x86, 0xcb, 0x9b, 0x50, 0x72, 0x19, 0xee, 0x95, 0xdb, 0x11, 0x3a, 0x91, 0x76, 0x78, 0xb2},
+	{0x73, 0xbe, 0xd6, 0xb8, 0xe3, 0xc1, 0x74, 0x3b, 0x71, 0x16, 0xe6, 0x9e, 0x22, 0x22, 0x95, 0x16},
+	{0x3f, 0xf1, 0xca, 0xa1, 0x68, 0x1f, 0xac, 0x09, 0x12, 0x0e, 0xca, 0x30, 0x75, 0x86, 0xe1, 0xa7}
+};
+
+static const unsigned char AES_CTR_Counter[MAX_LENGTH] =
+{
+	0xf0, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8, 0xf9, 0xfa, 0xfb, 0xfc, 0xfd, 0xfe, 0xff
+};
+
+static const unsigned char AES_CTR_Cipher[4][MAX_LENGTH] =
+{
+	{0x87, 0x4d, 0x61, 0x91, 0xb6, 0x20, 0xe3, 0x26, 0x1b, 0xef, 0x68, 0x64, 0x99, 0x0d, 0xb6, 0xce},
+	{0x98, 0x06, 0xf6, 0x6b, 0x79, 0x70, 0xfd, 0xff, 0x86, 0x17, 0x18, 0x7b, 0xb9, 0xff, 0xfd, 0xff},
+	{0x5a, 0xe4, 0xdf, 0x3e, 0xdb, 0xd5, 0xd3, 0x5e, 0x5b, 0x4f, 0x09, 0x02, 0x0d, 0xb0, 0x3e, 0xab},
+	{0x1e, 0x03, 0x1d, 0xda, 0x2f, 0xbe, 0x03, 0xd1, 0x79, 0x21, 0x70, 0xa0, 0xf3, 0x00, 0x9c, 0xee}
+};
+
+static const unsigned char AES_CTR_Carry_Cipher[4][MAX_LENGTH] =
+{
+	{0xe1, 0x33, 0x38, 0xe3, 0x6c, 0xb7, 0x19, 0x62, 0xe0, 0x0d, 0x02, 0x0b, 0x4c, 0xed, 0xbd, 0x86},
+	{0xd3, 0xda, 0xe1, 0x5b, 0x04, 0xbb, 0x35, 0x2f, 0xa0, 0xf5, 0x9f, 0xeb, 0xfc, 0xb4, 0xda, 0x3e},
+	{0x67, 0xda, 0x61, 0x06, 0x97, 0xed, 0x5a, 0xae, 0x4b, 0x0f, 0xa7, 0xa0, 0xdd, 0x78, 0x3d, 0x29},
+	{0x61, 0xa0, 0x0a, 0xb6, 0x97, 0x36, 0x79, 0x15, 0xd2, 0x3c, 0x75, 0x4b, 0xd9, 0x9e, 0x28, 0x99}
+};
+
+#define MODES_UT_TAIL		60		// Partial final block for CTR
+#define MODES_UT_JOBS		11		// More than AES128_MULTI_LANES so the batch scheduler refills lanes
+
+// CBC image. With AES_THREADS it is past two workers' worth of AES_MT_MIN_BLOCKS (4096 in aes_modes.c) so the decrypt is split
+#ifdef AES_THREADS
+#define MODES_UT_BLOCKS		(2 * 4096 + 5)
+#else
+#define MODES_UT_BLOCKS		69
+#endif
+
+static unsigned char Modes_Image_Plain[MODES_UT_BLOCKS * MAX_LENGTH];
+static unsigned char Modes_Image_Cipher[MODES_UT_BLOCKS * MAX_LENGTH];
+static unsigned char Modes_Image_Out[MODES_UT_BLOCKS * MAX_LENGTH];
+
+// Name: AES_Check_Modes_Vectors
+// Function: SP 800-38A ECB, CBC and CTR through the mode calls, CTR with a partial tail and across a full counter carry. The
+//           counter and IV handed back must be ready to continue the stream
+//-----------------------------------------------------------------------------------------------
+static unsigned char AES_Check_Modes_Vectors(const aes128_ctx *ctx)
+{
+	const unsigned char *Plain = (const unsigned char *)AES_ECB_Plain;
+	unsigned char out[4 * MAX_LENGTH], iv[MAX_LENGTH], counter[MAX_LENGTH], next[MAX_LENGTH];
+	unsigned char pass = TRUE;
+
+	aes128_ecb_encrypt(ctx, Plain, out, 4);
+	pass &= (memcmp(out, AES_ECB_Cipher, sizeof(out)) == 0);
+	aes128_ecb_decrypt(ctx, out, out, 4);
+	pass &= (memcmp(out, Plain, sizeof(out)) == 0);
+
+	memcpy(iv, AES_CBC_IV, MAX_LENGTH);
+	aes128_cbc_encrypt(ctx, iv, Plain, out, 4);
+	pass &= (memcmp(out, AES_CBC_Cipher, sizeof(out)) == 0);
+	pass &= (memcmp(iv, AES_CBC_Cipher[3], MAX_LENGTH) == 0);
+	memcpy(iv, AES_CBC_IV, MAX_LENGTH);
+	aes128_cbc_decrypt(ctx, iv, out, out, 4);
+	pass &= (memcmp(out, Plain, sizeof(out)) == 0);
+	pass &= (memcmp(iv, AES_CBC_Cipher[3], MAX_LENGTH) == 0);
+
+	memcpy(counter, AES_CTR_Counter, MAX_LENGTH);
+	aes128_ctr_xcrypt(ctx, counter, Plain, out, MODES_UT_TAIL);
+	pass &= (memcmp(out, AES_CTR_Cipher, MODES_UT_TAIL) == 0);
+	memcpy(next, AES_CTR_Counter, MAX_LENGTH);
+	next[MAX_LENGTH - 2] = 0xff;
+	next[MAX_LENGTH - 1] = 0x03;
+	pass &= (memcmp(counter, next, MAX_LENGTH) == 0);
+
+	memset(counter, 0xff, MAX_LENGTH);
+	aes128_ctr_xcrypt(ctx, counter, Plain, out, sizeof(out));
+	pass &= (memcmp(out, AES_CTR_Carry_Cipher, sizeof(out)) == 0);
+	memset(next, 0, MAX_LENGTH);
+	next[MAX_LENGTH - 1] = 0x03;
+	pass &= (memcmp(counter, next, MAX_LENGTH) == 0);
+	return pass;
+}
+
+// Name: AES_Check_Modes_Split
+// Function: The batch, multi-key and scatter/gather calls against the contiguous single-key calls they stand in for, and a
+//           CBC image round trip (split over threads with AES_THREADS)
+//-----------------------------------------------------------------------------------------------
+static unsigned char AES_Check_Modes_Split(const aes128_ctx *ctx)
+{
+	static const size_t Segment[6] = {7, 0, 16, 1, 40, 36};		// MODES_UT_BLOCKS * MAX_LENGTH bytes in all
+	aes128_ctx keys[4];
+	const aes128_ctx *lane[AES128_MULTI_LANES];
+	const unsigned char *in[AES128_MULTI_LANES];
+	unsigned char *out[AES128_MULTI_LANES];
+	aes128_job jobs[MODES_UT_JOBS];
+	aes128_iovec iov[6];
+	unsigned char iv[MAX_LENGTH], counter[MAX_LENGTH], iov_counter[MAX_LENGTH];
+	size_t x, offset;
+	unsigned int ii;
+	unsigned char pass = TRUE;
+
+	for (x = 0; x < sizeof(Modes_Image_Plain); x++)
+		Modes_Image_Plain[x] = (unsigned char)(x * 11 + 3);
+	for (ii = 0; ii < 4; ii++)
+		aes128_init(&keys[ii], AES_Vectors[ii].Key);
+
+	// Batch- each job a different key and length, packed one after another, against ECB on each job alone
+	for (ii = 0, offset = 0; ii < MODES_UT_JOBS; ii++)
+	{
+		jobs[ii].ctx = &keys[ii & 3];
+		jobs[ii].in = &Modes_Image_Plain[offset];
+		jobs[ii].out = &Modes_Image_Out[offset];
+		jobs[ii].Blocks = (ii * 5) % 7;
+		aes128_ecb_encrypt(jobs[ii].ctx, jobs[ii].in, &Modes_Image_Cipher[offset], jobs[ii].Blocks);
+		offset += jobs[ii].Blocks * MAX_LENGTH;
+	}
+	aes128_encrypt_batch(jobs, MODES_UT_JOBS);
+	pass &= (memcmp(Modes_Image_Out, Modes_Image_Cipher, offset) == 0);
+	for (ii = 0; ii < MODES_UT_JOBS; ii++)
+		jobs[ii].in = jobs[ii].out;
+	aes128_decrypt_batch(jobs, MODES_UT_JOBS);
+	pass &= (memcmp(Modes_Image_Out, Modes_Image_Plain, offset) == 0);
+
+	// Multi- one block per lane, each under its own key, against the single block calls
+	for (ii = 0; ii < AES128_MULTI_LANES; ii++)
+	{
+		lane[ii] = &keys[(ii * 3) & 3];
+		in[ii] = &Modes_Image_Plain[ii * MAX_LENGTH];
+		out[ii] = &Modes_Image_Out[ii * MAX_LENGTH];
+		memcpy(&Modes_Image_Cipher[ii * MAX_LENGTH], in[ii], MAX_LENGTH);
+		aes128_encrypt_block(lane[ii], &Modes_Image_Cipher[ii * MAX_LENGTH]);
+	}
+	aes128_encrypt_multi(lane, in, out, AES128_MULTI_LANES);
+	pass &= (memcmp(Modes_Image_Out, Modes_Image_Cipher, AES128_MULTI_LANES * MAX_LENGTH) == 0);
+	for (ii = 0; ii < AES128_MULTI_LANES; ii++)
+		in[ii] = out[ii];
+	aes128_decrypt_multi(lane, in, out, AES128_MULTI_LANES);
+	pass &= (memcmp(Modes_Image_Out, Modes_Image_Plain, AES128_MULTI_LANES * MAX_LENGTH) == 0);
+
+	// Scatter/gather- odd segment lengths, an empty one among them, against one contiguous CTR call
+	memcpy(counter, AES_CTR_Counter, MAX_LENGTH);
+	memcpy(iov_counter, AES_CTR_Counter, MAX_LENGTH);
+	aes128_ctr_xcrypt(ctx, counter, Modes_Image_Plain, Modes_Image_Cipher, sizeof(Modes_Image_Plain));
+	memcpy(Modes_Image_Out, Modes_Image_Plain, sizeof(Modes_Image_Out));
+	for (ii = 0, offset = 0; ii < 6; ii++)
+	{
+		iov[ii].Base = &Modes_Image_Out[offset];
+		iov[ii].Length = Segment[ii];
+		offset += Segment[ii];
+	}
+	iov[5].Length = sizeof(Modes_Image_Out) - (offset - Segment[5]);
+	aes128_ctr_xcrypt_iov(ctx, iov_counter, iov, 6);
+	pass &= (memcmp(Modes_Image_Out, Modes_Image_Cipher, sizeof(Modes_Image_Out)) == 0);
+	pass &= (memcmp(iov_counter, counter, MAX_LENGTH) == 0);
+
+	// CBC image round trip, out of place then in place
+	memcpy(iv, AES_CBC_IV, MAX_LENGTH);
+	aes128_cbc_encrypt(ctx, iv, Modes_Image_Plain, Modes_Image_Cipher, MODES_UT_BLOCKS);
+	memcpy(iv, AES_CBC_IV, MAX_LENGTH);
+	aes128_cbc_decrypt(ctx, iv, Modes_Image_Cipher, Modes_Image_Out, MODES_UT_BLOCKS);
+	pass &= (memcmp(Modes_Image_Out, Modes_Image_Plain, sizeof(Modes_Image_Out)) == 0);
+	pass &= (memcmp(iv, &Modes_Image_Cipher[(MODES_UT_BLOCKS - 1) * MAX_LENGTH], MAX_LENGTH) == 0);
+	memcpy(iv, AES_CBC_IV, MAX_LENGTH);
+	aes128_cbc_decrypt(ctx, iv, Modes_Image_Cipher, Modes_Image_Cipher, MODES_UT_BLOCKS);
+	pass &= (memcmp(Modes_Image_Cipher, Modes_Image_Plain, sizeof(Modes_Image_Cipher)) == 0);
+	return pass;
+}
+
+// Name: AES_Check_Modes
+// Function: Mode known answers and the batch, multi and scatter/gather paths, under the SP 800-38A key
+//-----------------------------------------------------------------------------------------------
+static unsigned char AES_Check_Modes(void)
+{
+	aes128_ctx ctx;
+	unsigned char pass;
+
+	aes128_init(&ctx, AES_Vectors[1].Key);
+	pass = AES_Check_Modes_Vectors(&ctx);
+	pass &= AES_Check_Modes_Split(&ctx);
+	return pass;
+}
+
+// McGrew/Viega GCM test cases 2, 4 and 6 (AES-128). Case 2 is all zero with no AAD, case 6 has a 60 byte IV that goes
+// through GHASH. Cases 4 and 6 share the key, AAD and plaintext
+typedef struct
+{
+	const unsigned char *Key;
+	const unsigned char *IV;
+	size_t IVLength;
+	const unsigned char *AAD;
+	size_t AADLength;
+	const unsigned char *Plain;
+	const unsigned char *Cipher;
+	size_t Length;
+	unsigned char Tag[GCM_TAG_LENGTH];
+} tGCMVector;
+
+static const unsigned char GCM_Zero[MAX_LENGTH] = {0};
+
+static const unsigned char GCM_Key4[16] =
+{
+	0xfe, 0xff, 0xe9, 0x92, 0x86, 0x65, 0x73, 0x1c, 0x6d, 0x6a, 0x8f, 0x94, 0x67, 0x30, 0x83, 0x08
+};
+
+static const unsigned char GCM_IV4[12] =
+{
+	0xca, 0xfe, 0xba, 0xbe, 0xfa, 0xce, 0xdb, 0xad, 0xde, 0xca, 0xf8, 0x88
+};
+
+static const unsigned char GCM_IV6[60] =
+{
+	0x93, 0x13, 0x22, 0x5d, 0xf8, 0x84, 0x06, 0xe5, 0x55, 0x90, 0x9c, 0x5a, 0xff, 0x52, 0x69, 0xaa,
+	0x6a, 0x7a, 0x95, 0x38, 0x53, 0x4f, 0x7d, 0xa1, 0xe4, 0xc3, 0x03, 0xd2, 0xa3, 0x18, 0xa7, 0x28,
+	0xc3, 0xc0, 0xc9, 0x51, 0x56, 0x80, 0x95, 0x39, 0xfc, 0xf0, 0xe2, 0x42, 0x9a, 0x6b, 0x52, 0x54,
+	0x16, 0xae, 0xdb, 0xf5, 0xa0, 0xde, 0x6a, 0x57, 0xa6, 0x37, 0xb3, 0x9b
+};
+
+static const unsigned char GCM_AAD4[20] =
+{
+	0xfe, 0xed, 0xfa, 0xce, 0xde, 0xad, 0xbe, 0xef, 0xfe, 0xed, 0xfa, 0xce, 0xde, 0xad, 0xbe, 0xef,
+	0xab, 0xad, 0xda, 0xd2
+};
+
+static const unsigned char GCM_Plain4[60] =
+{
+	0xd9, 0x31, 0x32, 0x25, 0xf8, 0x84, 0x06, 0xe5, 0xa5, 0x59, 0x09, 0xc5, 0xaf, 0xf5, 0x26, 0x9a,
+	0x86, 0xa7, 0xa9, 0x53, 0x15, 0x34, 0xf7, 0xda, 0x2e, 0x4c, 0x30, 0x3d, 0x8a, 0x31, 0x8a, 0x72,
+	0x1c, 0x3c, 0x0c, 0x95, 0x95, 0x68, 0x09, 0x53, 0x2f, 0xcf, 0x0e, 0x24, 0x49, 0xa6, 0xb5, 0x25,
+	0xb1, 0x6a, 0xed, 0xf5, 0xaa, 0x0d, 0xe6, 0x57, 0xba, 0x63, 0x7b, 0x39
+};
+
+static const unsigned char GCM_Cipher2[16] =
+{
+	0x03, 0x88, 0xda, 0xce, 0x60, 0xb6, 0xa3, 0x92, 0xf3, 0x28, 0xc2, 0xb9, 0x71, 0xb2, 0xfe, 0x78
+};
+
+static const unsigned char GCM_Cipher4[60] =
+{
+	0x42, 0x83, 0x1e, 0xc2, 0x21, 0x77, 0x74, 0x24, 0x4b, 0x72, 0x21, 0xb7, 0x84, 0xd0, 0xd4, 0x9c,
+	0xe3, 0xaa, 0x21, 0x2f, 0x2c, 0x02, 0xa4, 0xe0, 0x35, 0xc1, 0x7e, 0x23, 0x29, 0xac, 0xa1, 0x2e,
+	0x21, 0xd5, 0x14, 0xb2, 0x54, 0x66, 0x93, 0x1c, 0x7d, 0x8f, 0x6a, 0x5a, 0xac, 0x84, 0xaa, 0x05,
+	0x1b, 0xa3, 0x0b, 0x39, 0x6a, 0x0a, 0xac, 0x97, 0x3d, 0x58, 0xe0, 0x91
+};
+
+static const unsigned char GCM_Cipher6[60] =
+{
+	0x8c, 0xe2, 0x49, 0x98, 0x62, 0x56, 0x15, 0xb6, 0x03, 0xa0, 0x33, 0xac, 0xa1, 0x3f, 0xb8, 0x94,
+	0xbe, 0x91, 0x12, 0xa5, 0xc3, 0xa2, 0x11, 0xa8, 0xba, 0x26, 0x2a, 0x3c, 0xca, 0x7e, 0x2c, 0xa7,
+	0x01, 0xe4, 0xa9, 0xa4, 0xfb, 0xa4, 0x3c, 0x90, 0xcc, 0xdc, 0xb2, 0x81, 0xd4, 0x8c, 0x7c, 0x6f,
+	0xd6, 0x28, 0x75, 0xd2, 0xac, 0xa4, 0x17, 0x03, 0x4c, 0x34, 0xae, 0xe5
+};
+
+static const tGCMVector GCM_Vectors[3] =
+{
+	{ GCM_Zero, GCM_Zero, GCM_IV_LENGTH, NULL, 0, GCM_Zero, GCM_Cipher2, sizeof(GCM_Cipher2),
+		{0xab, 0x6e, 0x47, 0xd4, 0x2c, 0xec, 0x13, 0xbd, 0xf5, 0x3a, 0x67, 0xb2, 0x12, 0x57, 0xbd, 0xdf} },
+	{ GCM_Key4, GCM_IV4, sizeof(GCM_IV4), GCM_AAD4, sizeof(GCM_AAD4), GCM_Plain4, GCM_Cipher4, sizeof(GCM_Cipher4),
+		{0x5b, 0xc9, 0x4f, 0xbc, 0x32, 0x21, 0xa5, 0xdb, 0x94, 0xfa, 0xe9, 0x5a, 0xe7, 0x12, 0x1a, 0x47} },
+	{ GCM_Key4, GCM_IV6, sizeof(GCM_IV6), GCM_AAD4, sizeof(GCM_AAD4), GCM_Plain4, GCM_Cipher6, sizeof(GCM_Cipher6),
+		{0x61, 0x9c, 0xc5, 0xae, 0xff, 0xfe, 0x0b, 0xfa, 0x46, 0x2a, 0xf4, 0x3c, 0x16, 0x99, 0xd0, 0x50} }
+};
+
+// Name: AES_Check_GCM_Vectors
+// Function: Encrypts and decrypts the GCM vectors with contexts from Init, and checks that a tag with one bit flipped is
+//           refused with the output wiped
+//-----------------------------------------------------------------------------------------------
+static unsigned char AES_Check_GCM_Vectors(void (*Init)(aes128_gcm_ctx *ctx, const unsigned char *Key))
+{
+	aes128_gcm_ctx ctx;
+	unsigned char out[64], tag[GCM_TAG_LENGTH];
+	const tGCMVector *v;
+	unsigned int ii;
+	size_t x;
+	unsigned char pass = TRUE;
+
+	for (ii = 0; ii < 3; ii++)
+	{
+		v = &GCM_Vectors[ii];
+		Init(&ctx, v->Key);
+		pass &= (aes128_gcm_encrypt(&ctx, v->IV, v->IVLength, v->AAD, v->AADLength, v->Plain, out, v->Length, tag) == 1);
+		pass &= (memcmp(out, v->Cipher, v->Length) == 0);
+		pass &= (memcmp(tag, v->Tag, GCM_TAG_LENGTH) == 0);
+		pass &= (aes128_gcm_decrypt(&ctx, v->IV, v->IVLength, v->AAD, v->AADLength, v->Cipher, out, v->Length, v->Tag) == 1);
+		pass &= (memcmp(out, v->Plain, v->Length) == 0);
+
+		tag[GCM_TAG_LENGTH - 1] ^= 0x01;
+		pass &= (aes128_gcm_decrypt(&ctx, v->IV, v->IVLength, v->AAD, v->AADLength, v->Cipher, out, v->Length, tag) == 0);
+		for (x = 0; x < v->Length; x++)
+			pass &= (out[x] == 0);
+	}
+	return pass;
+}
+
+// Name: AES_Check_GCM
+// Function: GCM vectors through aes128_gcm_init (PCLMULQDQ where the CPU has it) and through the table-only test entry,
+//           an 8 block aggregated run compared between the two, and the SP 800-38D length limits
+//-----------------------------------------------------------------------------------------------
+static unsigned char AES_Check_GCM(void)
+{
+	aes128_gcm_ctx ctx, table_ctx;
+	unsigned char data[300], aad[150], selected[300], table[300], selected_tag[GCM_TAG_LENGTH], tag[GCM_TAG_LENGTH];
+	unsigned int ii;
+	unsigned char pass;
+
+	pass = AES_Check_GCM_Vectors(aes128_gcm_init);
+	pass &= AES_Check_GCM_Vectors(GCM_Init_Table);
+
+	// Both contexts live side by side- each keeps the multiplier it was initialised with
+	for (ii = 0; ii < sizeof(data); ii++)
+		data[ii] = (unsigned char)(ii * 7 + 1);
+	for (ii = 0; ii < sizeof(aad); ii++)
+		aad[ii] = (unsigned char)(ii * 13 + 5);
+	aes128_gcm_init(&ctx, GCM_Key4);
+	GCM_Init_Table(&table_ctx, GCM_Key4);
+	pass &= (table_ctx.UseCLMUL == 0);
+	aes128_gcm_encrypt(&ctx, GCM_IV4, sizeof(GCM_IV4), aad, sizeof(aad), data, selected, sizeof(data), selected_tag);
+	aes128_gcm_encrypt(&table_ctx, GCM_IV4, sizeof(GCM_IV4), aad, sizeof(aad), data, table, sizeof(data), tag);
+	pass &= (memcmp(selected, table, sizeof(data)) == 0);
+	pass &= (memcmp(selected_tag, tag, GCM_TAG_LENGTH) == 0);
+
+	// An empty IV and over-long input must be refused before anything is touched. The length limit is only reachable
+	// where size_t is wider than 36 bits
+	aes128_gcm_init(&ctx, GCM_Zero);
+	pass &= (aes128_gcm_encrypt(&ctx, GCM_Zero, 0, NULL, 0, GCM_Zero, tag, MAX_LENGTH, tag) == 0);
+#if SIZE_MAX > 0xFFFFFFFFu
+	pass &= (aes128_gcm_encrypt(&ctx, GCM_Zero, GCM_IV_LENGTH, NULL, 0, GCM_Zero, tag, (size_t)GCM_MAX_LENGTH + 1, tag) == 0);
+	pass &= (aes128_gcm_decrypt(&ctx, GCM_Zero, GCM_IV_LENGTH, NULL, 0, GCM_Zero, tag, (size_t)GCM_MAX_LENGTH + 1, tag) == 0);
+#endif
+	return pass;
+}
+
+// IEEE 1619 XTS-AES-128 vectors 2, 3 (whole blocks), 15 and 18 (17 and 20 bytes, ciphertext stealing). Vector 1 has K1 == K2,
+// which aes128_xts_init now refuses. Vector 4 (512 bytes, data unit 0) is checked through the sectors calls
+typedef struct
+{
+	const unsigned char *DataKey;
+	const unsigned char *TweakKey;
+	unsigned char Tweak[XTS_TWEAK_LENGTH];
+	const unsigned char *Plain;
+	const unsigned char *Cipher;
+	size_t Length;
+} tXTSVector;
+
+static const unsigned char XTS_Key1_2[16] =
+{
+	0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11
+};
+
+static const unsigned char XTS_Key2_2[16] =
+{
+	0x22, 0x22, 0x22, 0x22, 0x22, 0x22, 0x22, 0x22, 0x22, 0x22, 0x22, 0x22, 0x22, 0x22, 0x22, 0x22
+};
+
+static const unsigned char XTS_Key1_3[16] =
+{
+	0xff, 0xfe, 0xfd, 0xfc, 0xfb, 0xfa, 0xf9, 0xf8, 0xf7, 0xf6, 0xf5, 0xf4, 0xf3, 0xf2, 0xf1, 0xf0
+};
+
+static const unsigned char XTS_Key2_15[16] =
+{
+	0xbf, 0xbe, 0xbd, 0xbc, 0xbb, 0xba, 0xb9, 0xb8, 0xb7, 0xb6, 0xb5, 0xb4, 0xb3, 0xb2, 0xb1, 0xb0
+};
+
+static const unsigned char XTS_Key1_4[16] =
+{
+	0x27, 0x18, 0x28, 0x18, 0x28, 0x45, 0x90, 0x45, 0x23, 0x53, 0x60, 0x28, 0x74, 0x71, 0x35, 0x26
+};
+
+static const unsigned char XTS_Key2_4[16] =
+{
+	0x31, 0x41, 0x59, 0x26, 0x53, 0x58, 0x97, 0x93, 0x23, 0x84, 0x62, 0x64, 0x33, 0x83, 0x27, 0x95
+};
+
+static const unsigned char XTS_Plain2[32] =
+{
+	0x44, 0x44, 0x44, 0x44, 0x44, 0x44, 0x44, 0x44, 0x44, 0x44, 0x44, 0x44, 0x44, 0x44, 0x44, 0x44,
+	0x44, 0x44, 0x44, 0x44, 0x44, 0x44, 0x44, 0x44, 0x44, 0x44, 0x44, 0x44, 0x44, 0x44, 0x44, 0x44
+};
+
+static const unsigned char XTS_Plain15[20] =
+{
+	0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f,
+	0x10, 0x11, 0x12, 0x13
+};
+
+static const unsigned char XTS_Cipher2[32] =
+{
+	0xc4, 0x54, 0x18, 0x5e, 0x6a, 0x16, 0x93, 0x6e, 0x39, 0x33, 0x40, 0x38, 0xac, 0xef, 0x83, 0x8b,
+	0xfb, 0x18, 0x6f, 0xff, 0x74, 0x80, 0xad, 0xc4, 0x28, 0x93, 0x82, 0xec, 0xd6, 0xd3, 0x94, 0xf0
+};
+
+static const unsigned char XTS_Cipher3[32] =
+{
+	0xaf, 0x85, 0x33, 0x6b, 0x59, 0x7a, 0xfc, 0x1a, 0x90, 0x0b, 0x2e, 0xb2, 0x1e, 0xc9, 0x49, 0xd2,
+	0x92, 0xdf, 0x4c, 0x04, 0x7e, 0x0b, 0x21, 0x53, 0x21, 0x86, 0xa5, 0x97, 0x1a, 0x22, 0x7a, 0x89
+};
+
+static const unsigned char XTS_Cipher15[17] =
+{
+	0x6c, 0x16, 0x25, 0xdb, 0x46, 0x71, 0x52, 0x2d, 0x3d, 0x75, 0x99, 0x60, 0x1d, 0xe7, 0xca, 0x09,
+	0xed
+};
+
+static const unsigned char XTS_Cipher18[20] =
+{
+	0x9d, 0x84, 0xc8, 0x13, 0xf7, 0x19, 0xaa, 0x2c, 0x7b, 0xe3, 0xf6, 0x61, 0x71, 0xc7, 0xc5, 0xc2,
+	0xed, 0xbf, 0x9d, 0xac
+};
+
+static const unsigned char XTS_Cipher4[512] =
+{
+	0x27, 0xa7, 0x47, 0x9b, 0xef, 0xa1, 0xd4, 0x76, 0x48, 0x9f, 0x30, 0x8c, 0xd4, 0xcf, 0xa6, 0xe2,
+	0xa9, 0x6e, 0x4b, 0xbe, 0x32, 0x08, 0xff, 0x25, 0x28, 0x7d, 0xd3, 0x81, 0x96, 0x16, 0xe8, 0x9c,
+	0xc7, 0x8c, 0xf7, 0xf5, 0xe5, 0x43, 0x44, 0x5f, 0x83, 0x33, 0xd8, 0xfa, 0x7f, 0x56, 0x00, 0x00,
+	0x05, 0x27, 0x9f, 0xa5, 0xd8, 0xb5, 0xe4, 0xad, 0x40, 0xe7, 0x36, 0xdd, 0xb4, 0xd3, 0x54, 0x12,
+	0x32, 0x80, 0x63, 0xfd, 0x2a, 0xab, 0x53, 0xe5, 0xea, 0x1e, 0x0a, 0x9f, 0x33, 0x25, 0x00, 0xa5,
+	0xdf, 0x94, 0x87, 0xd0, 0x7a, 0x5c, 0x92, 0xcc, 0x51, 0x2c, 0x88, 0x66, 0xc7, 0xe8, 0x60, 0xce,
+	0x93, 0xfd, 0xf1, 0x66, 0xa2, 0x49, 0x12, 0xb4, 0x22, 0x97, 0x61, 0x46, 0xae, 0x20, 0xce, 0x84,
+	0x6b, 0xb7, 0xdc, 0x9b, 0xa9, 0x4a, 0x76, 0x7a, 0xae, 0xf2, 0x0c, 0x0d, 0x61, 0xad, 0x02, 0x65,
+	0x5e, 0xa9, 0x2d, 0xc4, 0xc4, 0xe4, 0x1a, 0x89, 0x52, 0xc6, 0x51, 0xd3, 0x31, 0x74, 0xbe, 0x51,
+	0xa1, 0x0c, 0x42, 0x11, 0x10, 0xe6, 0xd8, 0x15, 0x88, 0xed, 0xe8, 0x21, 0x03, 0xa2, 0x52, 0xd8,
+	0xa7, 0x50, 0xe8, 0x76, 0x8d, 0xef, 0xff, 0xed, 0x91, 0x22, 0x81, 0x0a, 0xae, 0xb9, 0x9f, 0x91,
+	0x72, 0xaf, 0x82, 0xb6, 0x04, 0xdc, 0x4b, 0x8e, 0x51, 0xbc, 0xb0, 0x82, 0x35, 0xa6, 0xf4, 0x34,
+	0x13, 0x32, 0xe4, 0xca, 0x60, 0x48, 0x2a, 0x4b, 0xa1, 0xa0, 0x3b, 0x3e, 0x65, 0x00, 0x8f, 0xc5,
+	0xda, 0x76, 0xb7, 0x0b, 0xf1, 0x69, 0x0d, 0xb4, 0xea, 0xe2, 0x9c, 0x5f, 0x1b, 0xad, 0xd0, 0x3c,
+	0x5c, 0xcf, 0x2a, 0x55, 0xd7, 0x05, 0xdd, 0xcd, 0x86, 0xd4, 0x49, 0x51, 0x1c, 0xeb, 0x7e, 0xc3,
+	0x0b, 0xf1, 0x2b, 0x1f, 0xa3, 0x5b, 0x91, 0x3f, 0x9f, 0x74, 0x7a, 0x8a, 0xfd, 0x1b, 0x13, 0x0e,
+	0x94, 0xbf, 0xf9, 0x4e, 0xff, 0xd0, 0x1a, 0x91, 0x73, 0x5c, 0xa1, 0x72, 0x6a, 0xcd, 0x0b, 0x19,
+	0x7c, 0x4e, 0x5b, 0x03, 0x39, 0x36, 0x97, 0xe1, 0x26, 0x82, 0x6f, 0xb6, 0xbb, 0xde, 0x8e, 0xcc,
+	0x1e, 0x08, 0x29, 0x85, 0x16, 0xe2, 0xc9, 0xed, 0x03, 0xff, 0x3c, 0x1b, 0x78, 0x60, 0xf6, 0xde,
+	0x76, 0xd4, 0xce, 0xcd, 0x94, 0xc8, 0x11, 0x98, 0x55, 0xef, 0x52, 0x97, 0xca, 0x67, 0xe9, 0xf3,
+	0xe7, 0xff, 0x72, 0xb1, 0xe9, 0x97, 0x85, 0xca, 0x0a, 0x7e, 0x77, 0x20, 0xc5, 0xb3, 0x6d, 0xc6,
+	0xd7, 0x2c, 0xac, 0x95, 0x74, 0xc8, 0xcb, 0xbc, 0x2f, 0x80, 0x1e, 0x23, 0xe5, 0x6f, 0xd3, 0x44,
+	0xb0, 0x7f, 0x22, 0x15, 0x4b, 0xeb, 0xa0, 0xf0, 0x8c, 0xe8, 0x89, 0x1e, 0x64, 0x3e, 0xd9, 0x95,
+	0xc9, 0x4d, 0x9a, 0x69, 0xc9, 0xf1, 0xb5, 0xf4, 0x99, 0x02, 0x7a, 0x78, 0x57, 0x2a, 0xee, 0xbd,
+	0x74, 0xd2, 0x0c, 0xc3, 0x98, 0x81, 0xc2, 0x13, 0xee, 0x77, 0x0b, 0x10, 0x10, 0xe4, 0xbe, 0xa7,
+	0x18, 0x84, 0x69, 0x77, 0xae, 0x11, 0x9f, 0x7a, 0x02, 0x3a, 0xb5, 0x8c, 0xca, 0x0a, 0xd7, 0x52,
+	0xaf, 0xe6, 0x56, 0xbb, 0x3c, 0x17, 0x25, 0x6a, 0x9f, 0x6e, 0x9b, 0xf1, 0x9f, 0xdd, 0x5a, 0x38,
+	0xfc, 0x82, 0xbb, 0xe8, 0x72, 0xc5, 0x53, 0x9e, 0xdb, 0x60, 0x9e, 0xf4, 0xf7, 0x9c, 0x20, 0x3e,
+	0xbb, 0x14, 0x0f, 0x2e, 0x58, 0x3c, 0xb2, 0xad, 0x15, 0xb4, 0xaa, 0x5b, 0x65, 0x50, 0x16, 0xa8,
+	0x44, 0x92, 0x77, 0xdb, 0xd4, 0x77, 0xef, 0x2c, 0x8d, 0x6c, 0x01, 0x7d, 0xb7, 0x38, 0xb1, 0x8d,
+	0xeb, 0x4a, 0x42, 0x7d, 0x19, 0x23, 0xce, 0x3f, 0xf2, 0x62, 0x73, 0x57, 0x79, 0xa4, 0x18, 0xf2,
+	0x0a, 0x28, 0x2d, 0xf9, 0x20, 0x14, 0x7b, 0xea, 0xbe, 0x42, 0x1e, 0xe5, 0x31, 0x9d, 0x05, 0x68
+};
+
+static const tXTSVector XTS_Vectors[4] =
+{
+	{ XTS_Key1_2, XTS_Key2_2, {0x33, 0x33, 0x33, 0x33, 0x33}, XTS_Plain2, XTS_Cipher2, sizeof(XTS_Cipher2) },
+	{ XTS_Key1_3, XTS_Key2_2, {0x33, 0x33, 0x33, 0x33, 0x33}, XTS_Plain2, XTS_Cipher3, sizeof(XTS_Cipher3) },
+	{ XTS_Key1_3, XTS_Key2_15, {0x9a, 0x78, 0x56, 0x34, 0x12}, XTS_Plain15, XTS_Cipher15, sizeof(XTS_Cipher15) },
+	{ XTS_Key1_3, XTS_Key2_15, {0x9a, 0x78, 0x56, 0x34, 0x12}, XTS_Plain15, XTS_Cipher18, sizeof(XTS_Cipher18) }
+};
+
+// Sectors round trip. With AES_THREADS the image is big enough for the split over two 64K workers
+#ifdef AES_THREADS
+#define XTS_UT_SECTORS			272
+#else
+#define XTS_UT_SECTORS			16
+#endif
+#define XTS_UT_SECTOR_LENGTH	520		// Largest sector size tried- 512 whole blocks, 520 ends in a stolen block
+
+static unsigned char XTS_Image_Plain[XTS_UT_SECTORS * XTS_UT_SECTOR_LENGTH];
+static unsigned char XTS_Image_Cipher[XTS_UT_SECTORS * XTS_UT_SECTOR_LENGTH];
+
+// Name: AES_Check_XTS_Sectors
+// Function: Encrypts an image of XTS_UT_SECTORS sectors in one call, checks sampled sectors against aes128_xts_encrypt
+//           under their own sector number, and decrypts the image back in place
+//-----------------------------------------------------------------------------------------------
+static unsigned char AES_Check_XTS_Sectors(const aes128_xts_ctx *ctx, size_t SectorLength)
+{
+	static const size_t Sample[4] = {0, 1, XTS_UT_SECTORS / 2, XTS_UT_SECTORS - 1};
+	unsigned char tweak[XTS_TWEAK_LENGTH], check[XTS_UT_SECTOR_LENGTH];
+	size_t x, Length = XTS_UT_SECTORS * SectorLength;
+	unsigned int ii;
+	unsigned char pass = TRUE;
+
+	for (x = 0; x < Length; x++)
+		XTS_Image_Plain[x] = (unsigned char)x;
+	pass &= (aes128_xts_encrypt_sectors(ctx, 0, SectorLength, XTS_Image_Plain, XTS_Image_Cipher, XTS_UT_SECTORS) == 1);
+
+	for (ii = 0; ii < 4; ii++)
+	{
+		memset(tweak, 0, sizeof(tweak));
+		tweak[0] = (unsigned char)Sample[ii];
+		tweak[1] = (unsigned char)(Sample[ii] >> 8);
+		aes128_xts_encrypt(ctx, tweak, &XTS_Image_Plain[Sample[ii] * SectorLength], check, SectorLength);
+		pass &= (memcmp(check, &XTS_Image_Cipher[Sample[ii] * SectorLength], SectorLength) == 0);
+	}
+
+	pass &= (aes128_xts_decrypt_sectors(ctx, 0, SectorLength, XTS_Image_Cipher, XTS_Image_Cipher, XTS_UT_SECTORS) == 1);
+	pass &= (memcmp(XTS_Image_Cipher, XTS_Image_Plain, Length) == 0);
+	return pass;
+}
+
+// Name: AES_Check_XTS
+// Function: IEEE 1619 vectors both ways, equal keys and short data units refused, vector 4 as sector 0 of a sectors round trip
+//-----------------------------------------------------------------------------------------------
+static unsigned char AES_Check_XTS(void)
+{
+	aes128_xts_ctx ctx;
+	unsigned char out[32];
+	const tXTSVector *v;
+	unsigned int ii;
+	unsigned char pass = TRUE;
+
+	pass &= (aes128_xts_init(&ctx, GCM_Zero, GCM_Zero) == 0);
+
+	for (ii = 0; ii < 4; ii++)
+	{
+		v = &XTS_Vectors[ii];
+		pass &= (aes128_xts_init(&ctx, v->DataKey, v->TweakKey) == 1);
+		pass &= (aes128_xts_encrypt(&ctx, v->Tweak, v->Plain, out, v->Length) == 1);
+		pass &= (memcmp(out, v->Cipher, v->Length) == 0);
+		pass &= (aes128_xts_decrypt(&ctx, v->Tweak, out, out, v->Length) == 1);
+		pass &= (memcmp(out, v->Plain, v->Length) == 0);
+	}
+	pass &= (aes128_xts_encrypt(&ctx, XTS_Vectors[0].Tweak, XTS_Plain15, out, MAX_LENGTH - 1) == 0);
+
+	aes128_xts_init(&ctx, XTS_Key1_4, XTS_Key2_4);
+	pass &= AES_Check_XTS_Sectors(&ctx, sizeof(XTS_Cipher4));
+	aes128_xts_encrypt_sectors(&ctx, 0, sizeof(XTS_Cipher4), XTS_Image_Plain, XTS_Image_Cipher, 1);
+	pass &= (memcmp(XTS_Image_Cipher, XTS_Cipher4, sizeof(XTS_Cipher4)) == 0);
+	pass &= AES_Check_XTS_Sectors(&ctx, XTS_UT_SECTOR_LENGTH);
+	return pass;
+}
+
+// RFC 4493 section 4 CMAC examples: the SP 800-38A plaintext cut to 0, 16, 40 and 64 bytes under the key of AES_Vectors[1]
+static const size_t CMAC_Lengths[4] = {0, 16, 40, 64};
+
+static const unsigned char CMAC_Tags[4][CMAC_TAG_LENGTH] =
+{
+	{0xbb, 0x1d, 0x69, 0x29, 0xe9, 0x59, 0x37, 0x28, 0x7f, 0xa3, 0x7d, 0x12, 0x9b, 0x75, 0x67, 0x46},
+	{0x07, 0x0a, 0x16, 0xb4, 0x6b, 0x4d, 0x41, 0x44, 0xf7, 0x9b, 0xdd, 0x9d, 0xd0, 0x4a, 0x28, 0x7c},
+	{0xdf, 0xa6, 0x67, 0x47, 0xde, 0x9a, 0xe6, 0x30, 0x30, 0xca, 0x32, 0x61, 0x14, 0x97, 0xc8, 0x27},
+	{0x51, 0xf0, 0xbe, 0xbf, 0x7e, 0x3b, 0x9d, 0x92, 0xfc, 0x49, 0x74, 0x17, 0x79, 0x36, 0x3c, 0xfe}
+};
+
+#define CMAC_UT_JOBS		11		// More than AES128_MULTI_LANES so finished lanes are refilled from the queue
+#define CMAC_UT_BAD_JOB		6
+
+// Name: AES_Check_CMAC
+// Function: RFC 4493 vectors one shot and through aes128_cmac_verify, streamed in two pieces split at every byte, then a
+//           batch of mixed lengths whose tags are written and verified with one of them corrupted
+//-----------------------------------------------------------------------------------------------
+static unsigned char AES_Check_CMAC(void)
+{
+	const unsigned char *Message = (const unsigned char *)AES_ECB_Plain;
+	aes128_cmac_ctx ctx;
+	aes128_cmac_job jobs[CMAC_UT_JOBS];
+	unsigned char tags[CMAC_UT_JOBS][CMAC_TAG_LENGTH], tag[CMAC_TAG_LENGTH];
+	unsigned char valid[CMAC_UT_JOBS];
+	size_t split;
+	unsigned int ii;
+	unsigned char pass = TRUE;
+
+	aes128_cmac_init(&ctx, AES_Vectors[1].Key);
+	for (ii = 0; ii < 4; ii++)
+	{
+		aes128_cmac(AES_Vectors[1].Key, Message, CMAC_Lengths[ii], tag);
+		pass &= (memcmp(tag, CMAC_Tags[ii], CMAC_TAG_LENGTH) == 0);
+		pass &= (aes128_cmac_verify(&ctx, Message, CMAC_Lengths[ii], CMAC_Tags[ii]) == 1);
+
+		for (split = 0; split <= CMAC_Lengths[ii]; split++)
+		{
+			aes128_cmac_update(&ctx, Message, split);
+			aes128_cmac_update(&ctx, Message + split, CMAC_Lengths[ii] - split);
+			aes128_cmac_final(&ctx, tag);
+			pass &= (memcmp(tag, CMAC_Tags[ii], CMAC_TAG_LENGTH) == 0);
+		}
+	}
+
+	for (ii = 0; ii < CMAC_UT_JOBS; ii++)
+	{
+		jobs[ii].ctx = &ctx;
+		jobs[ii].in = Message;
+		jobs[ii].Length = CMAC_Lengths[(ii * 3) & 3];
+		jobs[ii].Tag = tags[ii];
+	}
+	aes128_cmac_batch(jobs, CMAC_UT_JOBS);
+	for (ii = 0; ii < CMAC_UT_JOBS; ii++)
+		pass &= (memcmp(tags[ii], CMAC_Tags[(ii * 3) & 3], CMAC_TAG_LENGTH) == 0);
+
+	tags[CMAC_UT_BAD_JOB][0] ^= 0x80;
+	pass &= (aes128_cmac_verify_batch(jobs, CMAC_UT_JOBS, valid) == 0);
+	for (ii = 0; ii < CMAC_UT_JOBS; ii++)
+		pass &= (valid[ii] == (ii != CMAC_UT_BAD_JOB));
+	return pass;
+}
+
+void AESUT(void){
+		unsigned char block[MAX_LENGTH];
+		unsigned char ii;
+		unsigned char pass = TRUE;
+
+		Debug("Entering AES Unit Test...", TRUE);
+		for (ii = 0; ii < 4; ii++)
+			pass &= AES_Check_Vector(&AES_Vectors[ii]);
+
+		// Every engine compiled in, not only the one selected at startup
+		pass &= AES_Check_Engine(&Portable_Backend);
+#ifdef AES_NI
+		if (AESNI_Supported())
+			pass &= AES_Check_Engine(&AESNI_Backend);
+#endif
+#ifdef AES_BITSLICE
+		pass &= AES_Check_Engine(&Bitslice_Backend);
+#endif
+
+		pass &= AES_Check_Modes();
+		pass &= AES_Check_GCM();
+		pass &= AES_Check_XTS();
+		pass &= AES_Check_CMAC();
+
+		// KeyIndex wrappers must round trip
+		memcpy(block, AES_Vectors[0].Plain, MAX_LENGTH);
+		cipher_AES(block, 1);
+		decipher_AES(block, 1);
+		pass &= (memcmp(block, AES_Vectors[0].Plain, MAX_LENGTH) == 0);
+
+		Debug(pass ? "AES known answer tests passed!" : "AES known answer tests FAILED!", TRUE);
+}
+
+#ifdef AES_THREAD_UT
+
+typedef struct
+{
+	unsigned char Legacy;						// TRUE- go through cipher_AES/decipher_AES, FALSE- the context API
+	unsigned char KeyIndex;						// Legacy key used
+	unsigned char Key[MAX_LENGTH];				// Context API key, straight from AES_Vectors
+	unsigned char Plain[MAX_LENGTH];
+	unsigned char Cipher[MAX_LENGTH];			// Expected result- the vector's own ciphertext, or for the legacy keys the
+												// context API's answer once that has matched the vector table
+	unsigned long Iterations;
+	unsigned char Pass;
+} tAESThreadJob;
+
+// Name: AES_Thread_Worker
+// Function: Hammers either the context API with a known answer vector or the KeyIndex wrappers, every result is checked
+//-----------------------------------------------------------------------------------------------
+static void *AES_Thread_Worker(void *arg)
+{
+	tAESThreadJob *job = (tAESThreadJob *)arg;
+	aes128_ctx ctx;
+	unsigned char block[MAX_LENGTH];
+	unsigned long n;
+
+	// The block is carried from one iteration to the next so every round is really executed
+	job->Pass = TRUE;
+	memcpy(block, job->Plain, MAX_LENGTH);
+	for (n = 0; n < job->Iterations; n++)
+	{
+		if (job->Legacy)
+			cipher_AES(block, job->KeyIndex);
+		else
+		{
+			aes128_init(&ctx, job->Key);
+			aes128_encrypt_block(&ctx, block);
+		}
+		if (memcmp(block, job->Cipher, MAX_LENGTH) != 0)
+		{
+			job->Pass = FALSE;
+			break;
+		}
+		if (job->Legacy)
+			decipher_AES(block, job->KeyIndex);
+		else
+			aes128_decrypt_block(&ctx, block);
+		if (memcmp(block, job->Plain, MAX_LENGTH) != 0)
+		{
+			job->Pass = FALSE;
+			break;
+		}
+	}
+	return NULL;
+}
+
+// Name: AESThreadUT
+// Function: Runs Threads workers concurrently and reports throughput so scaling can be compared. Even threads use the context
+//           API on the unmodified AES_Vectors entries; odd threads share the KeyIndex 0/1 wrappers (and with AES_KEYSTORE the
+//           shared schedules). The R_Keys have no published vectors, so their expected results come from aes128_init on the raw key
+//           once the vector table has passed, never from the wrappers under test
+// Parameters: Number of threads, number of encrypt + decrypt iterations per thread
+//-----------------------------------------------------------------------------------------------
+void AESThreadUT(unsigned int Threads, unsigned long Iterations){
+		pthread_t tid[64];
+		tAESThreadJob job[64];
+		aes128_ctx ctx;
+		struct timespec start, stop;
+		char dispinfo[64];
+		double elapsed;
+		unsigned int ii, started;
+		unsigned char pass = TRUE;
+
+		if (Threads > 64)
+			Threads = 64;
+		if (Threads == 0)
+			Threads = 1;
+
+		Debug("Entering AES multi-threaded Unit Test...", TRUE);
+
+		// The engine must match the vector table before it is trusted for the legacy keys' expected results
+		for (ii = 0; ii < 4; ii++)
+			pass &= AES_Check_Vector(&AES_Vectors[ii]);
+
+		for (ii = 0; ii < Threads; ii++)
+		{
+			job[ii].Legacy = (unsigned char)(ii & 1);
+			job[ii].KeyIndex = (unsigned char)((ii >> 1) & 1);
+			memcpy(job[ii].Key, AES_Vectors[(ii >> 1) % 4].Key, MAX_LENGTH);
+			memcpy(job[ii].Plain, AES_Vectors[(ii >> 1) % 4].Plain, MAX_LENGTH);
+			if (job[ii].Legacy)
+			{
+				memcpy(job[ii].Cipher, job[ii].Plain, MAX_LENGTH);
+				aes128_init(&ctx, (job[ii].KeyIndex == 1) ? Key1 : Base_Key);
+				aes128_encrypt_block(&ctx, job[ii].Cipher);
+			}
+			else
+				memcpy(job[ii].Cipher, AES_Vectors[(ii >> 1) % 4].Cipher, MAX_LENGTH);
+			job[ii].Iterations = Iterations;
+		}
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for (started = 1; started < Threads; started++)
+		{
+			if (pthread_create(&tid[started], NULL, AES_Thread_Worker, &job[started]) != 0)
+				break;
+		}
+		AES_Thread_Worker(&job[0]);
+		// Anything that failed to start is done on this thread
+		for (ii = started; ii < Threads; ii++)
+			AES_Thread_Worker(&job[ii]);
+		for (ii = 1; ii < started; ii++)
+			pthread_join(tid[ii], NULL);
+		clock_gettime(CLOCK_MONOTONIC, &stop);
+		for (ii = 0; ii < Threads; ii++)
+			pass &= job[ii].Pass;
+
+		elapsed = (stop.tv_sec - start.tv_sec) + (stop.tv_nsec - start.tv_nsec) / 1e9;
+		sprintf(dispinfo, "%u threads (%u started): %.0f blocks/s", Threads, started, (2.0 * Threads * Iterations) / elapsed);
+		Debug(dispinfo, TRUE);
+		Debug(pass ? "AES multi-threaded test passed!" : "AES multi-threaded test FAILED!", TRUE);
+}
 
+#endif
@@ -19,7 +19,80 @@
 // Definitions
 //-------------
 #define MAX_LENGTH	16
-
+// Define AES_TTABLE to build the 32-bit T-table round engine (hosts). Leave undefined for the compact byte engine (HCS08 etc.)
+//#define AES_TTABLE
+// Define AES_NI on x86 hosts to build aes_ni.c. It is only used when CPUID reports AES-NI, otherwise the portable engine runs
+//#define AES_NI
+// Define AES_BITSLICE (GCC/Clang hosts) to build the constant-time bitsliced engine in aes_bitslice.c. It replaces the table
+// engines whenever AES-NI is not available
+//#define AES_BITSLICE
+// Define AES_KEYSTORE to expand the cipher_AES/decipher_AES KeyIndex 0/1 schedules once and share them without locking (-pthread)
+//#define AES_KEYSTORE
+#define AES128_ROUNDS	10
+#define AES128_SCHEDULE_LENGTH	((AES128_ROUNDS + 1) * MAX_LENGTH)		// 176 byte expanded key
+#define AES128_MULTI_LANES		8		// Independent blocks, each with its own key, taken by aes128_encrypt_multi
+
+#include <stddef.h>
+#if defined(AES_TTABLE) || defined(AES_BITSLICE)
+#include <stdint.h>
+#endif
+
+// Key context- holds the expanded schedule so it is generated once and reused for every block
+typedef struct
+{
+	unsigned char KeyGen[AES128_SCHEDULE_LENGTH];
+#ifdef AES_TTABLE
+	uint32_t EncRK[4 * (AES128_ROUNDS + 1)];		// Round keys as big-endian column words
+	uint32_t DecRK[4 * (AES128_ROUNDS + 1)];		// Equivalent inverse cipher schedule, InvMixColumns pre-applied
+#endif
+#ifdef AES_NI
+	unsigned char DecKeyGen[AES128_SCHEDULE_LENGTH];	// AESDEC schedule, AESIMC pre-applied
+#endif
+#ifdef AES_BITSLICE
+	uint64_t BSKey[8 * (AES128_ROUNDS + 1)];		// Round keys as bit planes for the bitsliced engine
+#endif
+} aes128_ctx;
+
+// The engines compiled in change the size of aes128_ctx (176 bytes with none, over 1400 with all three), so every file that
+// includes this header must be built with the same AES_TTABLE/AES_NI/AES_BITSLICE flags as the library. The functions that
+// fill in a context the caller allocated are linked under names that spell the flags out, so a mismatch fails to link
+// (undefined reference to aes128_init_cfg_ni etc.) instead of overrunning the caller's context at run time
+#ifdef AES_TTABLE
+#define AES128_CFG_TT	_tt
+#else
+#define AES128_CFG_TT
+#endif
+#ifdef AES_NI
+#define AES128_CFG_NI	_ni
+#else
+#define AES128_CFG_NI
+#endif
+#ifdef AES_BITSLICE
+#define AES128_CFG_BS	_bs
+#else
+#define AES128_CFG_BS
+#endif
+#define AES128_CFG_JOIN(Name, tt, ni, bs)	Name##_cfg##tt##ni##bs
+#define AES128_CFG_EXPAND(Name, tt, ni, bs)	AES128_CFG_JOIN(Name, tt, ni, bs)
+#define AES128_LINK_NAME(Name)				AES128_CFG_EXPAND(Name, AES128_CFG_TT, AES128_CFG_NI, AES128_CFG_BS)
+
+#define aes128_init		AES128_LINK_NAME(aes128_init)
+
+// One record for the batch calls- Blocks 16 byte blocks from in to out (may be equal) under ctx
+typedef struct
+{
+	const aes128_ctx *ctx;
+	const unsigned char *in;
+	unsigned char *out;
+	size_t Blocks;
+} aes128_job;
+
+// One segment for the scatter/gather calls- same layout as POSIX struct iovec
+typedef struct
+{
+	unsigned char *Base;
+	size_t Length;
+} aes128_iovec;
 
 
 
@@ -38,6 +111,32 @@
 void cipher_AES(unsigned char *Plain_Data, unsigned char KeyIndex);
 void decipher_AES(unsigned char *Plain_Data, unsigned char KeyIndex);
 
+void aes128_init(aes128_ctx *ctx, const unsigned char *Key);
+void aes128_encrypt_block(const aes128_ctx *ctx, unsigned char *Plain_Data);
+void aes128_decrypt_block(const aes128_ctx *ctx, unsigned char *Plain_Data);
+void aes128_encrypt_blocks(const aes128_ctx *ctx, unsigned char *Data, size_t Blocks);
+void aes128_decrypt_blocks(const aes128_ctx *ctx, unsigned char *Data, size_t Blocks);
+void aes128_encrypt_multi(const aes128_ctx *const *ctx, const unsigned char *const *in, unsigned char *const *out, unsigned int Count);
+void aes128_decrypt_multi(const aes128_ctx *const *ctx, const unsigned char *const *in, unsigned char *const *out, unsigned int Count);
+const char *aes128_backend_name(void);
+
+// Modes (aes_modes.c)
+void aes128_ctr_xcrypt(const aes128_ctx *ctx, unsigned char *Counter, const unsigned char *in, unsigned char *out, size_t Length);
+void aes128_ctr_xcrypt_iov(const aes128_ctx *ctx, unsigned char *Counter, const aes128_iovec *Segments, size_t Count);
+void aes128_ecb_encrypt(const aes128_ctx *ctx, const unsigned char *in, unsigned char *out, size_t Blocks);
+void aes128_ecb_decrypt(const aes128_ctx *ctx, const unsigned char *in, unsigned char *out, size_t Blocks);
+void aes128_cbc_encrypt(const aes128_ctx *ctx, unsigned char *IV, const unsigned char *in, unsigned char *out, size_t Blocks);
+void aes128_cbc_decrypt(const aes128_ctx *ctx, unsigned char *IV, const unsigned char *in, unsigned char *out, size_t Blocks);
+void aes128_encrypt_batch(const aes128_job *Jobs, size_t Count);
+void aes128_decrypt_batch(const aes128_job *Jobs, size_t Count);
+
+// Unit test Prototypes
+//----------------------
+void AESUT(void);
+#ifdef AES_THREAD_UT
+void AESThreadUT(unsigned int Threads, unsigned long Iterations);
+#endif
+
 
 
  
@@ -0,0 +1,52 @@
+//       
+//               Filename: aes_backend.h
+//               Description: Internal dispatch table shared by the AES round engines. Not for use by application code
+//
+//
+//------------------------------------------------------------------------------------------------------------------------------------
+
+#ifndef AES_BACKEND_H_
+#define AES_BACKEND_H_
+
+#include "aes.h"
+#include "aes_gcm.h"
+
+// Definitions
+//-------------
+
+// One entry per round engine. The public aes128_* calls forward through the entry selected at startup
+typedef struct
+{
+	const char *Name;
+	void (*Init)(aes128_ctx *ctx, const unsigned char *Key);
+	void (*Encrypt)(const aes128_ctx *ctx, unsigned char *Plain_Data);
+	void (*Decrypt)(const aes128_ctx *ctx, unsigned char *Plain_Data);
+	void (*EncryptBlocks)(const aes128_ctx *ctx, unsigned char *Data, size_t Blocks);
+	void (*DecryptBlocks)(const aes128_ctx *ctx, unsigned char *Data, size_t Blocks);
+	void (*EncryptMulti)(const aes128_ctx *const *ctx, const unsigned char *const *in, unsigned char *const *out, unsigned int Count);	// Count <= AES128_MULTI_LANES, one key each
+	void (*DecryptMulti)(const aes128_ctx *const *ctx, const unsigned char *const *in, unsigned char *const *out, unsigned int Count);
+} tAESBackend;
+
+
+// External, static or other variables
+//--------------------------------------
+extern const tAESBackend Portable_Backend;
+
+#ifdef AES_NI
+extern const tAESBackend AESNI_Backend;
+#endif
+
+#ifdef AES_BITSLICE
+extern const tAESBackend Bitslice_Backend;
+#endif
+
+
+
+// Function Prototypes
+//---------------------
+#ifdef AES_NI
+int AESNI_Supported(void);
+#endif
+void GCM_Init_Table(aes128_gcm_ctx *ctx, const unsigned char *Key);		// aes_gcm.c- AESUT only, GHASH pinned to the 4-bit table
+
+#endif
@@ -0,0 +1,634 @@
+//
+//          Filename: aes_bitslice.c
+//          Function: Constant-time bitsliced AES-128 round engine, 4 to 32 blocks per pass
+//
+//          Only built when AES_BITSLICE is defined. There are no table lookups at all- the S_Box is evaluated as the
+//          Boyar-Peralta boolean circuit, and ShiftRows/MixColumns are fixed shifts and masks, so no memory access depends on
+//          key or data. This closes the cache-timing channel of S_Box/inv_S_Box on hosts without AES-NI. Key expansion and
+//          single blocks go through the same circuit, so every call on this engine is constant-time.
+//
+//          Layout: each 64-bit word holds one bit plane of 4 blocks (4 x 16 bytes = 64 bit positions). The round code is
+//          written once per width in the *_BODY macros and built for:
+//              64  - one scalar word, 4 blocks. Single blocks, short tails and the key schedule SubWord
+//              128 - SSE2 xmm / NEON q, 8 blocks. The baseline bulk width and the multi-key calls
+//              256 - AVX2 ymm, 16 blocks  } x86 only, picked at startup when CPUID and XCR0 say the registers are usable.
+//              512 - AVX-512 zmm, 32 blocks } The functions carry their own target attributes like aes_ni.c
+//          Bulk calls run whole passes at the widest width first and work down, so nothing is padded except a final 1-7
+//          blocks. The circuit costs the same per pass at every width, so throughput scales with the vector width.
+//
+//          Uses GCC/Clang vector extensions, so the engine is portable to any target those compilers support.
+//
+//--------------------------------------------------------------------------------------------------------------------------------------
+
+#include "aes.h"
+#include "aes_backend.h"
+#include <string.h>
+
+#ifdef AES_BITSLICE
+
+#if defined(__x86_64__) || defined(__i386__)
+#define BS_X86
+#include <cpuid.h>
+#define BS_AVX2_TARGET		__attribute__((target("avx2")))
+#define BS_AVX512_TARGET	__attribute__((target("avx512f")))
+#define BS_WIDTHS			4
+#else
+#define BS_WIDTHS			2
+#endif
+
+#define BS_LANES	8		// Blocks taken by the multi-key calls, one 128-bit pass
+#define BS_BLOCKS(T)	(sizeof(T) / 2)		// Blocks per pass- 4 per 64-bit word
+
+// Bit plane vectors. Word j of a vector carries blocks 4j..4j+3 of the pass
+typedef uint64_t tBSWord __attribute__((vector_size(16)));
+#ifdef BS_X86
+typedef uint64_t tBSWord256 __attribute__((vector_size(32)));
+typedef uint64_t tBSWord512 __attribute__((vector_size(64)));
+#endif
+
+// Name: BS_Sbox
+// Function: FIPS 197 S_Box on every byte position at once. Boyar-Peralta circuit, 113 gates
+//---------------------------------------------------------------------------------------------
+#define BS_SBOX_BODY(T, q)	\
+	{ \
+	T x0, x1, x2, x3, x4, x5, x6, x7; \
+	T y1, y2, y3, y4, y5, y6, y7, y8, y9, y10, y11, y12, y13, y14, y15, y16, y17, y18, y19, y20, y21; \
+	T z0, z1, z2, z3, z4, z5, z6, z7, z8, z9, z10, z11, z12, z13, z14, z15, z16, z17; \
+	T t0, t1, t2, t3, t4, t5, t6, t7, t8, t9, t10, t11, t12, t13, t14, t15, t16, t17, t18, t19, t20, t21, t22, t23, t24, t25, t26, t27, t28, t29; \
+	T t30, t31, t32, t33, t34, t35, t36, t37, t38, t39, t40, t41, t42, t43, t44, t45, t46, t47, t48, t49, t50, t51, t52, t53, t54, t55, t56, t57, t58, t59; \
+	T t60, t61, t62, t63, t64, t65, t66, t67; \
+	T s0, s1, s2, s3, s4, s5, s6, s7; \
+	x0 = q[7]; x1 = q[6]; x2 = q[5]; x3 = q[4]; x4 = q[3]; x5 = q[2]; x6 = q[1]; x7 = q[0]; \
+	/* Top linear transformation */ \
+	y14 = x3 ^ x5; y13 = x0 ^ x6; y9 = x0 ^ x3; y8 = x0 ^ x5; t0 = x1 ^ x2; y1 = t0 ^ x7; y4 = y1 ^ x3; y12 = y13 ^ y14; \
+	y2 = y1 ^ x0; y5 = y1 ^ x6; y3 = y5 ^ y8; t1 = x4 ^ y12; y15 = t1 ^ x5; y20 = t1 ^ x1; y6 = y15 ^ x7; y10 = y15 ^ t0; \
+	y11 = y20 ^ y9; y7 = x7 ^ y11; y17 = y10 ^ y11; y19 = y10 ^ y8; y16 = t0 ^ y11; y21 = y13 ^ y16; y18 = x0 ^ y16; \
+	/* Non-linear section */ \
+	t2 = y12 & y15; t3 = y3 & y6; t4 = t3 ^ t2; t5 = y4 & x7; t6 = t5 ^ t2; t7 = y13 & y16; t8 = y5 & y1; t9 = t8 ^ t7; \
+	t10 = y2 & y7; t11 = t10 ^ t7; t12 = y9 & y11; t13 = y14 & y17; t14 = t13 ^ t12; t15 = y8 & y10; t16 = t15 ^ t12; \
+	t17 = t4 ^ t14; t18 = t6 ^ t16; t19 = t9 ^ t14; t20 = t11 ^ t16; t21 = t17 ^ y20; t22 = t18 ^ y19; t23 = t19 ^ y21; \
+	t24 = t20 ^ y18; t25 = t21 ^ t22; t26 = t21 & t23; t27 = t24 ^ t26; t28 = t25 & t27; t29 = t28 ^ t22; t30 = t23 ^ t24; \
+	t31 = t22 ^ t26; t32 = t31 & t30; t33 = t32 ^ t24; t34 = t23 ^ t33; t35 = t27 ^ t33; t36 = t24 & t35; t37 = t36 ^ t34; \
+	t38 = t27 ^ t36; t39 = t29 & t38; t40 = t25 ^ t39; t41 = t40 ^ t37; t42 = t29 ^ t33; t43 = t29 ^ t40; t44 = t33 ^ t37; \
+	t45 = t42 ^ t41; \
+	z0 = t44 & y15; z1 = t37 & y6; z2 = t33 & x7; z3 = t43 & y16; z4 = t40 & y1; z5 = t29 & y7; z6 = t42 & y11; \
+	z7 = t45 & y17; z8 = t41 & y10; z9 = t44 & y12; z10 = t37 & y3; z11 = t33 & y4; z12 = t43 & y13; z13 = t40 & y5; \
+	z14 = t29 & y2; z15 = t42 & y9; z16 = t45 & y14; z17 = t41 & y8; \
+	/* Bottom linear transformation */ \
+	t46 = z15 ^ z16; t47 = z10 ^ z11; t48 = z5 ^ z13; t49 = z9 ^ z10; t50 = z2 ^ z12; t51 = z2 ^ z5; t52 = z7 ^ z8; \
+	t53 = z0 ^ z3; t54 = z6 ^ z7; t55 = z16 ^ z17; t56 = z12 ^ t48; t57 = t50 ^ t53; t58 = z4 ^ t46; t59 = z3 ^ t54; \
+	t60 = t46 ^ t57; t61 = z14 ^ t57; t62 = t52 ^ t58; t63 = t49 ^ t58; t64 = z4 ^ t59; t65 = t61 ^ t62; t66 = z1 ^ t63; \
+	s0 = t59 ^ t63; s6 = t56 ^ ~t62; s7 = t48 ^ ~t60; t67 = t64 ^ t65; s3 = t53 ^ t66; s4 = t51 ^ t66; s5 = t47 ^ t65; \
+	s1 = t64 ^ ~s3; s2 = t55 ^ ~t67; \
+	q[7] = s0; q[6] = s1; q[5] = s2; q[4] = s3; q[3] = s4; q[2] = s5; q[1] = s6; q[0] = s7; \
+	}
+
+// Name: BS_Inv_Affine
+// Function: Undoes the S_Box affine transform. inv_S_Box(x) = A'(S_Box(A'(x))) where A' is this transform
+//---------------------------------------------------------------------------------------------
+#define BS_INV_AFFINE_BODY(T, q)	\
+	{ \
+	T q0, q1, q2, q3, q4, q5, q6, q7; \
+	q0 = ~q[0]; q1 = ~q[1]; q2 = q[2]; q3 = q[3]; \
+	q4 = q[4]; q5 = ~q[5]; q6 = ~q[6]; q7 = q[7]; \
+	q[7] = q1 ^ q4 ^ q6; \
+	q[6] = q0 ^ q3 ^ q5; \
+	q[5] = q7 ^ q2 ^ q4; \
+	q[4] = q6 ^ q1 ^ q3; \
+	q[3] = q5 ^ q0 ^ q2; \
+	q[2] = q4 ^ q7 ^ q1; \
+	q[1] = q3 ^ q6 ^ q0; \
+	q[0] = q2 ^ q5 ^ q7; \
+	}
+
+// Name: BS_Ortho
+// Function: Transposes between byte layout and bit planes. It is its own inverse
+//---------------------------------------------------------------------------------------------
+#define BS_SWAPN(T, cl, ch, s, x, y)	{ T a = (x), b = (y); (x) = (a & (uint64_t)(cl)) | ((b & (uint64_t)(cl)) << (s)); (y) = ((a & (uint64_t)(ch)) >> (s)) | (b & (uint64_t)(ch)); }
+#define BS_SWAP2(T, x, y)	BS_SWAPN(T, 0x5555555555555555ULL, 0xAAAAAAAAAAAAAAAAULL, 1, x, y)
+#define BS_SWAP4(T, x, y)	BS_SWAPN(T, 0x3333333333333333ULL, 0xCCCCCCCCCCCCCCCCULL, 2, x, y)
+#define BS_SWAP8(T, x, y)	BS_SWAPN(T, 0x0F0F0F0F0F0F0F0FULL, 0xF0F0F0F0F0F0F0F0ULL, 4, x, y)
+#define BS_ORTHO_BODY(T, q)	\
+	{ \
+	BS_SWAP2(T, q[0], q[1]); BS_SWAP2(T, q[2], q[3]); BS_SWAP2(T, q[4], q[5]); BS_SWAP2(T, q[6], q[7]); \
+	BS_SWAP4(T, q[0], q[2]); BS_SWAP4(T, q[1], q[3]); BS_SWAP4(T, q[4], q[6]); BS_SWAP4(T, q[5], q[7]); \
+	BS_SWAP8(T, q[0], q[4]); BS_SWAP8(T, q[1], q[5]); BS_SWAP8(T, q[2], q[6]); BS_SWAP8(T, q[3], q[7]); \
+	}
+
+// Name: BS_Shift_Rows / BS_Inv_Shift_Rows
+// Function: Row rotations become fixed nibble moves inside each bit plane
+//---------------------------------------------------------------------------------------------
+#define BS_SHIFT_ROWS_BODY(T, q)	\
+	{ \
+	unsigned char i; \
+	T x; \
+	for (i = 0; i < 8; i++) \
+	{ \
+		x = q[i]; \
+		q[i] = (x & 0x000000000000FFFFULL) \
+			| ((x & 0x00000000FFF00000ULL) >> 4) \
+			| ((x & 0x00000000000F0000ULL) << 12) \
+			| ((x & 0x0000FF0000000000ULL) >> 8) \
+			| ((x & 0x000000FF00000000ULL) << 8) \
+			| ((x & 0xF000000000000000ULL) >> 12) \
+			| ((x & 0x0FFF000000000000ULL) << 4); \
+	} \
+	}
+
+#define BS_INV_SHIFT_ROWS_BODY(T, q)	\
+	{ \
+	unsigned char i; \
+	T x; \
+	for (i = 0; i < 8; i++) \
+	{ \
+		x = q[i]; \
+		q[i] = (x & 0x000000000000FFFFULL) \
+			| ((x & 0x000000000FFF0000ULL) << 4) \
+			| ((x & 0x00000000F0000000ULL) >> 12) \
+			| ((x & 0x000000FF00000000ULL) << 8) \
+			| ((x & 0x0000FF0000000000ULL) >> 8) \
+			| ((x & 0x000F000000000000ULL) << 12) \
+			| ((x & 0xFFF0000000000000ULL) >> 4); \
+	} \
+	}
+
+#define BS_ROTR16(x)	(((x) >> 16) | ((x) << 48))
+#define BS_ROTR32(x)	(((x) >> 32) | ((x) << 32))
+
+// Name: BS_Mix_Columns
+// Function: MixColumns on bit planes. x2 in GF(2^8) is a plane shift with the 0x1b feedback folded into the XORs
+//---------------------------------------------------------------------------------------------
+#define BS_MIX_COLUMNS_BODY(T, q)	\
+	{ \
+	T q0, q1, q2, q3, q4, q5, q6, q7; \
+	T r0, r1, r2, r3, r4, r5, r6, r7; \
+	q0 = q[0]; q1 = q[1]; q2 = q[2]; q3 = q[3]; q4 = q[4]; q5 = q[5]; q6 = q[6]; q7 = q[7]; \
+	r0 = BS_ROTR16(q0); r1 = BS_ROTR16(q1); r2 = BS_ROTR16(q2); r3 = BS_ROTR16(q3); \
+	r4 = BS_ROTR16(q4); r5 = BS_ROTR16(q5); r6 = BS_ROTR16(q6); r7 = BS_ROTR16(q7); \
+	q[0] = q7 ^ r7 ^ r0 ^ BS_ROTR32(q0 ^ r0); \
+	q[1] = q0 ^ r0 ^ q7 ^ r7 ^ r1 ^ BS_ROTR32(q1 ^ r1); \
+	q[2] = q1 ^ r1 ^ r2 ^ BS_ROTR32(q2 ^ r2); \
+	q[3] = q2 ^ r2 ^ q7 ^ r7 ^ r3 ^ BS_ROTR32(q3 ^ r3); \
+	q[4] = q3 ^ r3 ^ q7 ^ r7 ^ r4 ^ BS_ROTR32(q4 ^ r4); \
+	q[5] = q4 ^ r4 ^ r5 ^ BS_ROTR32(q5 ^ r5); \
+	q[6] = q5 ^ r5 ^ r6 ^ BS_ROTR32(q6 ^ r6); \
+	q[7] = q6 ^ r6 ^ r7 ^ BS_ROTR32(q7 ^ r7); \
+	}
+
+// Name: BS_Inv_Mix_Columns
+// Function: InvMixColumns on bit planes
+//---------------------------------------------------------------------------------------------
+#define BS_INV_MIX_COLUMNS_BODY(T, q)	\
+	{ \
+	T q0, q1, q2, q3, q4, q5, q6, q7; \
+	T r0, r1, r2, r3, r4, r5, r6, r7; \
+	q0 = q[0]; q1 = q[1]; q2 = q[2]; q3 = q[3]; q4 = q[4]; q5 = q[5]; q6 = q[6]; q7 = q[7]; \
+	r0 = BS_ROTR16(q0); r1 = BS_ROTR16(q1); r2 = BS_ROTR16(q2); r3 = BS_ROTR16(q3); \
+	r4 = BS_ROTR16(q4); r5 = BS_ROTR16(q5); r6 = BS_ROTR16(q6); r7 = BS_ROTR16(q7); \
+	q[0] = q5 ^ q6 ^ q7 ^ r0 ^ r5 ^ r7 ^ BS_ROTR32(q0 ^ q5 ^ q6 ^ r0 ^ r5); \
+	q[1] = q0 ^ q5 ^ r0 ^ r1 ^ r5 ^ r6 ^ r7 ^ BS_ROTR32(q1 ^ q5 ^ q7 ^ r1 ^ r5 ^ r6); \
+	q[2] = q0 ^ q1 ^ q6 ^ r1 ^ r2 ^ r6 ^ r7 ^ BS_ROTR32(q0 ^ q2 ^ q6 ^ r2 ^ r6 ^ r7); \
+	q[3] = q0 ^ q1 ^ q2 ^ q5 ^ q6 ^ r0 ^ r2 ^ r3 ^ r5 ^ BS_ROTR32(q0 ^ q1 ^ q3 ^ q5 ^ q6 ^ q7 ^ r0 ^ r3 ^ r5 ^ r7); \
+	q[4] = q1 ^ q2 ^ q3 ^ q5 ^ r1 ^ r3 ^ r4 ^ r5 ^ r6 ^ r7 ^ BS_ROTR32(q1 ^ q2 ^ q4 ^ q5 ^ q7 ^ r1 ^ r4 ^ r5 ^ r6); \
+	q[5] = q2 ^ q3 ^ q4 ^ q6 ^ r2 ^ r4 ^ r5 ^ r6 ^ r7 ^ BS_ROTR32(q2 ^ q3 ^ q5 ^ q6 ^ r2 ^ r5 ^ r6 ^ r7); \
+	q[6] = q3 ^ q4 ^ q5 ^ q7 ^ r3 ^ r5 ^ r6 ^ r7 ^ BS_ROTR32(q3 ^ q4 ^ q6 ^ q7 ^ r3 ^ r6 ^ r7); \
+	q[7] = q4 ^ q5 ^ q6 ^ r4 ^ r6 ^ r7 ^ BS_ROTR32(q4 ^ q5 ^ q7 ^ r4 ^ r7); \
+	}
+
+// Name: BS_Add_Round_Key
+//---------------------------------------------------------------------------------------------
+#define BS_ADD_ROUND_KEY_BODY(q, sk)	\
+	{ \
+	unsigned char x; \
+	for (x = 0; x < 8; x++) \
+		q[x] ^= sk[x]; \
+	}
+
+// Name: BS_Encrypt_Core
+// Function: Encrypts one loaded pass. sk holds 11 round keys of 8 planes each, one vector per plane
+//---------------------------------------------------------------------------------------------
+#define BS_ENCRYPT_CORE_BODY(W, q, sk)	\
+	{ \
+	unsigned char turn; \
+	BS_Add_Round_Key##W(q, sk); \
+	for (turn = 1; turn < AES128_ROUNDS; turn++) \
+	{ \
+		BS_Sbox##W(q); \
+		BS_Shift_Rows##W(q); \
+		BS_Mix_Columns##W(q); \
+		BS_Add_Round_Key##W(q, sk + 8 * turn); \
+	} \
+	BS_Sbox##W(q); \
+	BS_Shift_Rows##W(q); \
+	BS_Add_Round_Key##W(q, sk + 8 * AES128_ROUNDS); \
+	}
+
+// Name: BS_Decrypt_Core
+// Function: Decrypts one loaded pass
+//---------------------------------------------------------------------------------------------
+#define BS_DECRYPT_CORE_BODY(W, q, sk)	\
+	{ \
+	unsigned char turn; \
+	BS_Add_Round_Key##W(q, sk + 8 * AES128_ROUNDS); \
+	for (turn = AES128_ROUNDS - 1; turn > 0; turn--) \
+	{ \
+		BS_Inv_Shift_Rows##W(q); \
+		BS_Inv_Sbox##W(q); \
+		BS_Add_Round_Key##W(q, sk + 8 * turn); \
+		BS_Inv_Mix_Columns##W(q); \
+	} \
+	BS_Inv_Shift_Rows##W(q); \
+	BS_Inv_Sbox##W(q); \
+	BS_Add_Round_Key##W(q, sk); \
+	}
+
+// Name: BS_Load_Blocks
+// Function: Loads one pass of blocks into bit planes, blocks 4j..4j+3 into word j of every plane. 64-bit word c of every
+//           64 byte group is gathered into t[c], then the bytes are spread over the planes with vector shifts and masks-
+//           the vector form of BS_Interleave_In
+//---------------------------------------------------------------------------------------------
+#define BS_LOAD_BODY(W, T, q, Data)	\
+	{ \
+	uint64_t t[8][sizeof(T) / 8]; \
+	T x0, x1, x2, x3; \
+	unsigned int j, x; \
+	for (j = 0; j < sizeof(T) / 8; j++) \
+		for (x = 0; x < 8; x++) \
+			t[x][j] = BS_Load64(Data + 64 * j + 8 * x); \
+	for (x = 0; x < 4; x++) \
+	{ \
+		memcpy(&x0, t[2 * x], sizeof(T)); \
+		memcpy(&x2, t[2 * x + 1], sizeof(T)); \
+		x1 = x0 >> 32; x3 = x2 >> 32; \
+		x0 &= 0xFFFFFFFFULL; x2 &= 0xFFFFFFFFULL; \
+		x0 |= (x0 << 16); x1 |= (x1 << 16); x2 |= (x2 << 16); x3 |= (x3 << 16); \
+		x0 &= 0x0000FFFF0000FFFFULL; x1 &= 0x0000FFFF0000FFFFULL; x2 &= 0x0000FFFF0000FFFFULL; x3 &= 0x0000FFFF0000FFFFULL; \
+		x0 |= (x0 << 8); x1 |= (x1 << 8); x2 |= (x2 << 8); x3 |= (x3 << 8); \
+		x0 &= 0x00FF00FF00FF00FFULL; x1 &= 0x00FF00FF00FF00FFULL; x2 &= 0x00FF00FF00FF00FFULL; x3 &= 0x00FF00FF00FF00FFULL; \
+		q[x] = x0 | (x2 << 8); \
+		q[x + 4] = x1 | (x3 << 8); \
+	} \
+	BS_Ortho##W(q); \
+	}
+
+// Name: BS_Store_Blocks
+// Function: Inverse of BS_Load_Blocks
+//---------------------------------------------------------------------------------------------
+#define BS_STORE_BODY(W, T, Data, q)	\
+	{ \
+	uint64_t t[8][sizeof(T) / 8]; \
+	T x0, x1, x2, x3; \
+	unsigned int j, x; \
+	BS_Ortho##W(q); \
+	for (x = 0; x < 4; x++) \
+	{ \
+		x0 = q[x] & 0x00FF00FF00FF00FFULL; \
+		x1 = q[x + 4] & 0x00FF00FF00FF00FFULL; \
+		x2 = (q[x] >> 8) & 0x00FF00FF00FF00FFULL; \
+		x3 = (q[x + 4] >> 8) & 0x00FF00FF00FF00FFULL; \
+		x0 |= (x0 >> 8); x1 |= (x1 >> 8); x2 |= (x2 >> 8); x3 |= (x3 >> 8); \
+		x0 &= 0x0000FFFF0000FFFFULL; x1 &= 0x0000FFFF0000FFFFULL; x2 &= 0x0000FFFF0000FFFFULL; x3 &= 0x0000FFFF0000FFFFULL; \
+		x0 = (x0 | (x0 >> 16)) & 0xFFFFFFFFULL; x1 = (x1 | (x1 >> 16)) & 0xFFFFFFFFULL; \
+		x2 = (x2 | (x2 >> 16)) & 0xFFFFFFFFULL; x3 = (x3 | (x3 >> 16)) & 0xFFFFFFFFULL; \
+		x0 |= (x1 << 32); x2 |= (x3 << 32); \
+		memcpy(t[2 * x], &x0, sizeof(T)); \
+		memcpy(t[2 * x + 1], &x2, sizeof(T)); \
+	} \
+	for (j = 0; j < sizeof(T) / 8; j++) \
+		for (x = 0; x < 8; x++) \
+			BS_Store64(Data + 64 * j + 8 * x, t[x][j]); \
+	}
+
+// Name: BS_Encrypt_Run / BS_Decrypt_Run
+// Function: Runs Passes whole passes in place, the key schedule broadcast to every block of the pass
+//---------------------------------------------------------------------------------------------
+#define BS_RUN_BODY(W, T, Core)	\
+	{ \
+	T sk[8 * (AES128_ROUNDS + 1)], q[8]; \
+	unsigned int x; \
+	for (x = 0; x < 8 * (AES128_ROUNDS + 1); x++) \
+		sk[x] = (T){ 0 } ^ ctx->BSKey[x]; \
+	for (; Passes > 0; Passes--, Data += BS_BLOCKS(T) * MAX_LENGTH) \
+	{ \
+		BS_Load_Blocks##W(q, Data); \
+		Core##W(q, sk); \
+		BS_Store_Blocks##W(Data, q); \
+	} \
+	}
+
+// Name: BS_Load32 / BS_Store32 / BS_Load64 / BS_Store64
+// Function: Little-endian word access, independent of host byte order
+//---------------------------------------------------------------------------------------------
+static uint32_t BS_Load32(const unsigned char *p)
+{
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void BS_Store32(unsigned char *p, uint32_t w)
+{
+	p[0] = (unsigned char)w; p[1] = (unsigned char)(w >> 8); p[2] = (unsigned char)(w >> 16); p[3] = (unsigned char)(w >> 24);
+}
+
+static uint64_t BS_Load64(const unsigned char *p)
+{
+	return (uint64_t)BS_Load32(p) | ((uint64_t)BS_Load32(p + 4) << 32);
+}
+
+static void BS_Store64(unsigned char *p, uint64_t w)
+{
+	BS_Store32(p, (uint32_t)w);
+	BS_Store32(p + 4, (uint32_t)(w >> 32));
+}
+
+// Name: BS_Interleave_In
+// Function: Spreads one 16 byte block over two words so that, after BS_Ortho, each word is a bit plane. Used for the round
+//           keys- data blocks take the vector form in BS_Load_Blocks
+//---------------------------------------------------------------------------------------------
+static void BS_Interleave_In(uint64_t *q0, uint64_t *q1, const unsigned char *Block)
+{
+	uint64_t x0, x1, x2, x3;
+
+	x0 = BS_Load32(Block);
+	x1 = BS_Load32(Block + 4);
+	x2 = BS_Load32(Block + 8);
+	x3 = BS_Load32(Block + 12);
+	x0 |= (x0 << 16); x1 |= (x1 << 16); x2 |= (x2 << 16); x3 |= (x3 << 16);
+	x0 &= 0x0000FFFF0000FFFFULL; x1 &= 0x0000FFFF0000FFFFULL; x2 &= 0x0000FFFF0000FFFFULL; x3 &= 0x0000FFFF0000FFFFULL;
+	x0 |= (x0 << 8); x1 |= (x1 << 8); x2 |= (x2 << 8); x3 |= (x3 << 8);
+	x0 &= 0x00FF00FF00FF00FFULL; x1 &= 0x00FF00FF00FF00FFULL; x2 &= 0x00FF00FF00FF00FFULL; x3 &= 0x00FF00FF00FF00FFULL;
+	*q0 = x0 | (x2 << 8);
+	*q1 = x1 | (x3 << 8);
+}
+
+// Name: BS_DEFINE_WIDTH
+// Function: Builds the round functions and the Run entry points for one plane type. W is the width in bits, used as the
+//           name suffix, and TARGET the target attribute the width needs (empty for the baseline widths)
+//---------------------------------------------------------------------------------------------
+#define BS_DEFINE_WIDTH(W, T, TARGET)	\
+	TARGET static void BS_Sbox##W(T *q) BS_SBOX_BODY(T, q) \
+	TARGET static void BS_Inv_Affine##W(T *q) BS_INV_AFFINE_BODY(T, q) \
+	TARGET static void BS_Inv_Sbox##W(T *q) { BS_Inv_Affine##W(q); BS_Sbox##W(q); BS_Inv_Affine##W(q); } \
+	TARGET static void BS_Ortho##W(T *q) BS_ORTHO_BODY(T, q) \
+	TARGET static void BS_Shift_Rows##W(T *q) BS_SHIFT_ROWS_BODY(T, q) \
+	TARGET static void BS_Inv_Shift_Rows##W(T *q) BS_INV_SHIFT_ROWS_BODY(T, q) \
+	TARGET static void BS_Mix_Columns##W(T *q) BS_MIX_COLUMNS_BODY(T, q) \
+	TARGET static void BS_Inv_Mix_Columns##W(T *q) BS_INV_MIX_COLUMNS_BODY(T, q) \
+	TARGET static void BS_Add_Round_Key##W(T *q, const T *sk) BS_ADD_ROUND_KEY_BODY(q, sk) \
+	TARGET static void BS_Encrypt_Core##W(T *q, const T *sk) BS_ENCRYPT_CORE_BODY(W, q, sk) \
+	TARGET static void BS_Decrypt_Core##W(T *q, const T *sk) BS_DECRYPT_CORE_BODY(W, q, sk) \
+	TARGET static void BS_Load_Blocks##W(T *q, const unsigned char *Data) BS_LOAD_BODY(W, T, q, Data) \
+	TARGET static void BS_Store_Blocks##W(unsigned char *Data, T *q) BS_STORE_BODY(W, T, Data, q) \
+	TARGET static void BS_Encrypt_Run##W(const aes128_ctx *ctx, unsigned char *Data, size_t Passes) BS_RUN_BODY(W, T, BS_Encrypt_Core) \
+	TARGET static void BS_Decrypt_Run##W(const aes128_ctx *ctx, unsigned char *Data, size_t Passes) BS_RUN_BODY(W, T, BS_Decrypt_Core)
+
+BS_DEFINE_WIDTH(64, uint64_t, )
+BS_DEFINE_WIDTH(128, tBSWord, )
+#ifdef BS_X86
+BS_DEFINE_WIDTH(256, tBSWord256, BS_AVX2_TARGET)
+BS_DEFINE_WIDTH(512, tBSWord512, BS_AVX512_TARGET)
+#endif
+
+typedef void (*tBSRun)(const aes128_ctx *ctx, unsigned char *Data, size_t Passes);
+
+// Run entry points by width, narrowest first- entry w takes 4 << w blocks per pass
+static const tBSRun BS_Encrypt_Runs[BS_WIDTHS] =
+{
+	BS_Encrypt_Run64, BS_Encrypt_Run128,
+#ifdef BS_X86
+	BS_Encrypt_Run256, BS_Encrypt_Run512
+#endif
+};
+
+static const tBSRun BS_Decrypt_Runs[BS_WIDTHS] =
+{
+	BS_Decrypt_Run64, BS_Decrypt_Run128,
+#ifdef BS_X86
+	BS_Decrypt_Run256, BS_Decrypt_Run512
+#endif
+};
+
+// Widest entry the CPU can run. Only written by BS_Select_Width before main() runs
+static unsigned int BS_Widest = 1;
+
+#ifdef BS_X86
+// Name: BS_XCR0
+// Function: Reads XCR0, the register state the OS saves on a context switch. Only valid once CPUID has reported OSXSAVE
+//---------------------------------------------------------------------------------------------
+static unsigned int BS_XCR0(void)
+{
+	unsigned int eax, edx;
+
+	__asm__ volatile ("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+	return eax;
+}
+
+// Name: BS_Select_Width
+// Function: Runs once at startup. CPUID leaf 1 ECX bits 27/28 (OSXSAVE, AVX) and XCR0 bits 1/2 (XMM/YMM state), then leaf 7
+//           EBX bit 5 for AVX2. AVX-512F also needs EBX bit 16 and XCR0 bits 5-7 (opmask/ZMM state)
+//---------------------------------------------------------------------------------------------
+__attribute__((constructor)) static void BS_Select_Width(void)
+{
+	unsigned int eax, ebx, ecx, edx;
+
+	if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+		return;
+	if (((ecx & (1u << 27)) == 0) || ((ecx & (1u << 28)) == 0))
+		return;
+	if ((BS_XCR0() & 0x06) != 0x06)
+		return;
+	if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx))
+		return;
+	if ((ebx & (1u << 5)) == 0)
+		return;
+	BS_Widest = 2;
+	if (((ebx & (1u << 16)) != 0) && ((BS_XCR0() & 0xE6) == 0xE6))
+		BS_Widest = 3;
+}
+#endif
+
+// Name: BS_Run_Blocks
+// Function: Runs Blocks consecutive blocks in place through Run, whole passes at the widest width first. The last 1-7 blocks
+//           take one padded pass, a single word (4 blocks) when they fit
+//---------------------------------------------------------------------------------------------
+static void BS_Run_Blocks(const tBSRun *Run, const aes128_ctx *ctx, unsigned char *Data, size_t Blocks)
+{
+	unsigned char pass[BS_LANES * MAX_LENGTH];
+	unsigned int w;
+	size_t lanes, n;
+
+	for (w = BS_Widest; w > 0; w--)
+	{
+		lanes = (size_t)4 << w;
+		n = Blocks / lanes;
+		if (n > 0)
+		{
+			Run[w](ctx, Data, n);
+			Data += n * lanes * MAX_LENGTH;
+			Blocks -= n * lanes;
+		}
+	}
+	if (Blocks > 0)
+	{
+		w = (Blocks > 4) ? 1 : 0;
+		memset(pass, 0, sizeof(pass));
+		memcpy(pass, Data, Blocks * MAX_LENGTH);
+		Run[w](ctx, pass, 1);
+		memcpy(Data, pass, Blocks * MAX_LENGTH);
+	}
+}
+
+// Name: BS_Sub_Word
+// Function: S_Box on the 4 bytes of a key schedule word, through the circuit so key setup is constant-time too
+//---------------------------------------------------------------------------------------------
+static uint32_t BS_Sub_Word(uint32_t w)
+{
+	uint64_t q[8];
+
+	memset(q, 0, sizeof(q));
+	q[0] = w;
+	BS_Ortho64(q);
+	BS_Sbox64(q);
+	BS_Ortho64(q);
+	return (uint32_t)q[0];
+}
+
+// Name: BS_Init
+// Function: Expands the key and stores each round key as bit planes, replicated across the 4 blocks of a word
+//---------------------------------------------------------------------------------------------
+static void BS_Init(aes128_ctx *ctx, const unsigned char *Key)
+{
+	static const unsigned char Rcon[AES128_ROUNDS] = {0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1b, 0x36};
+	uint32_t w[4 * (AES128_ROUNDS + 1)], t;
+	uint64_t q[8];
+	unsigned char ii, x;
+
+	for (ii = 0; ii < 4; ii++)
+		w[ii] = BS_Load32(Key + 4 * ii);
+	for (ii = 4; ii < 4 * (AES128_ROUNDS + 1); ii++)
+	{
+		t = w[ii - 1];
+		if ((ii & 3) == 0)
+			t = BS_Sub_Word((t >> 8) | (t << 24)) ^ Rcon[(ii >> 2) - 1];
+		w[ii] = w[ii - 4] ^ t;
+	}
+
+	for (ii = 0; ii <= AES128_ROUNDS; ii++)
+	{
+		for (x = 0; x < 4; x++)
+			BS_Store32(&ctx->KeyGen[ii * MAX_LENGTH + 4 * x], w[4 * ii + x]);
+		for (x = 0; x < 4; x++)
+			BS_Interleave_In(&q[x], &q[x + 4], &ctx->KeyGen[ii * MAX_LENGTH]);
+		BS_Ortho64(q);
+		for (x = 0; x < 8; x++)
+			ctx->BSKey[8 * ii + x] = q[x];
+	}
+	memset(w, 0, sizeof(w));
+	memset(q, 0, sizeof(q));
+}
+
+// Name: BS_Encrypt_Blocks / BS_Decrypt_Blocks
+// Function: Consecutive blocks in place
+//---------------------------------------------------------------------------------------------
+static void BS_Encrypt_Blocks(const aes128_ctx *ctx, unsigned char *Data, size_t Blocks)
+{
+	BS_Run_Blocks(BS_Encrypt_Runs, ctx, Data, Blocks);
+}
+
+static void BS_Decrypt_Blocks(const aes128_ctx *ctx, unsigned char *Data, size_t Blocks)
+{
+	BS_Run_Blocks(BS_Decrypt_Runs, ctx, Data, Blocks);
+}
+
+// Name: BS_Encrypt / BS_Decrypt
+// Function: Single block entry points- one scalar word pass, about a quarter of the work of an 8 block vector pass
+//---------------------------------------------------------------------------------------------
+static void BS_Encrypt(const aes128_ctx *ctx, unsigned char *Plain_Data)
+{
+	BS_Run_Blocks(BS_Encrypt_Runs, ctx, Plain_Data, 1);
+}
+
+static void BS_Decrypt(const aes128_ctx *ctx, unsigned char *Plain_Data)
+{
+	BS_Run_Blocks(BS_Decrypt_Runs, ctx, Plain_Data, 1);
+}
+
+// Name: BS_Merge_Keys
+// Function: Builds a schedule where block x of the pass uses ctx[x]. Within a plane, bit j of every nibble belongs to block
+//           j of that half, so each key contributes only its own bit positions
+//---------------------------------------------------------------------------------------------
+static void BS_Merge_Keys(tBSWord *sk, const aes128_ctx *const *ctx, unsigned int Count)
+{
+	uint64_t lo, hi, mask;
+	unsigned int x, b;
+
+	for (x = 0; x < 8 * (AES128_ROUNDS + 1); x++)
+	{
+		lo = 0;
+		hi = 0;
+		for (b = 0; b < Count; b++)
+		{
+			mask = 0x1111111111111111ULL << (b & 3);
+			if (b < 4)
+				lo |= ctx[b]->BSKey[x] & mask;
+			else
+				hi |= ctx[b]->BSKey[x] & mask;
+		}
+		sk[x] = (tBSWord){ lo, hi };
+	}
+}
+
+// Name: BS_Encrypt_Multi
+// Function: Encrypts Count (<= 8) blocks in one pass, block x from in[x] to out[x] under ctx[x]
+//---------------------------------------------------------------------------------------------
+static void BS_Encrypt_Multi(const aes128_ctx *const *ctx, const unsigned char *const *in, unsigned char *const *out, unsigned int Count)
+{
+	unsigned char pass[BS_LANES * MAX_LENGTH];
+	tBSWord sk[8 * (AES128_ROUNDS + 1)];
+	tBSWord q[8];
+	unsigned int x;
+
+	memset(pass, 0, sizeof(pass));
+	for (x = 0; x < Count; x++)
+		memcpy(&pass[x * MAX_LENGTH], in[x], MAX_LENGTH);
+	BS_Merge_Keys(sk, ctx, Count);
+	BS_Load_Blocks128(q, pass);
+	BS_Encrypt_Core128(q, sk);
+	BS_Store_Blocks128(pass, q);
+	for (x = 0; x < Count; x++)
+		memcpy(out[x], &pass[x * MAX_LENGTH], MAX_LENGTH);
+}
+
+// Name: BS_Decrypt_Multi
+// Function: Decrypts Count (<= 8) blocks in one pass, block x from in[x] to out[x] under ctx[x]
+//---------------------------------------------------------------------------------------------
+static void BS_Decrypt_Multi(const aes128_ctx *const *ctx, const unsigned char *const *in, unsigned char *const *out, unsigned int Count)
+{
+	unsigned char pass[BS_LANES * MAX_LENGTH];
+	tBSWord sk[8 * (AES128_ROUNDS + 1)];
+	tBSWord q[8];
+	unsigned int x;
+
+	memset(pass, 0, sizeof(pass));
+	for (x = 0; x < Count; x++)
+		memcpy(&pass[x * MAX_LENGTH], in[x], MAX_LENGTH);
+	BS_Merge_Keys(sk, ctx, Count);
+	BS_Load_Blocks128(q, pass);
+	BS_Decrypt_Core128(q, sk);
+	BS_Store_Blocks128(pass, q);
+	for (x = 0; x < Count; x++)
+		memcpy(out[x], &pass[x * MAX_LENGTH], MAX_LENGTH);
+}
+
+const tAESBackend Bitslice_Backend =
+{
+	"bitslice",
+	BS_Init,
+	BS_Encrypt,
+	BS_Decrypt,
+	BS_Encrypt_Blocks,
+	BS_Decrypt_Blocks,
+	BS_Encrypt_Multi,
+	BS_Decrypt_Multi
+};
+
+#endif
@@ -0,0 +1,303 @@
+//
+//          Filename: aes_cmac.c
+//          Function: AES-128-CMAC (NIST SP 800-38B / RFC 4493) on top of the aes128_ctx engine
+//
+//          CMAC is a CBC-MAC over the message with the last block masked by one of two subkeys, K1 for a whole final block and
+//          K2 for a padded one. The subkeys depend only on the key, so aes128_cmac_init works them out once with the schedule.
+//
+//          Each block of a CBC-MAC chain needs the output of the one before, so a single message cannot use the pipelined
+//          engines. The batch calls get the parallelism back across messages instead: up to 8 chains, one per lane, advance in
+//          lockstep through one aes128_encrypt_multi call per block, and a lane whose message is done is refilled from the queue.
+//
+//--------------------------------------------------------------------------------------------------------------------------------------
+
+#include "aes_cmac.h"
+#include <stdint.h>
+#include <string.h>
+
+// Name: CMAC_XOR
+// Function: X ^= in for one block, a word at a time
+//---------------------------------------------------------------------------------------------
+static void CMAC_XOR(unsigned char *X, const unsigned char *in)
+{
+	uint64_t a[2], b[2];
+
+	memcpy(a, X, MAX_LENGTH);
+	memcpy(b, in, MAX_LENGTH);
+	a[0] ^= b[0];
+	a[1] ^= b[1];
+	memcpy(X, a, MAX_LENGTH);
+}
+
+// Name: CMAC_Double
+// Function: out = in.x in GF(2^128) (big-endian, reduction 0x87). Constant time- no branch on the top bit of the key material
+//---------------------------------------------------------------------------------------------
+static void CMAC_Double(unsigned char *out, const unsigned char *in)
+{
+	unsigned char mask = (unsigned char)(0 - (in[0] >> 7));
+	unsigned int x;
+
+	for (x = 0; x < MAX_LENGTH - 1; x++)
+		out[x] = (unsigned char)((in[x] << 1) | (in[x + 1] >> 7));
+	out[MAX_LENGTH - 1] = (unsigned char)((in[MAX_LENGTH - 1] << 1) ^ (mask & 0x87));
+}
+
+// Name: CMAC_Last
+// Function: Folds the final block into the chain: a whole block (Length 16) is masked with K1, anything shorter (an empty
+//           message included) is padded with 0x80 0x00... and masked with K2. The chain still needs its last encryption
+// Parameters: Context holding the subkeys, chain, final block bytes, their count (0..16)
+//---------------------------------------------------------------------------------------------
+static void CMAC_Last(const aes128_cmac_ctx *ctx, unsigned char *X, const unsigned char *in, size_t Length)
+{
+	unsigned int x;
+
+	if (Length == MAX_LENGTH)
+	{
+		for (x = 0; x < MAX_LENGTH; x++)
+			X[x] ^= in[x] ^ ctx->K1[x];
+		return;
+	}
+	for (x = 0; x < Length; x++)
+		X[x] ^= in[x];
+	X[Length] ^= 0x80;
+	for (x = 0; x < MAX_LENGTH; x++)
+		X[x] ^= ctx->K2[x];
+}
+
+// Name: CMAC_Compare
+// Function: Constant time tag comparison
+// Returns: 1 if the tags match, 0 otherwise
+//---------------------------------------------------------------------------------------------
+static int CMAC_Compare(const unsigned char *a, const unsigned char *b)
+{
+	unsigned char diff = 0;
+	unsigned int x;
+
+	for (x = 0; x < CMAC_TAG_LENGTH; x++)
+		diff |= a[x] ^ b[x];
+	return (diff == 0);
+}
+
+// Name: aes128_cmac_init
+// Function: Expands the key and derives the subkeys K1 = L.x and K2 = L.x^2 from L = E(K, 0). Starts an empty message
+// Parameters: Context to fill, 16 byte key
+// Returns: void
+//--------------------------------------------------------------------------
+void aes128_cmac_init(aes128_cmac_ctx *ctx, const unsigned char *Key)
+{
+	unsigned char L[MAX_LENGTH];
+
+	aes128_init(&ctx->Key, Key);
+	memset(L, 0, sizeof(L));
+	aes128_encrypt_block(&ctx->Key, L);
+	CMAC_Double(ctx->K1, L);
+	CMAC_Double(ctx->K2, ctx->K1);
+	memset(L, 0, sizeof(L));
+
+	memset(ctx->X, 0, MAX_LENGTH);
+	ctx->BufferLength = 0;
+}
+
+// Name: aes128_cmac_update
+// Function: Adds Length bytes to the message. The last block seen is always held back in the buffer, since only
+//           aes128_cmac_final knows it is the final one
+// Parameters: Context, data, length in bytes
+// Returns: void
+//--------------------------------------------------------------------------
+void aes128_cmac_update(aes128_cmac_ctx *ctx, const unsigned char *in, size_t Length)
+{
+	size_t take;
+
+	if (Length == 0)
+		return;
+
+	// Top up the held back block. If there is more data after it, it was not the last one
+	if (ctx->BufferLength > 0)
+	{
+		take = MAX_LENGTH - ctx->BufferLength;
+		if (take > Length)
+			take = Length;
+		memcpy(ctx->Buffer + ctx->BufferLength, in, take);
+		ctx->BufferLength += (unsigned char)take;
+		in += take;
+		Length -= take;
+		if (Length == 0)
+			return;
+		CMAC_XOR(ctx->X, ctx->Buffer);
+		aes128_encrypt_block(&ctx->Key, ctx->X);
+		ctx->BufferLength = 0;
+	}
+
+	// Whole blocks straight from the input, keeping back whatever could be the last one
+	while (Length > MAX_LENGTH)
+	{
+		CMAC_XOR(ctx->X, in);
+		aes128_encrypt_block(&ctx->Key, ctx->X);
+		in += MAX_LENGTH;
+		Length -= MAX_LENGTH;
+	}
+	memcpy(ctx->Buffer, in, Length);
+	ctx->BufferLength = (unsigned char)Length;
+}
+
+// Name: aes128_cmac_final
+// Function: Writes the 16 byte tag and resets the chain, keeping the key and subkeys for the next message
+// Parameters: Context, 16 byte tag out
+// Returns: void
+//--------------------------------------------------------------------------
+void aes128_cmac_final(aes128_cmac_ctx *ctx, unsigned char *Tag)
+{
+	CMAC_Last(ctx, ctx->X, ctx->Buffer, ctx->BufferLength);
+	aes128_encrypt_block(&ctx->Key, ctx->X);
+	memcpy(Tag, ctx->X, CMAC_TAG_LENGTH);
+
+	memset(ctx->X, 0, MAX_LENGTH);
+	memset(ctx->Buffer, 0, MAX_LENGTH);
+	ctx->BufferLength = 0;
+}
+
+// Name: aes128_cmac
+// Function: One-shot CMAC for a key that is used once. Keep an aes128_cmac_ctx instead when a key signs many messages
+// Parameters: 16 byte key, message, length in bytes, 16 byte tag out
+// Returns: void
+//--------------------------------------------------------------------------
+void aes128_cmac(const unsigned char *Key, const unsigned char *in, size_t Length, unsigned char *Tag)
+{
+	aes128_cmac_ctx ctx;
+
+	aes128_cmac_init(&ctx, Key);
+	aes128_cmac_update(&ctx, in, Length);
+	aes128_cmac_final(&ctx, Tag);
+	memset(&ctx, 0, sizeof(ctx));
+}
+
+// Name: aes128_cmac_verify
+// Function: Computes the tag of a whole message with a keyed context and checks it against Tag in constant time. Any
+//           message already in progress on the context is discarded
+// Parameters: Keyed context, message, length in bytes, expected 16 byte tag
+// Returns: 1 if the tag matches, 0 otherwise
+//--------------------------------------------------------------------------
+int aes128_cmac_verify(aes128_cmac_ctx *ctx, const unsigned char *in, size_t Length, const unsigned char *Tag)
+{
+	unsigned char Check[CMAC_TAG_LENGTH];
+	int ok;
+
+	memset(ctx->X, 0, MAX_LENGTH);
+	ctx->BufferLength = 0;
+	aes128_cmac_update(ctx, in, Length);
+	aes128_cmac_final(ctx, Check);
+	ok = CMAC_Compare(Check, Tag);
+	memset(Check, 0, sizeof(Check));
+	return ok;
+}
+
+// Name: CMAC_Batch_Run
+// Function: Multi-buffer scheduler, as Batch_Run in aes_modes.c. Up to 8 messages are live at once, one chain per lane.
+//           Every step folds the next block of every live message into its chain and encrypts all the chains with one
+//           multi-key engine call; a lane whose message has had its final block is finished and refilled from the queue
+// Parameters: Jobs, job count, 1 to check each job's Tag rather than write it, per job results (may be NULL)
+// Returns: 1 if every tag matched (always 1 when writing tags), 0 otherwise
+//---------------------------------------------------------------------------------------------
+static int CMAC_Batch_Run(const aes128_cmac_job *Jobs, size_t Count, unsigned char Verify, unsigned char *Valid)
+{
+	const aes128_ctx *keys[AES128_MULTI_LANES];
+	unsigned char X[AES128_MULTI_LANES][MAX_LENGTH];
+	const unsigned char *chain[AES128_MULTI_LANES];
+	unsigned char *chainOut[AES128_MULTI_LANES];
+	const unsigned char *in[AES128_MULTI_LANES];
+	size_t left[AES128_MULTI_LANES], job[AES128_MULTI_LANES];
+	size_t next = 0, tail;
+	unsigned int live = 0, x;
+	int all = 1, ok;
+
+	for (x = 0; x < AES128_MULTI_LANES; x++)
+	{
+		chain[x] = X[x];
+		chainOut[x] = X[x];
+	}
+
+	for (;;)
+	{
+		// Refill lanes from the queue. Every message has at least one block, the empty one included
+		while ((live < AES128_MULTI_LANES) && (next < Count))
+		{
+			keys[live] = &Jobs[next].ctx->Key;
+			in[live] = Jobs[next].in;
+			left[live] = (Jobs[next].Length == 0) ? 1 : (Jobs[next].Length + MAX_LENGTH - 1) / MAX_LENGTH;
+			job[live] = next;
+			memset(X[live], 0, MAX_LENGTH);
+			live++;
+			next++;
+		}
+		if (live == 0)
+			break;
+
+		// Fold in the next block of every lane
+		for (x = 0; x < live; x++)
+		{
+			if (left[x] == 1)
+			{
+				tail = Jobs[job[x]].Length - (size_t)(in[x] - Jobs[job[x]].in);
+				CMAC_Last(Jobs[job[x]].ctx, X[x], in[x], tail);
+			}
+			else
+				CMAC_XOR(X[x], in[x]);
+		}
+
+		aes128_encrypt_multi(keys, chain, chainOut, live);
+
+		// Advance every lane, moving the last live lane into any that just finished
+		for (x = 0; x < live; )
+		{
+			if (--left[x] == 0)
+			{
+				if (Verify)
+				{
+					ok = CMAC_Compare(X[x], Jobs[job[x]].Tag);
+					if (Valid != NULL)
+						Valid[job[x]] = (unsigned char)ok;
+					all &= ok;
+				}
+				else
+					memcpy(Jobs[job[x]].Tag, X[x], CMAC_TAG_LENGTH);
+
+				live--;
+				if (x != live)						// The last lane finishing has nothing to move into it
+				{
+					keys[x] = keys[live];
+					in[x] = in[live];
+					left[x] = left[live];
+					job[x] = job[live];
+					memcpy(X[x], X[live], MAX_LENGTH);
+				}
+			}
+			else
+			{
+				in[x] += MAX_LENGTH;
+				x++;
+			}
+		}
+	}
+	memset(X, 0, sizeof(X));
+	return all;
+}
+
+// Name: aes128_cmac_batch
+// Function: Computes the tags of many independent messages, each under its own keyed context, 8 chains interleaved at a time
+// Parameters: Array of jobs (Tag is written), job count
+// Returns: void
+//--------------------------------------------------------------------------
+void aes128_cmac_batch(const aes128_cmac_job *Jobs, size_t Count)
+{
+	CMAC_Batch_Run(Jobs, Count, 0, NULL);
+}
+
+// Name: aes128_cmac_verify_batch
+// Function: Checks many messages against their expected tags, 8 chains interleaved at a time, e.g. a fleet of firmware images
+// Parameters: Array of jobs (Tag is the expected tag), job count, Count per job results- 1 valid, 0 not (may be NULL)
+// Returns: 1 if every message verified, 0 if any failed
+//--------------------------------------------------------------------------
+int aes128_cmac_verify_batch(const aes128_cmac_job *Jobs, size_t Count, unsigned char *Valid)
+{
+	return CMAC_Batch_Run(Jobs, Count, 1, Valid);
+}
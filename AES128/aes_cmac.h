@@ -0,0 +1,52 @@
+//
+//               Filename: aes_cmac.h
+//               Description: AES-128-CMAC (NIST SP 800-38B / RFC 4493) message authentication
+//
+//
+//------------------------------------------------------------------------------------------------------------------------------------
+
+#ifndef AES_CMAC_H_
+#define AES_CMAC_H_
+
+#include "aes.h"
+
+// Definitions
+//-------------
+#define CMAC_TAG_LENGTH		16
+
+// CMAC context- the key schedule and the K1/K2 subkeys, worked out once by aes128_cmac_init, plus the running chain of the
+// message being authenticated. aes128_cmac_final leaves the key in place, so the context is ready for the next message
+typedef struct
+{
+	aes128_ctx Key;
+	unsigned char K1[MAX_LENGTH];				// Subkey for a message ending on a whole block
+	unsigned char K2[MAX_LENGTH];				// Subkey for a padded final block
+	unsigned char X[MAX_LENGTH];				// CBC-MAC chain so far
+	unsigned char Buffer[MAX_LENGTH];			// Held back until more data shows it is not the last block
+	unsigned char BufferLength;
+} aes128_cmac_ctx;
+
+// One record for the batch calls- the whole message in at Length bytes under ctx (only its key and subkeys are used)
+typedef struct
+{
+	const aes128_cmac_ctx *ctx;
+	const unsigned char *in;
+	size_t Length;
+	unsigned char *Tag;							// Tag out for aes128_cmac_batch, expected tag for aes128_cmac_verify_batch
+} aes128_cmac_job;
+
+
+// Linked under names tagged with the engine flags- see AES128_LINK_NAME in aes.h
+#define aes128_cmac_init	AES128_LINK_NAME(aes128_cmac_init)
+
+// Function Prototypes
+//---------------------
+void aes128_cmac_init(aes128_cmac_ctx *ctx, const unsigned char *Key);
+void aes128_cmac_update(aes128_cmac_ctx *ctx, const unsigned char *in, size_t Length);
+void aes128_cmac_final(aes128_cmac_ctx *ctx, unsigned char *Tag);
+void aes128_cmac(const unsigned char *Key, const unsigned char *in, size_t Length, unsigned char *Tag);
+int aes128_cmac_verify(aes128_cmac_ctx *ctx, const unsigned char *in, size_t Length, const unsigned char *Tag);
+void aes128_cmac_batch(const aes128_cmac_job *Jobs, size_t Count);
+int aes128_cmac_verify_batch(const aes128_cmac_job *Jobs, size_t Count, unsigned char *Valid);
+
+#endif
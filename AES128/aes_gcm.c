@@ -0,0 +1,521 @@
+//
+//          Filename: aes_gcm.c
+//          Function: AES-128-GCM (NIST SP 800-38D) on top of the aes128_ctx engine
+//
+//          Encryption and authentication happen in one pass: each run of 8 blocks is CTR encrypted through aes128_encrypt_blocks
+//          and GHASHed straight away while it is still in L1, so the data is only walked once.
+//
+//          GHASH has two implementations:
+//              - portable 4-bit table (Shoup's method, 256 bytes per key)
+//              - PCLMULQDQ carry-less multiply, folding 8 blocks into one reduction with the H^1..H^8 table (x86, built with AES_NI)
+//          The choice is made once at startup from CPUID, like the AES engine.
+//
+//--------------------------------------------------------------------------------------------------------------------------------------
+
+#include "aes_gcm.h"
+#include "aes_backend.h"
+#include <string.h>
+
+#ifdef AES_NI
+#include <cpuid.h>
+#include <emmintrin.h>
+#include <tmmintrin.h>
+#include <wmmintrin.h>
+
+#define GCM_CLMUL_TARGET	__attribute__((target("sse2,ssse3,pclmul")))
+#endif
+
+#define GCM_PIPELINE_BLOCKS		8
+
+// Reduction constants for the 4-bit table method
+static const uint64_t GCM_Last4[16] =
+{
+	0x0000, 0x1c20, 0x3840, 0x2460, 0x7080, 0x6ca0, 0x48c0, 0x54e0,
+	0xe100, 0xfd20, 0xd940, 0xc560, 0x9180, 0x8da0, 0xa9c0, 0xb5e0
+};
+
+// Name: GCM_Load64 / GCM_Store64
+// Function: Big-endian 64-bit access
+//---------------------------------------------------------------------------------------------
+static uint64_t GCM_Load64(const unsigned char *p)
+{
+	uint64_t v = 0;
+	unsigned char x;
+
+	for (x = 0; x < 8; x++)
+		v = (v << 8) | p[x];
+	return v;
+}
+
+static void GCM_Store64(unsigned char *p, uint64_t v)
+{
+	unsigned char x;
+
+	for (x = 8; x > 0; x--)
+	{
+		p[x - 1] = (unsigned char)v;
+		v >>= 8;
+	}
+}
+
+// Name: GCM_Table_Mult
+// Function: X = X.H in GF(2^128) using the 4-bit tables
+//---------------------------------------------------------------------------------------------
+static void GCM_Table_Mult(const aes128_gcm_ctx *ctx, unsigned char *X)
+{
+	uint64_t zh, zl;
+	unsigned char lo, hi, rem;
+	int i;
+
+	lo = X[15] & 0x0f;
+	zh = ctx->HH[lo];
+	zl = ctx->HL[lo];
+
+	for (i = 15; i >= 0; i--)
+	{
+		lo = X[i] & 0x0f;
+		hi = (X[i] >> 4) & 0x0f;
+
+		if (i != 15)
+		{
+			rem = (unsigned char)zl & 0x0f;
+			zl = (zh << 60) | (zl >> 4);
+			zh = (zh >> 4) ^ (GCM_Last4[rem] << 48);
+			zh ^= ctx->HH[lo];
+			zl ^= ctx->HL[lo];
+		}
+		rem = (unsigned char)zl & 0x0f;
+		zl = (zh << 60) | (zl >> 4);
+		zh = (zh >> 4) ^ (GCM_Last4[rem] << 48);
+		zh ^= ctx->HH[hi];
+		zl ^= ctx->HL[hi];
+	}
+	GCM_Store64(X, zh);
+	GCM_Store64(X + 8, zl);
+}
+
+// Name: GCM_Table_Init
+// Function: Builds the 4-bit multiples of H
+//---------------------------------------------------------------------------------------------
+static void GCM_Table_Init(aes128_gcm_ctx *ctx, const unsigned char *H)
+{
+	uint64_t vh, vl, T;
+	unsigned char i, j;
+
+	vh = GCM_Load64(H);
+	vl = GCM_Load64(H + 8);
+
+	ctx->HL[8] = vl;
+	ctx->HH[8] = vh;
+	ctx->HH[0] = 0;
+	ctx->HL[0] = 0;
+
+	for (i = 4; i > 0; i >>= 1)
+	{
+		T = (vl & 1) * 0xe1000000U;
+		vl = (vh << 63) | (vl >> 1);
+		vh = (vh >> 1) ^ (T << 32);
+		ctx->HL[i] = vl;
+		ctx->HH[i] = vh;
+	}
+	for (i = 2; i <= 8; i *= 2)
+	{
+		vh = ctx->HH[i];
+		vl = ctx->HL[i];
+		for (j = 1; j < i; j++)
+		{
+			ctx->HH[i + j] = vh ^ ctx->HH[j];
+			ctx->HL[i + j] = vl ^ ctx->HL[j];
+		}
+	}
+}
+
+// Name: GCM_Table_Update
+// Function: Folds Length bytes into the running hash X. A short last block is zero padded
+//---------------------------------------------------------------------------------------------
+static void GCM_Table_Update(const aes128_gcm_ctx *ctx, unsigned char *X, const unsigned char *Data, size_t Length)
+{
+	unsigned char x, n;
+
+	while (Length > 0)
+	{
+		n = (Length < MAX_LENGTH) ? (unsigned char)Length : MAX_LENGTH;
+		for (x = 0; x < n; x++)
+			X[x] ^= Data[x];
+		GCM_Table_Mult(ctx, X);
+		Data += n;
+		Length -= n;
+	}
+}
+
+#ifdef AES_NI
+//--------------------------------------------------------------------------------------------------------------------------------------
+// PCLMULQDQ GHASH. Values are held byte reflected so the carry-less multiply works on the natural bit order
+//--------------------------------------------------------------------------------------------------------------------------------------
+
+// Non-zero when the CPU has PCLMULQDQ and SSSE3. Set once by GCM_Select before main() runs and only read after that-
+// every context copies it at init, so GHASH never depends on a flag that could change under it
+static int GCM_Use_CLMUL = 0;
+
+// Name: GCM_Select
+// Function: CPUID leaf 1- ECX bit 1 is PCLMULQDQ, ECX bit 9 is SSSE3 (PSHUFB for the byte reflection)
+//---------------------------------------------------------------------------------------------
+__attribute__((constructor)) static void GCM_Select(void)
+{
+	unsigned int eax, ebx, ecx, edx;
+
+	if (__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+		GCM_Use_CLMUL = ((ecx & (1u << 1)) != 0) && ((ecx & (1u << 9)) != 0);
+}
+
+// Name: GCM_Clmul_Wide
+// Function: Full 256-bit carry-less product of a and b, accumulated into lo/hi without reduction
+//---------------------------------------------------------------------------------------------
+GCM_CLMUL_TARGET static void GCM_Clmul_Wide(__m128i a, __m128i b, __m128i *lo, __m128i *hi)
+{
+	__m128i t0, t1, t2, t3;
+
+	t0 = _mm_clmulepi64_si128(a, b, 0x00);
+	t1 = _mm_clmulepi64_si128(a, b, 0x10);
+	t2 = _mm_clmulepi64_si128(a, b, 0x01);
+	t3 = _mm_clmulepi64_si128(a, b, 0x11);
+	t1 = _mm_xor_si128(t1, t2);
+	*lo = _mm_xor_si128(*lo, _mm_xor_si128(t0, _mm_slli_si128(t1, 8)));
+	*hi = _mm_xor_si128(*hi, _mm_xor_si128(t3, _mm_srli_si128(t1, 8)));
+}
+
+// Name: GCM_Clmul_Reduce
+// Function: Shifts the reflected 256-bit product left one bit and reduces it modulo x^128 + x^7 + x^2 + x + 1
+//---------------------------------------------------------------------------------------------
+GCM_CLMUL_TARGET static __m128i GCM_Clmul_Reduce(__m128i lo, __m128i hi)
+{
+	__m128i t7, t8, t9, t2, t4, t5;
+
+	t7 = _mm_srli_epi32(lo, 31);
+	t8 = _mm_srli_epi32(hi, 31);
+	lo = _mm_slli_epi32(lo, 1);
+	hi = _mm_slli_epi32(hi, 1);
+	t9 = _mm_srli_si128(t7, 12);
+	t8 = _mm_slli_si128(t8, 4);
+	t7 = _mm_slli_si128(t7, 4);
+	lo = _mm_or_si128(lo, t7);
+	hi = _mm_or_si128(hi, t8);
+	hi = _mm_or_si128(hi, t9);
+
+	t7 = _mm_slli_epi32(lo, 31);
+	t8 = _mm_slli_epi32(lo, 30);
+	t9 = _mm_slli_epi32(lo, 25);
+	t7 = _mm_xor_si128(t7, t8);
+	t7 = _mm_xor_si128(t7, t9);
+	t8 = _mm_srli_si128(t7, 4);
+	t7 = _mm_slli_si128(t7, 12);
+	lo = _mm_xor_si128(lo, t7);
+
+	t2 = _mm_srli_epi32(lo, 1);
+	t4 = _mm_srli_epi32(lo, 2);
+	t5 = _mm_srli_epi32(lo, 7);
+	t2 = _mm_xor_si128(t2, t4);
+	t2 = _mm_xor_si128(t2, t5);
+	t2 = _mm_xor_si128(t2, t8);
+	lo = _mm_xor_si128(lo, t2);
+	return _mm_xor_si128(hi, lo);
+}
+
+// Name: GCM_Clmul_Load
+// Function: Loads a 16 byte block (zero padded when short) and reflects it
+//---------------------------------------------------------------------------------------------
+GCM_CLMUL_TARGET static __m128i GCM_Clmul_Load(const unsigned char *Data, size_t Length)
+{
+	const __m128i bswap = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+	unsigned char pad[MAX_LENGTH];
+
+	if (Length < MAX_LENGTH)
+	{
+		memset(pad, 0, sizeof(pad));
+		memcpy(pad, Data, Length);
+		Data = pad;
+	}
+	return _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)Data), bswap);
+}
+
+// Name: GCM_Clmul_Init
+// Function: Stores H^1..H^8 reflected
+//---------------------------------------------------------------------------------------------
+GCM_CLMUL_TARGET static void GCM_Clmul_Init(aes128_gcm_ctx *ctx, const unsigned char *H)
+{
+	__m128i h, p, lo, hi;
+	unsigned char x;
+
+	h = GCM_Clmul_Load(H, MAX_LENGTH);
+	p = h;
+	_mm_storeu_si128((__m128i *)ctx->HPow[0], p);
+	for (x = 1; x < GCM_HPOWERS; x++)
+	{
+		lo = _mm_setzero_si128();
+		hi = _mm_setzero_si128();
+		GCM_Clmul_Wide(p, h, &lo, &hi);
+		p = GCM_Clmul_Reduce(lo, hi);
+		_mm_storeu_si128((__m128i *)ctx->HPow[x], p);
+	}
+}
+
+// Name: GCM_Clmul_Update
+// Function: Folds Length bytes into X. Runs of 8 blocks are multiplied by H^8..H^1 and reduced once
+//---------------------------------------------------------------------------------------------
+GCM_CLMUL_TARGET static void GCM_Clmul_Update(const aes128_gcm_ctx *ctx, unsigned char *X, const unsigned char *Data, size_t Length)
+{
+	const __m128i bswap = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+	__m128i y, lo, hi;
+	unsigned char x;
+	size_t n;
+
+	y = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)X), bswap);
+
+	while (Length >= GCM_HPOWERS * MAX_LENGTH)
+	{
+		lo = _mm_setzero_si128();
+		hi = _mm_setzero_si128();
+		y = _mm_xor_si128(y, GCM_Clmul_Load(Data, MAX_LENGTH));
+		GCM_Clmul_Wide(y, _mm_loadu_si128((const __m128i *)ctx->HPow[GCM_HPOWERS - 1]), &lo, &hi);
+		for (x = 1; x < GCM_HPOWERS; x++)
+			GCM_Clmul_Wide(GCM_Clmul_Load(Data + x * MAX_LENGTH, MAX_LENGTH), _mm_loadu_si128((const __m128i *)ctx->HPow[GCM_HPOWERS - 1 - x]), &lo, &hi);
+		y = GCM_Clmul_Reduce(lo, hi);
+		Data += GCM_HPOWERS * MAX_LENGTH;
+		Length -= GCM_HPOWERS * MAX_LENGTH;
+	}
+	while (Length > 0)
+	{
+		n = (Length < MAX_LENGTH) ? Length : MAX_LENGTH;
+		lo = _mm_setzero_si128();
+		hi = _mm_setzero_si128();
+		GCM_Clmul_Wide(_mm_xor_si128(y, GCM_Clmul_Load(Data, n)), _mm_loadu_si128((const __m128i *)ctx->HPow[0]), &lo, &hi);
+		y = GCM_Clmul_Reduce(lo, hi);
+		Data += n;
+		Length -= n;
+	}
+	_mm_storeu_si128((__m128i *)X, _mm_shuffle_epi8(y, bswap));
+}
+#endif
+
+// Name: GHASH_Update
+// Function: Folds Length bytes into the running hash X with the multiplier the context was initialised for
+//---------------------------------------------------------------------------------------------
+static void GHASH_Update(const aes128_gcm_ctx *ctx, unsigned char *X, const unsigned char *Data, size_t Length)
+{
+#ifdef AES_NI
+	if (ctx->UseCLMUL)
+	{
+		GCM_Clmul_Update(ctx, X, Data, Length);
+		return;
+	}
+#endif
+	GCM_Table_Update(ctx, X, Data, Length);
+}
+
+// Name: GCM_Start
+// Function: Derives the pre-counter block J0 from the IV and hashes the AAD
+//---------------------------------------------------------------------------------------------
+static void GCM_Start(const aes128_gcm_ctx *ctx, const unsigned char *IV, size_t IVLength, const unsigned char *AAD, size_t AADLength,
+					  unsigned char *J0, unsigned char *X)
+{
+	unsigned char lens[MAX_LENGTH];
+
+	memset(J0, 0, MAX_LENGTH);
+	if (IVLength == GCM_IV_LENGTH)
+	{
+		memcpy(J0, IV, GCM_IV_LENGTH);
+		J0[15] = 1;
+	}
+	else
+	{
+		GHASH_Update(ctx, J0, IV, IVLength);
+		memset(lens, 0, sizeof(lens));
+		GCM_Store64(lens + 8, (uint64_t)IVLength * 8);
+		GHASH_Update(ctx, J0, lens, MAX_LENGTH);
+	}
+
+	memset(X, 0, MAX_LENGTH);
+	GHASH_Update(ctx, X, AAD, AADLength);
+}
+
+// Name: GCM_Finish
+// Function: Hashes the length block and encrypts the result with E(K, J0) to form the tag
+//---------------------------------------------------------------------------------------------
+static void GCM_Finish(const aes128_gcm_ctx *ctx, const unsigned char *J0, unsigned char *X, size_t AADLength, size_t Length, unsigned char *Tag)
+{
+	unsigned char lens[MAX_LENGTH];
+	unsigned char x;
+
+	GCM_Store64(lens, (uint64_t)AADLength * 8);
+	GCM_Store64(lens + 8, (uint64_t)Length * 8);
+	GHASH_Update(ctx, X, lens, MAX_LENGTH);
+
+	memcpy(Tag, J0, MAX_LENGTH);
+	aes128_encrypt_block(&ctx->Key, Tag);
+	for (x = 0; x < GCM_TAG_LENGTH; x++)
+		Tag[x] ^= X[x];
+}
+
+// Name: GCM_Lengths_Valid
+// Function: SP 800-38D limits. GCM_Keystream only steps the low 32 bits of the counter, so a longer message would wrap back
+//           to J0 and reuse the keystream, tag mask included. The IV must not be empty
+//---------------------------------------------------------------------------------------------
+static int GCM_Lengths_Valid(size_t IVLength, size_t AADLength, size_t Length)
+{
+	return (IVLength > 0) && ((uint64_t)IVLength <= GCM_MAX_AAD_LENGTH) && ((uint64_t)AADLength <= GCM_MAX_AAD_LENGTH)
+		&& ((uint64_t)Length <= GCM_MAX_LENGTH);
+}
+
+// Name: GCM_Keystream
+// Function: Encrypts Blocks counter blocks following Counter. GCM increments only the low 32 bits
+//---------------------------------------------------------------------------------------------
+static void GCM_Keystream(const aes128_gcm_ctx *ctx, unsigned char *Counter, unsigned char *ks, size_t Blocks)
+{
+	uint32_t c;
+	size_t x;
+
+	c = ((uint32_t)Counter[12] << 24) | ((uint32_t)Counter[13] << 16) | ((uint32_t)Counter[14] << 8) | Counter[15];
+	for (x = 0; x < Blocks; x++)
+	{
+		c++;
+		memcpy(ks + x * MAX_LENGTH, Counter, 12);
+		ks[x * MAX_LENGTH + 12] = (unsigned char)(c >> 24);
+		ks[x * MAX_LENGTH + 13] = (unsigned char)(c >> 16);
+		ks[x * MAX_LENGTH + 14] = (unsigned char)(c >> 8);
+		ks[x * MAX_LENGTH + 15] = (unsigned char)c;
+	}
+	Counter[12] = (unsigned char)(c >> 24);
+	Counter[13] = (unsigned char)(c >> 16);
+	Counter[14] = (unsigned char)(c >> 8);
+	Counter[15] = (unsigned char)c;
+	aes128_encrypt_blocks(&ctx->Key, ks, Blocks);
+}
+
+// Name: GCM_Init_With
+// Function: Expands the key, precomputes the GHASH tables for H = E(K, 0^128) and fixes the multiplier in the context.
+//           HPow is filled whenever the CPU has PCLMULQDQ, so a context can only be marked UseCLMUL with its powers in place
+//---------------------------------------------------------------------------------------------
+static void GCM_Init_With(aes128_gcm_ctx *ctx, const unsigned char *Key, unsigned char UseCLMUL)
+{
+	unsigned char H[MAX_LENGTH];
+
+	aes128_init(&ctx->Key, Key);
+	memset(H, 0, sizeof(H));
+	aes128_encrypt_block(&ctx->Key, H);
+
+	GCM_Table_Init(ctx, H);
+	memset(ctx->HPow, 0, sizeof(ctx->HPow));
+	ctx->UseCLMUL = 0;
+#ifdef AES_NI
+	if (GCM_Use_CLMUL)
+	{
+		GCM_Clmul_Init(ctx, H);
+		ctx->UseCLMUL = UseCLMUL;
+	}
+#else
+	(void)UseCLMUL;
+#endif
+	memset(H, 0, sizeof(H));
+}
+
+// Name: aes128_gcm_init
+// Function: Expands the key and precomputes the GHASH tables. GHASH runs on PCLMULQDQ when the CPU has it, else the table
+// Parameters: GCM context, 16 byte key
+// Returns: void
+//--------------------------------------------------------------------------
+void aes128_gcm_init(aes128_gcm_ctx *ctx, const unsigned char *Key)
+{
+	GCM_Init_With(ctx, Key, 1);
+}
+
+// Name: GCM_Init_Table
+// Function: As aes128_gcm_init with GHASH pinned to the 4-bit table, so AESUT can check it on a PCLMULQDQ machine without
+//           touching the process-wide selection
+//--------------------------------------------------------------------------
+void GCM_Init_Table(aes128_gcm_ctx *ctx, const unsigned char *Key)
+{
+	GCM_Init_With(ctx, Key, 0);
+}
+
+// Name: aes128_gcm_encrypt
+// Function: Encrypts and authenticates in one pass
+// Parameters: GCM context, IV (12 bytes recommended), AAD, plaintext in, ciphertext out (may equal in), length, 16 byte tag out
+// Returns: 1 on success, 0 when the IV is empty or a length is over the SP 800-38D limits (GCM_MAX_LENGTH for the plaintext).
+//          Nothing is written in that case
+//--------------------------------------------------------------------------
+int aes128_gcm_encrypt(const aes128_gcm_ctx *ctx, const unsigned char *IV, size_t IVLength, const unsigned char *AAD, size_t AADLength,
+					   const unsigned char *in, unsigned char *out, size_t Length, unsigned char *Tag)
+{
+	unsigned char J0[MAX_LENGTH], Counter[MAX_LENGTH], X[MAX_LENGTH];
+	unsigned char ks[GCM_PIPELINE_BLOCKS * MAX_LENGTH];
+	size_t remaining, chunk, x;
+
+	if (!GCM_Lengths_Valid(IVLength, AADLength, Length))
+		return 0;
+
+	GCM_Start(ctx, IV, IVLength, AAD, AADLength, J0, X);
+	memcpy(Counter, J0, MAX_LENGTH);
+
+	for (remaining = Length; remaining > 0; remaining -= chunk)
+	{
+		chunk = (remaining < sizeof(ks)) ? remaining : sizeof(ks);
+		GCM_Keystream(ctx, Counter, ks, (chunk + MAX_LENGTH - 1) / MAX_LENGTH);
+		for (x = 0; x < chunk; x++)
+			out[x] = in[x] ^ ks[x];
+		// Hash the ciphertext while it is still in cache
+		GHASH_Update(ctx, X, out, chunk);
+		in += chunk;
+		out += chunk;
+	}
+
+	GCM_Finish(ctx, J0, X, AADLength, Length, Tag);
+	memset(ks, 0, sizeof(ks));
+	return 1;
+}
+
+// Name: aes128_gcm_decrypt
+// Function: Authenticates and decrypts in one pass
+// Parameters: GCM context, IV, AAD, ciphertext in, plaintext out (may equal in), length, 16 byte expected tag
+// Returns: 1 when the tag matches, 0 otherwise. On a tag mismatch the output is wiped so unauthenticated plaintext is never
+//          released. Lengths outside the SP 800-38D limits are rejected before anything is written
+//--------------------------------------------------------------------------
+int aes128_gcm_decrypt(const aes128_gcm_ctx *ctx, const unsigned char *IV, size_t IVLength, const unsigned char *AAD, size_t AADLength,
+						const unsigned char *in, unsigned char *out, size_t Length, const unsigned char *Tag)
+{
+	unsigned char J0[MAX_LENGTH], Counter[MAX_LENGTH], X[MAX_LENGTH], Check[GCM_TAG_LENGTH];
+	unsigned char ks[GCM_PIPELINE_BLOCKS * MAX_LENGTH];
+	unsigned char *start = out;
+	unsigned char diff = 0;
+	size_t remaining, chunk, x;
+
+	if (!GCM_Lengths_Valid(IVLength, AADLength, Length))
+		return 0;
+
+	GCM_Start(ctx, IV, IVLength, AAD, AADLength, J0, X);
+	memcpy(Counter, J0, MAX_LENGTH);
+
+	for (remaining = Length; remaining > 0; remaining -= chunk)
+	{
+		chunk = (remaining < sizeof(ks)) ? remaining : sizeof(ks);
+		// Hash before decrypting- out may overwrite in
+		GHASH_Update(ctx, X, in, chunk);
+		GCM_Keystream(ctx, Counter, ks, (chunk + MAX_LENGTH - 1) / MAX_LENGTH);
+		for (x = 0; x < chunk; x++)
+			out[x] = in[x] ^ ks[x];
+		in += chunk;
+		out += chunk;
+	}
+
+	GCM_Finish(ctx, J0, X, AADLength, Length, Check);
+	memset(ks, 0, sizeof(ks));
+
+	// Constant-time compare
+	for (x = 0; x < GCM_TAG_LENGTH; x++)
+		diff |= Check[x] ^ Tag[x];
+	if (diff != 0)
+	{
+		memset(start, 0, Length);
+		return 0;
+	}
+	return 1;
+}
@@ -0,0 +1,44 @@
+//       
+//               Filename: aes_gcm.h
+//               Description: AES-128-GCM authenticated encryption
+//
+//
+//------------------------------------------------------------------------------------------------------------------------------------
+
+#ifndef AES_GCM_H_
+#define AES_GCM_H_
+
+#include "aes.h"
+#include <stdint.h>
+
+// Definitions
+//-------------
+#define GCM_TAG_LENGTH		16
+#define GCM_IV_LENGTH		12		// Recommended IV size- any other length goes through GHASH first
+#define GCM_HPOWERS			8		// Blocks folded into a single reduction on the PCLMULQDQ path
+#define GCM_MAX_LENGTH		((((uint64_t)1) << 36) - 32)	// SP 800-38D plaintext limit, 2^32 - 2 blocks of keystream
+#define GCM_MAX_AAD_LENGTH	((((uint64_t)1) << 61) - 1)	// AAD and IV limit- their bit lengths must fit the 64-bit length fields
+
+// GCM context- the cipher key plus everything derived from the hash key H, computed once by aes128_gcm_init
+typedef struct
+{
+	aes128_ctx Key;
+	uint64_t HL[16];							// 4-bit Shoup table, low halves of i.H
+	uint64_t HH[16];							// 4-bit Shoup table, high halves of i.H
+	unsigned char HPow[GCM_HPOWERS][16];		// H^1..H^8, byte reflected, for aggregated reduction with PCLMULQDQ
+	unsigned char UseCLMUL;						// GHASH multiplier fixed at init- 1 PCLMULQDQ (HPow filled), 0 the 4-bit table
+} aes128_gcm_ctx;
+
+
+// Linked under names tagged with the engine flags- see AES128_LINK_NAME in aes.h
+#define aes128_gcm_init	AES128_LINK_NAME(aes128_gcm_init)
+
+// Function Prototypes
+//---------------------
+void aes128_gcm_init(aes128_gcm_ctx *ctx, const unsigned char *Key);
+int aes128_gcm_encrypt(const aes128_gcm_ctx *ctx, const unsigned char *IV, size_t IVLength, const unsigned char *AAD, size_t AADLength,
+					   const unsigned char *in, unsigned char *out, size_t Length, unsigned char *Tag);
+int aes128_gcm_decrypt(const aes128_gcm_ctx *ctx, const unsigned char *IV, size_t IVLength, const unsigned char *AAD, size_t AADLength,
+						const unsigned char *in, unsigned char *out, size_t Length, const unsigned char *Tag);
+
+#endif
@@ -0,0 +1,255 @@
+//
+//          Filename: aes_keystore.c
+//          Function: Bounded cache of expanded AES-128 key contexts
+//
+//          Keys are looked up by a 32-bit id through a hash table that lives inside the slot array itself (slot i doubles as the
+//          head of bucket i), so lookup is O(1) and the only memory is the caller's slot array. On a miss the raw key comes from
+//          the caller's loader, is expanded once with aes128_init and wiped. When the store is full the least recently used
+//          context is evicted and its schedules are wiped before the slot is reused.
+//
+//          Even a hit relinks the LRU list, so every call takes the store's mutex whatever the build flags. aes128_keystore_get
+//          returns a pointer into the store which stays valid only until the next call on that store; from multiple threads use
+//          aes128_keystore_fetch, which copies the context out under the mutex. Link with -pthread.
+//
+//--------------------------------------------------------------------------------------------------------------------------------------
+
+#include "aes_keystore.h"
+#include <string.h>
+
+#define KS_SLOT(ks, link)	(&(ks)->Slots[(link) - 1])
+
+#define KS_LOCK(ks)		pthread_mutex_lock(&(ks)->Lock)
+#define KS_UNLOCK(ks)	pthread_mutex_unlock(&(ks)->Lock)
+
+// Name: KS_Wipe
+// Function: memset through a volatile pointer so the compiler cannot drop it as a dead store
+//---------------------------------------------------------------------------------------------
+static void KS_Wipe(void *p, size_t Length)
+{
+	volatile unsigned char *v = (volatile unsigned char *)p;
+
+	while (Length--)
+		*v++ = 0;
+}
+
+// Name: KS_Bucket
+// Function: Maps a key id onto a bucket- multiplicative hash (Knuth's constant) reduced mod the slot count
+//---------------------------------------------------------------------------------------------
+static uint32_t KS_Bucket(const aes128_keystore *ks, uint32_t KeyId)
+{
+	return (uint32_t)((KeyId * 2654435761u) % ks->SlotCount);
+}
+
+// Name: KS_LRU_Unlink
+//---------------------------------------------------------------------------------------------
+static void KS_LRU_Unlink(aes128_keystore *ks, uint32_t link)
+{
+	aes128_keystore_slot *s = KS_SLOT(ks, link);
+
+	if (s->Newer != KS_NONE)
+		KS_SLOT(ks, s->Newer)->Older = s->Older;
+	else
+		ks->Newest = s->Older;
+	if (s->Older != KS_NONE)
+		KS_SLOT(ks, s->Older)->Newer = s->Newer;
+	else
+		ks->Oldest = s->Newer;
+	s->Newer = KS_NONE;
+	s->Older = KS_NONE;
+}
+
+// Name: KS_LRU_Push
+// Function: Makes link the most recently used entry
+//---------------------------------------------------------------------------------------------
+static void KS_LRU_Push(aes128_keystore *ks, uint32_t link)
+{
+	aes128_keystore_slot *s = KS_SLOT(ks, link);
+
+	s->Newer = KS_NONE;
+	s->Older = ks->Newest;
+	if (ks->Newest != KS_NONE)
+		KS_SLOT(ks, ks->Newest)->Newer = link;
+	ks->Newest = link;
+	if (ks->Oldest == KS_NONE)
+		ks->Oldest = link;
+}
+
+// Name: KS_Find
+// Function: Returns the link holding KeyId, or KS_NONE. prev gets the chain predecessor for unlinking
+//---------------------------------------------------------------------------------------------
+static uint32_t KS_Find(const aes128_keystore *ks, uint32_t KeyId, uint32_t *prev)
+{
+	uint32_t link, last = KS_NONE;
+
+	for (link = ks->Slots[KS_Bucket(ks, KeyId)].Head; link != KS_NONE; link = ks->Slots[link - 1].Next)
+	{
+		if (ks->Slots[link - 1].KeyId == KeyId)
+			break;
+		last = link;
+	}
+	if (prev)
+		*prev = last;
+	return link;
+}
+
+// Name: KS_Remove
+// Function: Takes link out of its hash chain and the LRU list and wipes it
+//---------------------------------------------------------------------------------------------
+static void KS_Remove(aes128_keystore *ks, uint32_t link)
+{
+	aes128_keystore_slot *s = KS_SLOT(ks, link);
+	uint32_t prev;
+
+	KS_Find(ks, s->KeyId, &prev);
+	if (prev == KS_NONE)
+		ks->Slots[KS_Bucket(ks, s->KeyId)].Head = s->Next;
+	else
+		KS_SLOT(ks, prev)->Next = s->Next;
+	KS_LRU_Unlink(ks, link);
+
+	KS_Wipe(&s->ctx, sizeof(s->ctx));
+	s->KeyId = 0;
+	s->Next = KS_NONE;
+}
+
+// Name: KS_Lookup
+// Function: Hit- refresh the LRU position. Miss- load, expand and insert, evicting the oldest entry if the store is full
+//---------------------------------------------------------------------------------------------
+static aes128_keystore_slot *KS_Lookup(aes128_keystore *ks, uint32_t KeyId)
+{
+	unsigned char Key[MAX_LENGTH];
+	aes128_keystore_slot *s;
+	uint32_t link, bucket;
+
+	link = KS_Find(ks, KeyId, NULL);
+	if (link != KS_NONE)
+	{
+		if (ks->Newest != link)
+		{
+			KS_LRU_Unlink(ks, link);
+			KS_LRU_Push(ks, link);
+		}
+		return KS_SLOT(ks, link);
+	}
+
+	if ((ks->Loader == NULL) || !ks->Loader(KeyId, Key, ks->LoaderArg))
+	{
+		KS_Wipe(Key, sizeof(Key));					// The loader may have written part of a key before failing
+		return NULL;
+	}
+
+	// Pick a slot- never used, then released, then the least recently used
+	if (ks->Used < ks->SlotCount)
+		link = ++ks->Used;
+	else if (ks->FreeList != KS_NONE)
+	{
+		link = ks->FreeList;
+		ks->FreeList = KS_SLOT(ks, link)->Next;
+	}
+	else
+	{
+		link = ks->Oldest;
+		KS_Remove(ks, link);
+	}
+
+	s = KS_SLOT(ks, link);
+	aes128_init(&s->ctx, Key);
+	KS_Wipe(Key, sizeof(Key));
+	s->KeyId = KeyId;
+
+	bucket = KS_Bucket(ks, KeyId);
+	s->Next = ks->Slots[bucket].Head;
+	ks->Slots[bucket].Head = link;
+	KS_LRU_Push(ks, link);
+	return s;
+}
+
+// Name: aes128_keystore_init
+// Function: Prepares an empty store over the caller's slot array
+// Parameters: Store, slot array, number of slots (at least 1), key loader and its argument
+// Returns: 1 on success, 0 if SlotCount is 0
+//--------------------------------------------------------------------------
+int aes128_keystore_init(aes128_keystore *ks, aes128_keystore_slot *Slots, uint32_t SlotCount, tAESKeyLoader Loader, void *LoaderArg)
+{
+	if (SlotCount == 0)
+		return 0;
+	memset(Slots, 0, SlotCount * sizeof(aes128_keystore_slot));
+	ks->Slots = Slots;
+	ks->SlotCount = SlotCount;
+	ks->Used = 0;
+	ks->FreeList = KS_NONE;
+	ks->Newest = KS_NONE;
+	ks->Oldest = KS_NONE;
+	ks->Loader = Loader;
+	ks->LoaderArg = LoaderArg;
+	pthread_mutex_init(&ks->Lock, NULL);
+	return 1;
+}
+
+// Name: aes128_keystore_get
+// Function: Returns the expanded context for KeyId, expanding it on first use
+// Parameters: Store, key id
+// Returns: Context pointer, valid until the next call on this store. NULL if the loader does not know the id
+//--------------------------------------------------------------------------
+const aes128_ctx *aes128_keystore_get(aes128_keystore *ks, uint32_t KeyId)
+{
+	aes128_keystore_slot *s;
+
+	KS_LOCK(ks);
+	s = KS_Lookup(ks, KeyId);
+	KS_UNLOCK(ks);
+	return s ? &s->ctx : NULL;
+}
+
+// Name: aes128_keystore_fetch
+// Function: Copies the expanded context for KeyId out of the store. Safe to call from several threads
+// Parameters: Store, key id, context to fill
+// Returns: 1 on success, 0 if the loader does not know the id
+//--------------------------------------------------------------------------
+int aes128_keystore_fetch(aes128_keystore *ks, uint32_t KeyId, aes128_ctx *ctx)
+{
+	aes128_keystore_slot *s;
+
+	KS_LOCK(ks);
+	s = KS_Lookup(ks, KeyId);
+	if (s)
+		memcpy(ctx, &s->ctx, sizeof(aes128_ctx));
+	KS_UNLOCK(ks);
+	return s != NULL;
+}
+
+// Name: aes128_keystore_evict
+// Function: Drops and wipes KeyId if it is cached, e.g. after a key rotation
+// Parameters: Store, key id
+// Returns: void
+//--------------------------------------------------------------------------
+void aes128_keystore_evict(aes128_keystore *ks, uint32_t KeyId)
+{
+	uint32_t link;
+
+	KS_LOCK(ks);
+	link = KS_Find(ks, KeyId, NULL);
+	if (link != KS_NONE)
+	{
+		KS_Remove(ks, link);
+		KS_SLOT(ks, link)->Next = ks->FreeList;
+		ks->FreeList = link;
+	}
+	KS_UNLOCK(ks);
+}
+
+// Name: aes128_keystore_clear
+// Function: Wipes every cached schedule and empties the store
+// Parameters: Store
+// Returns: void
+//--------------------------------------------------------------------------
+void aes128_keystore_clear(aes128_keystore *ks)
+{
+	KS_LOCK(ks);
+	KS_Wipe(ks->Slots, ks->SlotCount * sizeof(aes128_keystore_slot));
+	ks->Used = 0;
+	ks->FreeList = KS_NONE;
+	ks->Newest = KS_NONE;
+	ks->Oldest = KS_NONE;
+	KS_UNLOCK(ks);
+}
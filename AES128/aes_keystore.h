@@ -0,0 +1,59 @@
+//       
+//               Filename: aes_keystore.h
+//               Description: Cache of expanded AES-128 key contexts indexed by 32-bit key id
+//
+//
+//------------------------------------------------------------------------------------------------------------------------------------
+
+#ifndef AES_KEYSTORE_H_
+#define AES_KEYSTORE_H_
+
+#include "aes.h"
+#include <stdint.h>
+#include <pthread.h>
+
+// Definitions
+//-------------
+#define KS_NONE		0		// Links are slot index + 1, so a zero filled store is a valid empty one
+
+// Supplies the raw 16 byte key for KeyId. Returns 1 if the id exists, 0 if not
+typedef int (*tAESKeyLoader)(uint32_t KeyId, unsigned char *Key, void *Arg);
+
+// One cached key. The slot array is supplied by the caller, which bounds the memory used
+typedef struct
+{
+	aes128_ctx ctx;						// Expanded encryption and decryption schedules
+	uint32_t KeyId;
+	uint32_t Head;						// First slot of the hash chain whose bucket is this slot's index
+	uint32_t Next;						// Next slot in the same hash chain, or in the free list
+	uint32_t Newer;						// LRU neighbours
+	uint32_t Older;
+} aes128_keystore_slot;
+
+typedef struct
+{
+	aes128_keystore_slot *Slots;
+	uint32_t SlotCount;
+	uint32_t Used;						// Slots handed out so far, the rest have never been touched
+	uint32_t FreeList;					// Slots released by aes128_keystore_evict
+	uint32_t Newest;
+	uint32_t Oldest;
+	tAESKeyLoader Loader;
+	void *LoaderArg;
+	pthread_mutex_t Lock;				// Taken by every call- lookups reorder the LRU list
+} aes128_keystore;
+
+
+// Linked under names tagged with the engine flags- see AES128_LINK_NAME in aes.h
+#define aes128_keystore_init	AES128_LINK_NAME(aes128_keystore_init)
+#define aes128_keystore_fetch	AES128_LINK_NAME(aes128_keystore_fetch)
+
+// Function Prototypes
+//---------------------
+int aes128_keystore_init(aes128_keystore *ks, aes128_keystore_slot *Slots, uint32_t SlotCount, tAESKeyLoader Loader, void *LoaderArg);
+const aes128_ctx *aes128_keystore_get(aes128_keystore *ks, uint32_t KeyId);
+int aes128_keystore_fetch(aes128_keystore *ks, uint32_t KeyId, aes128_ctx *ctx);
+void aes128_keystore_evict(aes128_keystore *ks, uint32_t KeyId);
+void aes128_keystore_clear(aes128_keystore *ks);
+
+#endif
@@ -0,0 +1,368 @@
+//
+//          Filename: aes_modes.c
+//          Function: Bulk block cipher modes on top of the aes128_ctx engine
+//
+//          Everything here goes through aes128_encrypt_blocks/aes128_decrypt_blocks, so whichever round engine was picked at
+//          startup (byte, T-table, bitslice or AES-NI) gets several independent blocks per call to pipeline.
+//
+//          Define AES_THREADS (and link with -pthread) to let large CBC decryptions split over worker threads.
+//
+//--------------------------------------------------------------------------------------------------------------------------------------
+
+#include "aes.h"
+#include <string.h>
+#include <stdint.h>
+
+#ifdef AES_THREADS
+#include <pthread.h>
+#include <unistd.h>
+
+#define AES_MAX_THREADS			16
+#define AES_MT_MIN_BLOCKS		4096	// 64K per worker- below this thread start-up costs more than it saves
+#endif
+
+#define AES_PIPELINE_BLOCKS		32		// Blocks handed to the engine per call- the widest bitsliced pass (AVX-512), 4 AES-NI runs
+
+// Name: XOR_Bytes
+// Function: out = in ^ ks over Length bytes, 8 bytes at a time. memcpy keeps unaligned buffers legal and compiles to plain moves
+//---------------------------------------------------------------------------------------------
+static void XOR_Bytes(unsigned char *out, const unsigned char *in, const unsigned char *ks, size_t Length)
+{
+	uint64_t a, b;
+
+	for (; Length >= 8; Length -= 8, in += 8, ks += 8, out += 8)
+	{
+		memcpy(&a, in, 8);
+		memcpy(&b, ks, 8);
+		a ^= b;
+		memcpy(out, &a, 8);
+	}
+	for (; Length > 0; Length--)
+		*out++ = *in++ ^ *ks++;
+}
+
+// Name: Counter_Increment
+// Function: Adds one to a 16 byte big-endian counter block
+//---------------------------------------------------------------------------------------------
+static void Counter_Increment(unsigned char *Counter)
+{
+	unsigned char x = MAX_LENGTH;
+
+	while (x > 0)
+	{
+		x--;
+		if (++Counter[x] != 0)
+			break;
+	}
+}
+
+// Name: aes128_ctr_xcrypt
+// Function: CTR mode encrypt/decrypt (the same operation). 32 counter blocks are encrypted per engine call and XORed in
+// Parameters: Key context, 16 byte initial counter block (updated to the next unused counter), input, output, length in bytes
+//             in and out may be the same buffer. Any length is accepted- a partial final block uses the front of its keystream.
+//             To continue a stream in a later call, split it on a 16 byte boundary
+// Returns: void
+//--------------------------------------------------------------------------
+void aes128_ctr_xcrypt(const aes128_ctx *ctx, unsigned char *Counter, const unsigned char *in, unsigned char *out, size_t Length)
+{
+	unsigned char ks[AES_PIPELINE_BLOCKS * MAX_LENGTH];
+	size_t Blocks, chunk;
+	unsigned char x;
+
+	while (Length > 0)
+	{
+		Blocks = (Length + MAX_LENGTH - 1) / MAX_LENGTH;
+		if (Blocks > AES_PIPELINE_BLOCKS)
+			Blocks = AES_PIPELINE_BLOCKS;
+
+		for (x = 0; x < Blocks; x++)
+		{
+			memcpy(&ks[x * MAX_LENGTH], Counter, MAX_LENGTH);
+			Counter_Increment(Counter);
+		}
+		aes128_encrypt_blocks(ctx, ks, Blocks);
+
+		chunk = Blocks * MAX_LENGTH;
+		if (chunk > Length)
+			chunk = Length;
+		XOR_Bytes(out, in, ks, chunk);
+		in += chunk;
+		out += chunk;
+		Length -= chunk;
+	}
+	memset(ks, 0, sizeof(ks));
+}
+
+// Name: aes128_ctr_xcrypt_iov
+// Function: CTR mode in place across a list of segments, as if they were one contiguous buffer- so a header, payload and
+//           trailer held apart need no staging copy. Whole blocks inside a segment take the pipelined path; a block that
+//           straddles a boundary has its keystream carried over into the next segment
+// Parameters: Key context, 16 byte initial counter block (updated to the next unused counter), segments, segment count
+// Returns: void
+//--------------------------------------------------------------------------
+void aes128_ctr_xcrypt_iov(const aes128_ctx *ctx, unsigned char *Counter, const aes128_iovec *Segments, size_t Count)
+{
+	unsigned char ks[MAX_LENGTH];
+	unsigned char *p;
+	size_t Length, take, s;
+	size_t used = MAX_LENGTH;				// Bytes of ks already consumed- none carried over to begin with
+
+	for (s = 0; s < Count; s++)
+	{
+		p = Segments[s].Base;
+		Length = Segments[s].Length;
+
+		// Finish the block left open at the end of the last segment
+		if (used < MAX_LENGTH)
+		{
+			take = MAX_LENGTH - used;
+			if (take > Length)
+				take = Length;
+			XOR_Bytes(p, p, ks + used, take);
+			used += take;
+			p += take;
+			Length -= take;
+		}
+
+		take = Length - (Length % MAX_LENGTH);
+		aes128_ctr_xcrypt(ctx, Counter, p, p, take);
+		p += take;
+		Length -= take;
+
+		// Open a block for the tail- what is left of its keystream goes to the next segment
+		if (Length > 0)
+		{
+			memcpy(ks, Counter, MAX_LENGTH);
+			Counter_Increment(Counter);
+			aes128_encrypt_block(ctx, ks);
+			XOR_Bytes(p, p, ks, Length);
+			used = Length;
+		}
+	}
+	memset(ks, 0, sizeof(ks));
+}
+
+// Name: aes128_ecb_encrypt
+// Function: ECB encrypts Blocks 16 byte blocks
+// Parameters: Key context, input, output (may equal input), block count
+// Returns: void
+//--------------------------------------------------------------------------
+void aes128_ecb_encrypt(const aes128_ctx *ctx, const unsigned char *in, unsigned char *out, size_t Blocks)
+{
+	if (out != in)
+		memmove(out, in, Blocks * MAX_LENGTH);
+	aes128_encrypt_blocks(ctx, out, Blocks);
+}
+
+// Name: aes128_ecb_decrypt
+// Function: ECB decrypts Blocks 16 byte blocks
+// Parameters: Key context, input, output (may equal input), block count
+// Returns: void
+//--------------------------------------------------------------------------
+void aes128_ecb_decrypt(const aes128_ctx *ctx, const unsigned char *in, unsigned char *out, size_t Blocks)
+{
+	if (out != in)
+		memmove(out, in, Blocks * MAX_LENGTH);
+	aes128_decrypt_blocks(ctx, out, Blocks);
+}
+
+// Name: aes128_cbc_encrypt
+// Function: CBC encrypts Blocks 16 byte blocks. Each block depends on the last, so this is inherently one block at a time
+// Parameters: Key context, 16 byte IV (updated to the last ciphertext block for chaining), input, output (may equal input), block count
+// Returns: void
+//--------------------------------------------------------------------------
+void aes128_cbc_encrypt(const aes128_ctx *ctx, unsigned char *IV, const unsigned char *in, unsigned char *out, size_t Blocks)
+{
+	unsigned char block[MAX_LENGTH];
+
+	memcpy(block, IV, MAX_LENGTH);
+	for (; Blocks > 0; Blocks--, in += MAX_LENGTH, out += MAX_LENGTH)
+	{
+		XOR_Bytes(block, block, in, MAX_LENGTH);
+		aes128_encrypt_block(ctx, block);
+		memcpy(out, block, MAX_LENGTH);
+	}
+	memcpy(IV, block, MAX_LENGTH);
+}
+
+// Name: CBC_Decrypt_Serial
+// Function: CBC decrypt on one thread. Blocks do not depend on each other, so 32 go to the engine per call
+//---------------------------------------------------------------------------------------------
+static void CBC_Decrypt_Serial(const aes128_ctx *ctx, unsigned char *IV, const unsigned char *in, unsigned char *out, size_t Blocks)
+{
+	unsigned char ct[AES_PIPELINE_BLOCKS * MAX_LENGTH];
+	unsigned char pt[AES_PIPELINE_BLOCKS * MAX_LENGTH];
+	size_t chunk;
+
+	while (Blocks > 0)
+	{
+		chunk = (Blocks > AES_PIPELINE_BLOCKS) ? AES_PIPELINE_BLOCKS : Blocks;
+
+		// Keep the ciphertext- out may overwrite in
+		memcpy(ct, in, chunk * MAX_LENGTH);
+		memcpy(pt, ct, chunk * MAX_LENGTH);
+		aes128_decrypt_blocks(ctx, pt, chunk);
+
+		XOR_Bytes(out, pt, IV, MAX_LENGTH);
+		XOR_Bytes(out + MAX_LENGTH, pt + MAX_LENGTH, ct, (chunk - 1) * MAX_LENGTH);
+		memcpy(IV, &ct[(chunk - 1) * MAX_LENGTH], MAX_LENGTH);
+
+		in += chunk * MAX_LENGTH;
+		out += chunk * MAX_LENGTH;
+		Blocks -= chunk;
+	}
+	memset(pt, 0, sizeof(pt));
+}
+
+#ifdef AES_THREADS
+typedef struct
+{
+	const aes128_ctx *ctx;
+	unsigned char IV[MAX_LENGTH];
+	const unsigned char *in;
+	unsigned char *out;
+	size_t Blocks;
+} tCBCJob;
+
+// Name: CBC_Decrypt_Worker
+//---------------------------------------------------------------------------------------------
+static void *CBC_Decrypt_Worker(void *arg)
+{
+	tCBCJob *job = (tCBCJob *)arg;
+
+	CBC_Decrypt_Serial(job->ctx, job->IV, job->in, job->out, job->Blocks);
+	return NULL;
+}
+#endif
+
+// Name: aes128_cbc_decrypt
+// Function: CBC decrypts Blocks 16 byte blocks. Blocks are decrypted 32 at a time and, with AES_THREADS, large buffers are
+//           cut into contiguous runs that each worker thread decrypts independently
+// Parameters: Key context, 16 byte IV (updated to the last ciphertext block for chaining), input, output (may equal input), block count
+// Returns: void
+//--------------------------------------------------------------------------
+void aes128_cbc_decrypt(const aes128_ctx *ctx, unsigned char *IV, const unsigned char *in, unsigned char *out, size_t Blocks)
+{
+#ifdef AES_THREADS
+	pthread_t tid[AES_MAX_THREADS];
+	tCBCJob job[AES_MAX_THREADS];
+	unsigned char last[MAX_LENGTH];
+	size_t per, start;
+	long cpus;
+	unsigned int Threads, started, ii;
+
+	cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	Threads = (cpus > 1) ? (unsigned int)cpus : 1;
+	if (Threads > AES_MAX_THREADS)
+		Threads = AES_MAX_THREADS;
+	if (Blocks / AES_MT_MIN_BLOCKS < Threads)
+		Threads = (unsigned int)(Blocks / AES_MT_MIN_BLOCKS);
+
+	if (Threads > 1)
+	{
+		// Every run's IV is the ciphertext block before it- capture them all before anything is overwritten
+		per = Blocks / Threads;
+		for (ii = 0, start = 0; ii < Threads; ii++, start += per)
+		{
+			job[ii].ctx = ctx;
+			memcpy(job[ii].IV, (ii == 0) ? IV : in + (start - 1) * MAX_LENGTH, MAX_LENGTH);
+			job[ii].in = in + start * MAX_LENGTH;
+			job[ii].out = out + start * MAX_LENGTH;
+			job[ii].Blocks = (ii == Threads - 1) ? (Blocks - start) : per;
+		}
+		memcpy(last, in + (Blocks - 1) * MAX_LENGTH, MAX_LENGTH);
+
+		for (started = 1; started < Threads; started++)
+		{
+			if (pthread_create(&tid[started], NULL, CBC_Decrypt_Worker, &job[started]) != 0)
+				break;
+		}
+		CBC_Decrypt_Worker(&job[0]);
+		// Anything that failed to start is done on this thread
+		for (ii = started; ii < Threads; ii++)
+			CBC_Decrypt_Worker(&job[ii]);
+		for (ii = 1; ii < started; ii++)
+			pthread_join(tid[ii], NULL);
+		memcpy(IV, last, MAX_LENGTH);
+		return;
+	}
+#endif
+	CBC_Decrypt_Serial(ctx, IV, in, out, Blocks);
+}
+
+// Name: Batch_Run
+// Function: Multi-buffer scheduler. Up to 8 jobs are live at once, one lane each. Every step takes the next block of every
+//           live job through a single multi-key engine call, and a lane whose job is finished is refilled from the queue
+//---------------------------------------------------------------------------------------------
+static void Batch_Run(const aes128_job *Jobs, size_t Count, unsigned char Decrypt)
+{
+	const aes128_ctx *keys[AES128_MULTI_LANES];
+	const unsigned char *in[AES128_MULTI_LANES];
+	unsigned char *out[AES128_MULTI_LANES];
+	size_t left[AES128_MULTI_LANES];
+	size_t next = 0;
+	unsigned int live = 0, x;
+
+	for (;;)
+	{
+		// Refill lanes from the queue, skipping empty jobs
+		while ((live < AES128_MULTI_LANES) && (next < Count))
+		{
+			if (Jobs[next].Blocks > 0)
+			{
+				keys[live] = Jobs[next].ctx;
+				in[live] = Jobs[next].in;
+				out[live] = Jobs[next].out;
+				left[live] = Jobs[next].Blocks;
+				live++;
+			}
+			next++;
+		}
+		if (live == 0)
+			break;
+
+		if (Decrypt)
+			aes128_decrypt_multi(keys, in, out, live);
+		else
+			aes128_encrypt_multi(keys, in, out, live);
+
+		// Advance every lane, moving the last live lane into any that just finished
+		for (x = 0; x < live; )
+		{
+			if (--left[x] == 0)
+			{
+				live--;
+				keys[x] = keys[live];
+				in[x] = in[live];
+				out[x] = out[live];
+				left[x] = left[live];
+			}
+			else
+			{
+				in[x] += MAX_LENGTH;
+				out[x] += MAX_LENGTH;
+				x++;
+			}
+		}
+	}
+}
+
+// Name: aes128_encrypt_batch
+// Function: ECB encrypts many small independent records, each under its own key, 8 records interleaved at a time
+// Parameters: Array of jobs, job count
+// Returns: void
+//--------------------------------------------------------------------------
+void aes128_encrypt_batch(const aes128_job *Jobs, size_t Count)
+{
+	Batch_Run(Jobs, Count, 0);
+}
+
+// Name: aes128_decrypt_batch
+// Function: ECB decrypts many small independent records, each under its own key, 8 records interleaved at a time
+// Parameters: Array of jobs, job count
+// Returns: void
+//--------------------------------------------------------------------------
+void aes128_decrypt_batch(const aes128_job *Jobs, size_t Count)
+{
+	Batch_Run(Jobs, Count, 1);
+}
@@ -0,0 +1,276 @@
+//
+//          Filename: aes_ni.c
+//          Function: AES-128 round engine using the x86 AES-NI instructions
+//
+//          Only built when AES_NI is defined. The functions carry their own target attributes, so the rest of the library does
+//          not need to be compiled with -maes and still runs on CPUs without AES-NI- aes.c only selects this engine when
+//          CPUID says the instructions are present.
+//
+//          Bulk calls keep 8 blocks in flight so the AESENC/AESDEC latency is hidden behind independent work.
+//
+//--------------------------------------------------------------------------------------------------------------------------------------
+
+#include "aes.h"
+#include "aes_backend.h"
+
+#ifdef AES_NI
+
+#include <cpuid.h>
+#include <string.h>
+#include <emmintrin.h>
+#include <wmmintrin.h>
+
+#define AESNI_TARGET	__attribute__((target("sse2,aes")))
+#define AESNI_LANES		8
+
+// Name: AESNI_Supported
+// Function: CPUID leaf 1- ECX bit 25 is AES-NI, EDX bit 26 is SSE2
+//---------------------------------------------------------------------------------------------
+int AESNI_Supported(void)
+{
+	unsigned int eax, ebx, ecx, edx;
+
+	if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+		return 0;
+	return ((ecx & (1u << 25)) != 0) && ((edx & (1u << 26)) != 0);
+}
+
+// Name: AESNI_Key_Step
+// Function: One step of the key schedule, fed by the AESKEYGENASSIST result
+//---------------------------------------------------------------------------------------------
+AESNI_TARGET static __m128i AESNI_Key_Step(__m128i key, __m128i assist)
+{
+	assist = _mm_shuffle_epi32(assist, 0xff);
+	key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+	key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+	key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+	return _mm_xor_si128(key, assist);
+}
+
+// Name: AESNI_Init
+// Function: Expands the key with AESKEYGENASSIST and derives the AESDEC schedule with AESIMC
+//---------------------------------------------------------------------------------------------
+AESNI_TARGET static void AESNI_Init(aes128_ctx *ctx, const unsigned char *Key)
+{
+	__m128i rk[AES128_ROUNDS + 1];
+	unsigned char turn;
+
+	rk[0]  = _mm_loadu_si128((const __m128i *)Key);
+	rk[1]  = AESNI_Key_Step(rk[0], _mm_aeskeygenassist_si128(rk[0], 0x01));
+	rk[2]  = AESNI_Key_Step(rk[1], _mm_aeskeygenassist_si128(rk[1], 0x02));
+	rk[3]  = AESNI_Key_Step(rk[2], _mm_aeskeygenassist_si128(rk[2], 0x04));
+	rk[4]  = AESNI_Key_Step(rk[3], _mm_aeskeygenassist_si128(rk[3], 0x08));
+	rk[5]  = AESNI_Key_Step(rk[4], _mm_aeskeygenassist_si128(rk[4], 0x10));
+	rk[6]  = AESNI_Key_Step(rk[5], _mm_aeskeygenassist_si128(rk[5], 0x20));
+	rk[7]  = AESNI_Key_Step(rk[6], _mm_aeskeygenassist_si128(rk[6], 0x40));
+	rk[8]  = AESNI_Key_Step(rk[7], _mm_aeskeygenassist_si128(rk[7], 0x80));
+	rk[9]  = AESNI_Key_Step(rk[8], _mm_aeskeygenassist_si128(rk[8], 0x1b));
+	rk[10] = AESNI_Key_Step(rk[9], _mm_aeskeygenassist_si128(rk[9], 0x36));
+
+	for (turn = 0; turn <= AES128_ROUNDS; turn++)
+		_mm_storeu_si128((__m128i *)&ctx->KeyGen[turn * MAX_LENGTH], rk[turn]);
+
+	// Equivalent inverse cipher: reversed order, InvMixColumns on the inner round keys
+	_mm_storeu_si128((__m128i *)&ctx->DecKeyGen[0], rk[AES128_ROUNDS]);
+	for (turn = 1; turn < AES128_ROUNDS; turn++)
+		_mm_storeu_si128((__m128i *)&ctx->DecKeyGen[turn * MAX_LENGTH], _mm_aesimc_si128(rk[AES128_ROUNDS - turn]));
+	_mm_storeu_si128((__m128i *)&ctx->DecKeyGen[AES128_ROUNDS * MAX_LENGTH], rk[0]);
+}
+
+// Name: AESNI_Encrypt
+// Function: Encrypts a single 16 byte block in place
+//---------------------------------------------------------------------------------------------
+AESNI_TARGET static void AESNI_Encrypt(const aes128_ctx *ctx, unsigned char *Plain_Data)
+{
+	const __m128i *rk = (const __m128i *)ctx->KeyGen;
+	__m128i b;
+	unsigned char turn;
+
+	b = _mm_xor_si128(_mm_loadu_si128((const __m128i *)Plain_Data), _mm_loadu_si128(&rk[0]));
+	for (turn = 1; turn < AES128_ROUNDS; turn++)
+		b = _mm_aesenc_si128(b, _mm_loadu_si128(&rk[turn]));
+	b = _mm_aesenclast_si128(b, _mm_loadu_si128(&rk[AES128_ROUNDS]));
+	_mm_storeu_si128((__m128i *)Plain_Data, b);
+}
+
+// Name: AESNI_Decrypt
+// Function: Decrypts a single 16 byte block in place
+//---------------------------------------------------------------------------------------------
+AESNI_TARGET static void AESNI_Decrypt(const aes128_ctx *ctx, unsigned char *Plain_Data)
+{
+	const __m128i *rk = (const __m128i *)ctx->DecKeyGen;
+	__m128i b;
+	unsigned char turn;
+
+	b = _mm_xor_si128(_mm_loadu_si128((const __m128i *)Plain_Data), _mm_loadu_si128(&rk[0]));
+	for (turn = 1; turn < AES128_ROUNDS; turn++)
+		b = _mm_aesdec_si128(b, _mm_loadu_si128(&rk[turn]));
+	b = _mm_aesdeclast_si128(b, _mm_loadu_si128(&rk[AES128_ROUNDS]));
+	_mm_storeu_si128((__m128i *)Plain_Data, b);
+}
+
+// Name: AESNI_Encrypt_Blocks
+// Function: Encrypts Blocks consecutive 16 byte blocks in place, 8 interleaved through the rounds at a time
+//---------------------------------------------------------------------------------------------
+AESNI_TARGET static void AESNI_Encrypt_Blocks(const aes128_ctx *ctx, unsigned char *Data, size_t Blocks)
+{
+	const __m128i *rk = (const __m128i *)ctx->KeyGen;
+	__m128i b[AESNI_LANES], k;
+	unsigned char turn, x;
+
+	while (Blocks >= AESNI_LANES)
+	{
+		k = _mm_loadu_si128(&rk[0]);
+		#pragma GCC unroll 8
+		for (x = 0; x < AESNI_LANES; x++)
+			b[x] = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(Data + x * MAX_LENGTH)), k);
+		for (turn = 1; turn < AES128_ROUNDS; turn++)
+		{
+			k = _mm_loadu_si128(&rk[turn]);
+			#pragma GCC unroll 8
+			for (x = 0; x < AESNI_LANES; x++)
+				b[x] = _mm_aesenc_si128(b[x], k);
+		}
+		k = _mm_loadu_si128(&rk[AES128_ROUNDS]);
+		#pragma GCC unroll 8
+		for (x = 0; x < AESNI_LANES; x++)
+			_mm_storeu_si128((__m128i *)(Data + x * MAX_LENGTH), _mm_aesenclast_si128(b[x], k));
+
+		Data += AESNI_LANES * MAX_LENGTH;
+		Blocks -= AESNI_LANES;
+	}
+	for (; Blocks > 0; Blocks--, Data += MAX_LENGTH)
+		AESNI_Encrypt(ctx, Data);
+}
+
+// Name: AESNI_Decrypt_Blocks
+// Function: Decrypts Blocks consecutive 16 byte blocks in place, 8 interleaved through the rounds at a time
+//---------------------------------------------------------------------------------------------
+AESNI_TARGET static void AESNI_Decrypt_Blocks(const aes128_ctx *ctx, unsigned char *Data, size_t Blocks)
+{
+	const __m128i *rk = (const __m128i *)ctx->DecKeyGen;
+	__m128i b[AESNI_LANES], k;
+	unsigned char turn, x;
+
+	while (Blocks >= AESNI_LANES)
+	{
+		k = _mm_loadu_si128(&rk[0]);
+		#pragma GCC unroll 8
+		for (x = 0; x < AESNI_LANES; x++)
+			b[x] = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(Data + x * MAX_LENGTH)), k);
+		for (turn = 1; turn < AES128_ROUNDS; turn++)
+		{
+			k = _mm_loadu_si128(&rk[turn]);
+			#pragma GCC unroll 8
+			for (x = 0; x < AESNI_LANES; x++)
+				b[x] = _mm_aesdec_si128(b[x], k);
+		}
+		k = _mm_loadu_si128(&rk[AES128_ROUNDS]);
+		#pragma GCC unroll 8
+		for (x = 0; x < AESNI_LANES; x++)
+			_mm_storeu_si128((__m128i *)(Data + x * MAX_LENGTH), _mm_aesdeclast_si128(b[x], k));
+
+		Data += AESNI_LANES * MAX_LENGTH;
+		Blocks -= AESNI_LANES;
+	}
+	for (; Blocks > 0; Blocks--, Data += MAX_LENGTH)
+		AESNI_Decrypt(ctx, Data);
+}
+
+// Name: AESNI_Encrypt_Lanes
+// Function: Encrypts 8 blocks, block x from in[x] to out[x] under its own schedule ctx[x], interleaved through the rounds
+//---------------------------------------------------------------------------------------------
+AESNI_TARGET static inline __attribute__((always_inline)) void AESNI_Encrypt_Lanes(const aes128_ctx *const *ctx, const unsigned char *const *in, unsigned char *const *out)
+{
+	__m128i b[AES128_MULTI_LANES];
+	unsigned int turn, x;
+
+	#pragma GCC unroll 8
+	for (x = 0; x < AES128_MULTI_LANES; x++)
+		b[x] = _mm_xor_si128(_mm_loadu_si128((const __m128i *)in[x]), _mm_loadu_si128((const __m128i *)ctx[x]->KeyGen));
+	for (turn = 1; turn < AES128_ROUNDS; turn++)
+	{
+		#pragma GCC unroll 8
+		for (x = 0; x < AES128_MULTI_LANES; x++)
+			b[x] = _mm_aesenc_si128(b[x], _mm_loadu_si128((const __m128i *)&ctx[x]->KeyGen[turn * MAX_LENGTH]));
+	}
+	#pragma GCC unroll 8
+	for (x = 0; x < AES128_MULTI_LANES; x++)
+		_mm_storeu_si128((__m128i *)out[x], _mm_aesenclast_si128(b[x], _mm_loadu_si128((const __m128i *)&ctx[x]->KeyGen[AES128_ROUNDS * MAX_LENGTH])));
+}
+
+// Name: AESNI_Encrypt_Multi
+// Function: A full set of lanes runs unrolled with the 8 blocks in registers, a partial set (batch tail) goes block by block
+//---------------------------------------------------------------------------------------------
+AESNI_TARGET static void AESNI_Encrypt_Multi(const aes128_ctx *const *ctx, const unsigned char *const *in, unsigned char *const *out, unsigned int Count)
+{
+	unsigned int x;
+
+	if (Count == AES128_MULTI_LANES)
+	{
+		AESNI_Encrypt_Lanes(ctx, in, out);
+		return;
+	}
+	for (x = 0; x < Count; x++)
+	{
+		if (out[x] != in[x])
+			memcpy(out[x], in[x], MAX_LENGTH);
+		AESNI_Encrypt(ctx[x], out[x]);
+	}
+}
+
+// Name: AESNI_Decrypt_Lanes
+// Function: Decrypts 8 blocks, block x from in[x] to out[x] under its own schedule ctx[x], interleaved through the rounds
+//---------------------------------------------------------------------------------------------
+AESNI_TARGET static inline __attribute__((always_inline)) void AESNI_Decrypt_Lanes(const aes128_ctx *const *ctx, const unsigned char *const *in, unsigned char *const *out)
+{
+	__m128i b[AES128_MULTI_LANES];
+	unsigned int turn, x;
+
+	#pragma GCC unroll 8
+	for (x = 0; x < AES128_MULTI_LANES; x++)
+		b[x] = _mm_xor_si128(_mm_loadu_si128((const __m128i *)in[x]), _mm_loadu_si128((const __m128i *)ctx[x]->DecKeyGen));
+	for (turn = 1; turn < AES128_ROUNDS; turn++)
+	{
+		#pragma GCC unroll 8
+		for (x = 0; x < AES128_MULTI_LANES; x++)
+			b[x] = _mm_aesdec_si128(b[x], _mm_loadu_si128((const __m128i *)&ctx[x]->DecKeyGen[turn * MAX_LENGTH]));
+	}
+	#pragma GCC unroll 8
+	for (x = 0; x < AES128_MULTI_LANES; x++)
+		_mm_storeu_si128((__m128i *)out[x], _mm_aesdeclast_si128(b[x], _mm_loadu_si128((const __m128i *)&ctx[x]->DecKeyGen[AES128_ROUNDS * MAX_LENGTH])));
+}
+
+// Name: AESNI_Decrypt_Multi
+// Function: A full set of lanes runs unrolled with the 8 blocks in registers, a partial set (batch tail) goes block by block
+//---------------------------------------------------------------------------------------------
+AESNI_TARGET static void AESNI_Decrypt_Multi(const aes128_ctx *const *ctx, const unsigned char *const *in, unsigned char *const *out, unsigned int Count)
+{
+	unsigned int x;
+
+	if (Count == AES128_MULTI_LANES)
+	{
+		AESNI_Decrypt_Lanes(ctx, in, out);
+		return;
+	}
+	for (x = 0; x < Count; x++)
+	{
+		if (out[x] != in[x])
+			memcpy(out[x], in[x], MAX_LENGTH);
+		AESNI_Decrypt(ctx[x], out[x]);
+	}
+}
+
+const tAESBackend AESNI_Backend =
+{
+	"aes-ni",
+	AESNI_Init,
+	AESNI_Encrypt,
+	AESNI_Decrypt,
+	AESNI_Encrypt_Blocks,
+	AESNI_Decrypt_Blocks,
+	AESNI_Encrypt_Multi,
+	AESNI_Decrypt_Multi
+};
+
+#endif
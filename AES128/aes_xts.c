@@ -0,0 +1,326 @@
+//
+//          Filename: aes_xts.c
+//          Function: XTS-AES-128 (IEEE 1619 / NIST SP 800-38E) on top of the aes128_ctx engine
+//
+//          Each data unit (sector) is encrypted under its own tweak: T = E(K2, sector number) and block j uses T.alpha^j in
+//          GF(2^128). Blocks within a sector are independent once their tweaks are known, so 8 at a time go to the engine.
+//          The 8 tweaks are not chained one from the next- each is T.alpha^k worked out directly from the group's base with a
+//          k bit shift and a small carry fold, which leaves them independent for the compiler and the CPU to run side by side.
+//
+//          A sector that is not a multiple of 16 bytes ends with ciphertext stealing, so the ciphertext is exactly as long as
+//          the plaintext. Sectors are independent of each other, and with AES_THREADS defined (link with -pthread) the
+//          *_sectors calls share large images out over worker threads.
+//
+//--------------------------------------------------------------------------------------------------------------------------------------
+
+#include "aes_xts.h"
+#include <string.h>
+
+#ifdef AES_THREADS
+#include <pthread.h>
+#include <unistd.h>
+
+#define XTS_MAX_THREADS			16
+#define XTS_MT_MIN_BYTES		65536	// 64K per worker- below this thread start-up costs more than it saves
+#endif
+
+// Name: XTS_Load64 / XTS_Store64
+// Function: Little-endian 64-bit access- XTS tweaks are little-endian 128-bit numbers. Written out byte by byte so any host
+//           gets it right; compilers turn both into a single move on little-endian CPUs
+//---------------------------------------------------------------------------------------------
+static uint64_t XTS_Load64(const unsigned char *p)
+{
+	return (uint64_t)p[0] | ((uint64_t)p[1] << 8) | ((uint64_t)p[2] << 16) | ((uint64_t)p[3] << 24) |
+		   ((uint64_t)p[4] << 32) | ((uint64_t)p[5] << 40) | ((uint64_t)p[6] << 48) | ((uint64_t)p[7] << 56);
+}
+
+static void XTS_Store64(unsigned char *p, uint64_t v)
+{
+	p[0] = (unsigned char)v;
+	p[1] = (unsigned char)(v >> 8);
+	p[2] = (unsigned char)(v >> 16);
+	p[3] = (unsigned char)(v >> 24);
+	p[4] = (unsigned char)(v >> 32);
+	p[5] = (unsigned char)(v >> 40);
+	p[6] = (unsigned char)(v >> 48);
+	p[7] = (unsigned char)(v >> 56);
+}
+
+// Name: XTS_Tweaks
+// Function: tw gets T.alpha^0 .. T.alpha^8 as low/high halves. Every entry comes straight from T rather than from the one before:
+//           shifted left by k bits, with the k bits that fall off the top folded back in times x^7 + x^2 + x + 1
+// Parameters: Base tweak as low/high halves, 2 * (XTS_TWEAK_LANES + 1) words out
+//---------------------------------------------------------------------------------------------
+static void XTS_Tweaks(const uint64_t *T, uint64_t *tw)
+{
+	uint64_t lo = T[0], hi = T[1], carry;
+	unsigned int k;
+
+	tw[0] = lo;
+	tw[1] = hi;
+#pragma GCC unroll 8
+	for (k = 1; k <= XTS_TWEAK_LANES; k++)
+	{
+		carry = hi >> (64 - k);
+		carry ^= (carry << 1) ^ (carry << 2) ^ (carry << 7);
+		tw[2 * k] = (lo << k) ^ carry;
+		tw[2 * k + 1] = (hi << k) | (lo >> (64 - k));
+	}
+}
+
+// Name: XTS_Whiten
+// Function: out = in ^ tweak for Count blocks
+//---------------------------------------------------------------------------------------------
+static void XTS_Whiten(unsigned char *out, const unsigned char *in, const uint64_t *tw, unsigned int Count)
+{
+	unsigned int j;
+
+	for (j = 0; j < Count; j++)
+	{
+		XTS_Store64(out + j * MAX_LENGTH, XTS_Load64(in + j * MAX_LENGTH) ^ tw[2 * j]);
+		XTS_Store64(out + j * MAX_LENGTH + 8, XTS_Load64(in + j * MAX_LENGTH + 8) ^ tw[2 * j + 1]);
+	}
+}
+
+// Name: XTS_Blocks
+// Function: Encrypts or decrypts Blocks whole blocks, 8 per engine call, each under its own tweak. T is advanced past them
+//---------------------------------------------------------------------------------------------
+static void XTS_Blocks(const aes128_ctx *Key, uint64_t *T, const unsigned char *in, unsigned char *out, size_t Blocks, unsigned char Decrypt)
+{
+	uint64_t tw[2 * (XTS_TWEAK_LANES + 1)];
+	unsigned char buf[XTS_TWEAK_LANES * MAX_LENGTH];
+	unsigned int chunk;
+
+	while (Blocks > 0)
+	{
+		chunk = (Blocks > XTS_TWEAK_LANES) ? XTS_TWEAK_LANES : (unsigned int)Blocks;
+		XTS_Tweaks(T, tw);
+		XTS_Whiten(buf, in, tw, chunk);
+		if (Decrypt)
+			aes128_decrypt_blocks(Key, buf, chunk);
+		else
+			aes128_encrypt_blocks(Key, buf, chunk);
+		XTS_Whiten(out, buf, tw, chunk);
+		T[0] = tw[2 * chunk];
+		T[1] = tw[2 * chunk + 1];
+		in += chunk * MAX_LENGTH;
+		out += chunk * MAX_LENGTH;
+		Blocks -= chunk;
+	}
+	memset(buf, 0, sizeof(buf));
+}
+
+// Name: XTS_Unit
+// Function: One data unit. The whole blocks go through XTS_Blocks; a partial tail steals the end of the last whole block's
+//           output. Decryption takes the last two tweaks in the opposite order
+//---------------------------------------------------------------------------------------------
+static void XTS_Unit(const aes128_xts_ctx *ctx, const unsigned char *Tweak, const unsigned char *in, unsigned char *out, size_t Length, unsigned char Decrypt)
+{
+	unsigned char t[MAX_LENGTH];
+	unsigned char cc[MAX_LENGTH], pp[MAX_LENGTH];
+	uint64_t T[2], tw[2 * (XTS_TWEAK_LANES + 1)];
+	size_t Blocks = Length / MAX_LENGTH;
+	size_t r = Length % MAX_LENGTH;
+
+	memcpy(t, Tweak, MAX_LENGTH);
+	aes128_encrypt_block(&ctx->Tweak, t);
+	T[0] = XTS_Load64(t);
+	T[1] = XTS_Load64(t + 8);
+
+	if (r == 0)
+	{
+		XTS_Blocks(&ctx->Data, T, in, out, Blocks, Decrypt);
+		return;
+	}
+
+	// All but the last whole block, then the stolen pair by hand
+	XTS_Blocks(&ctx->Data, T, in, out, Blocks - 1, Decrypt);
+	in += (Blocks - 1) * MAX_LENGTH;
+	out += (Blocks - 1) * MAX_LENGTH;
+	XTS_Tweaks(T, tw);						// tw = tweaks m-1 and m, then more that are not needed
+
+	// First of the pair: tweak m-1 to encrypt, tweak m to decrypt
+	XTS_Whiten(cc, in, tw + (Decrypt ? 2 : 0), 1);
+	if (Decrypt)
+		aes128_decrypt_block(&ctx->Data, cc);
+	else
+		aes128_encrypt_block(&ctx->Data, cc);
+	XTS_Whiten(cc, cc, tw + (Decrypt ? 2 : 0), 1);
+
+	// The short tail takes the front of it, its own bytes take the front of the second block
+	memcpy(pp, in + MAX_LENGTH, r);
+	memcpy(pp + r, cc + r, MAX_LENGTH - r);
+	memcpy(out + MAX_LENGTH, cc, r);
+
+	XTS_Whiten(pp, pp, tw + (Decrypt ? 0 : 2), 1);
+	if (Decrypt)
+		aes128_decrypt_block(&ctx->Data, pp);
+	else
+		aes128_encrypt_block(&ctx->Data, pp);
+	XTS_Whiten(out, pp, tw + (Decrypt ? 0 : 2), 1);
+
+	memset(cc, 0, sizeof(cc));
+	memset(pp, 0, sizeof(pp));
+}
+
+// Name: aes128_xts_init
+// Function: Expands the data key (K1) and the tweak key (K2). IEEE 1619 requires them to differ- with K1 == K2 the tweak
+//           mask leaks through, so equal keys are refused. The comparison looks at every byte whatever it finds
+// Parameters: Context to fill, 16 byte data key, 16 byte tweak key
+// Returns: 1 on success, 0 if the two keys are equal. The context is left untouched in that case
+//--------------------------------------------------------------------------
+int aes128_xts_init(aes128_xts_ctx *ctx, const unsigned char *DataKey, const unsigned char *TweakKey)
+{
+	unsigned char diff = 0;
+	unsigned int x;
+
+	for (x = 0; x < MAX_LENGTH; x++)
+		diff |= DataKey[x] ^ TweakKey[x];
+	if (diff == 0)
+		return 0;
+
+	aes128_init(&ctx->Data, DataKey);
+	aes128_init(&ctx->Tweak, TweakKey);
+	return 1;
+}
+
+// Name: aes128_xts_encrypt
+// Function: Encrypts one data unit of any length from 16 bytes up. in and out may be the same buffer
+// Parameters: Key context, 16 byte tweak (the data unit number, little-endian), input, output, length in bytes
+// Returns: 1 on success, 0 if the data unit is shorter than one block
+//--------------------------------------------------------------------------
+int aes128_xts_encrypt(const aes128_xts_ctx *ctx, const unsigned char *Tweak, const unsigned char *in, unsigned char *out, size_t Length)
+{
+	if (Length < MAX_LENGTH)
+		return 0;
+	XTS_Unit(ctx, Tweak, in, out, Length, 0);
+	return 1;
+}
+
+// Name: aes128_xts_decrypt
+// Function: Decrypts one data unit, the inverse of aes128_xts_encrypt
+// Returns: 1 on success, 0 if the data unit is shorter than one block
+//--------------------------------------------------------------------------
+int aes128_xts_decrypt(const aes128_xts_ctx *ctx, const unsigned char *Tweak, const unsigned char *in, unsigned char *out, size_t Length)
+{
+	if (Length < MAX_LENGTH)
+		return 0;
+	XTS_Unit(ctx, Tweak, in, out, Length, 1);
+	return 1;
+}
+
+typedef struct
+{
+	const aes128_xts_ctx *ctx;
+	uint64_t FirstSector;
+	size_t SectorLength;
+	const unsigned char *in;
+	unsigned char *out;
+	size_t Sectors;
+	unsigned char Decrypt;
+} tXTSJob;
+
+// Name: XTS_Sectors_Serial
+// Function: Runs consecutive sectors on one thread, sector s under the tweak s as a 128-bit little-endian number
+//---------------------------------------------------------------------------------------------
+static void *XTS_Sectors_Serial(void *arg)
+{
+	tXTSJob *job = (tXTSJob *)arg;
+	unsigned char Tweak[XTS_TWEAK_LENGTH];
+	size_t s;
+
+	memset(Tweak, 0, sizeof(Tweak));
+	for (s = 0; s < job->Sectors; s++)
+	{
+		XTS_Store64(Tweak, job->FirstSector + s);
+		XTS_Unit(job->ctx, Tweak, job->in + s * job->SectorLength, job->out + s * job->SectorLength, job->SectorLength, job->Decrypt);
+	}
+	return NULL;
+}
+
+// Name: XTS_Sectors
+// Function: Shares the sectors out over worker threads in contiguous runs (AES_THREADS), or runs them here
+//---------------------------------------------------------------------------------------------
+static void XTS_Sectors(const aes128_xts_ctx *ctx, uint64_t FirstSector, size_t SectorLength, const unsigned char *in, unsigned char *out, size_t Sectors, unsigned char Decrypt)
+{
+	tXTSJob all;
+#ifdef AES_THREADS
+	pthread_t tid[XTS_MAX_THREADS];
+	tXTSJob job[XTS_MAX_THREADS];
+	size_t per, start;
+	long cpus;
+	unsigned int Threads, started, ii;
+
+	cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	Threads = (cpus > 1) ? (unsigned int)cpus : 1;
+	if (Threads > XTS_MAX_THREADS)
+		Threads = XTS_MAX_THREADS;
+	if ((Sectors * SectorLength) / XTS_MT_MIN_BYTES < Threads)
+		Threads = (unsigned int)((Sectors * SectorLength) / XTS_MT_MIN_BYTES);
+	if (Threads > Sectors)
+		Threads = (unsigned int)Sectors;
+
+	if (Threads > 1)
+	{
+		per = Sectors / Threads;
+		for (ii = 0, start = 0; ii < Threads; ii++, start += per)
+		{
+			job[ii].ctx = ctx;
+			job[ii].FirstSector = FirstSector + start;
+			job[ii].SectorLength = SectorLength;
+			job[ii].in = in + start * SectorLength;
+			job[ii].out = out + start * SectorLength;
+			job[ii].Sectors = (ii == Threads - 1) ? (Sectors - start) : per;
+			job[ii].Decrypt = Decrypt;
+		}
+
+		for (started = 1; started < Threads; started++)
+		{
+			if (pthread_create(&tid[started], NULL, XTS_Sectors_Serial, &job[started]) != 0)
+				break;
+		}
+		XTS_Sectors_Serial(&job[0]);
+		// Anything that failed to start is done on this thread
+		for (ii = started; ii < Threads; ii++)
+			XTS_Sectors_Serial(&job[ii]);
+		for (ii = 1; ii < started; ii++)
+			pthread_join(tid[ii], NULL);
+		return;
+	}
+#endif
+	all.ctx = ctx;
+	all.FirstSector = FirstSector;
+	all.SectorLength = SectorLength;
+	all.in = in;
+	all.out = out;
+	all.Sectors = Sectors;
+	all.Decrypt = Decrypt;
+	XTS_Sectors_Serial(&all);
+}
+
+// Name: aes128_xts_encrypt_sectors
+// Function: Encrypts Sectors consecutive sectors of SectorLength bytes, numbered from FirstSector. With AES_THREADS large images
+//           are split over worker threads
+// Parameters: Key context, number of the first sector, sector size in bytes (16 or more), input, output (may equal input),
+//             sector count
+// Returns: 1 on success, 0 if the sector size is shorter than one block
+//--------------------------------------------------------------------------
+int aes128_xts_encrypt_sectors(const aes128_xts_ctx *ctx, uint64_t FirstSector, size_t SectorLength, const unsigned char *in, unsigned char *out, size_t Sectors)
+{
+	if (SectorLength < MAX_LENGTH)
+		return 0;
+	XTS_Sectors(ctx, FirstSector, SectorLength, in, out, Sectors, 0);
+	return 1;
+}
+
+// Name: aes128_xts_decrypt_sectors
+// Function: Decrypts Sectors consecutive sectors, the inverse of aes128_xts_encrypt_sectors
+// Returns: 1 on success, 0 if the sector size is shorter than one block
+//--------------------------------------------------------------------------
+int aes128_xts_decrypt_sectors(const aes128_xts_ctx *ctx, uint64_t FirstSector, size_t SectorLength, const unsigned char *in, unsigned char *out, size_t Sectors)
+{
+	if (SectorLength < MAX_LENGTH)
+		return 0;
+	XTS_Sectors(ctx, FirstSector, SectorLength, in, out, Sectors, 1);
+	return 1;
+}
@@ -0,0 +1,38 @@
+//
+//               Filename: aes_xts.h
+//               Description: XTS-AES-128 (IEEE 1619 / SP 800-38E) for sector based storage encryption
+//
+//
+//------------------------------------------------------------------------------------------------------------------------------------
+
+#ifndef AES_XTS_H_
+#define AES_XTS_H_
+
+#include "aes.h"
+#include <stdint.h>
+
+// Definitions
+//-------------
+#define XTS_TWEAK_LENGTH		16
+#define XTS_TWEAK_LANES			8		// Tweaks derived side by side, one per block handed to the engine
+
+// XTS context- the data key and the tweak key, each expanded once
+typedef struct
+{
+	aes128_ctx Data;
+	aes128_ctx Tweak;
+} aes128_xts_ctx;
+
+
+// Linked under names tagged with the engine flags- see AES128_LINK_NAME in aes.h
+#define aes128_xts_init	AES128_LINK_NAME(aes128_xts_init)
+
+// Function Prototypes
+//---------------------
+int aes128_xts_init(aes128_xts_ctx *ctx, const unsigned char *DataKey, const unsigned char *TweakKey);
+int aes128_xts_encrypt(const aes128_xts_ctx *ctx, const unsigned char *Tweak, const unsigned char *in, unsigned char *out, size_t Length);
+int aes128_xts_decrypt(const aes128_xts_ctx *ctx, const unsigned char *Tweak, const unsigned char *in, unsigned char *out, size_t Length);
+int aes128_xts_encrypt_sectors(const aes128_xts_ctx *ctx, uint64_t FirstSector, size_t SectorLength, const unsigned char *in, unsigned char *out, size_t Sectors);
+int aes128_xts_decrypt_sectors(const aes128_xts_ctx *ctx, uint64_t FirstSector, size_t SectorLength, const unsigned char *in, unsigned char *out, size_t Sectors);
+
+#endif
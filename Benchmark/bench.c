@@ -0,0 +1,511 @@
+//
+//          Filename: bench.c
+//          Function: Throughput and latency benchmark for every AES and SHA-3 path in the tree
+//
+//          Each case is run until it has taken at least the target time (0.2 s by default, after one untimed warm-up call) and
+//          reported as time per call, MB/s and cycles per byte. Bulk cases are swept over message sizes from 16 B to 64 MB; key
+//          expansion, single blocks and the bare permutation are fixed size and show latency. Every engine compiled in and
+//          supported by the CPU is measured on its own, not only the one the dispatcher picks. With -T the bulk cases are also
+//          run on several threads at once, each on its own 1 MB buffer, and the aggregate throughput is reported.
+//
+//          Cycles come from the time stamp counter on x86 (reference cycles- turbo and power states are not accounted for)
+//          and are reported as null elsewhere.
+//
+//          Usage: bench [-q] [-J] [-t seconds] [-m max bytes] [-T threads] [filter]
+//              -q  quick- sizes up to 1 MB and 0.05 s per case
+//              -J  JSON on stdout instead of the table, for comparing releases
+//              -T  threads for the multi-thread runs (default: online CPUs, 1 disables them)
+//              filter  only cases whose name contains this text
+//
+//          Build with the same flags as the libraries, linking every AES and SHA-3 source, e.g.
+//              cc -O2 -DAES_NI -DAES_BITSLICE -DSHA3_SIMD -pthread -I../AES128 -I"../Keccak (SHA-3)" bench.c ../AES128/*.c "../Keccak (SHA-3)"/*.c
+//
+//--------------------------------------------------------------------------------------------------------------------------------------
+
+#include "aes.h"
+#include "aes_backend.h"
+#include "sha3.h"
+#include "sha3_backend.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_HAVE_TSC
+#endif
+
+#define BENCH_MAX_THREADS		64
+#define BENCH_MT_LENGTH			(1024 * 1024)	// Bytes per thread in the multi-thread runs
+#define BENCH_MAX_LENGTH		(64u * 1024 * 1024)
+
+typedef struct tBenchCase tBenchCase;
+typedef void (*tBenchFn)(const tBenchCase *c, unsigned char *Data, size_t Length);
+
+struct tBenchCase
+{
+	const char *Name;
+	const char *Backend;
+	tBenchFn Run;
+	const void *Arg;		// Engine table or kernel for Run
+	size_t Fixed;			// Non-zero- a latency case of this many bytes, not swept over sizes
+};
+
+typedef struct
+{
+	const tBenchCase *Case;
+	unsigned char *Data;
+	size_t Length;
+	unsigned long Iterations;
+} tBenchThread;
+
+// Options
+static double Bench_Target = 0.2;
+static size_t Bench_Max = BENCH_MAX_LENGTH;
+static unsigned int Bench_Threads = 1;
+static int Bench_JSON = 0;
+static int Bench_First = 1;
+static const char *Bench_Filter = NULL;
+
+// Keeps results live so the compiler cannot drop the work
+static volatile unsigned char Bench_Sink;
+
+//--------------------------------------------------------------------------------------------------------------------------
+// Timing
+//--------------------------------------------------------------------------------------------------------------------------
+
+static double Bench_Now(void)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static unsigned long long Bench_Cycles(void)
+{
+#ifdef BENCH_HAVE_TSC
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+// Cases. Each runs one call's worth of work over Data/Length
+//--------------------------------------------------------------------------------------------------------------------------
+
+static void Run_AES_Init(const tBenchCase *c, unsigned char *Data, size_t Length)
+{
+	const tAESBackend *b = (const tAESBackend *)c->Arg;
+	aes128_ctx ctx;
+
+	(void)Length;
+	b->Init(&ctx, Data);
+	Bench_Sink ^= ctx.KeyGen[AES128_SCHEDULE_LENGTH - 1];
+	Data[0] ^= ctx.KeyGen[AES128_SCHEDULE_LENGTH - 1];
+}
+
+// The key context is expanded once per engine and reused by the block cases. NULL is the dispatching aes128_* API
+static const unsigned char Bench_AES_Key[MAX_LENGTH] = { 0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6, 0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c };
+static aes128_ctx Bench_Key[4];
+static const tAESBackend *Bench_Key_Owner[4];
+static unsigned char Bench_Key_Used[4];
+
+static const aes128_ctx *Bench_Context(const tAESBackend *b)
+{
+	unsigned int x;
+
+	// Filled on the warm-up call, before any benchmark thread exists
+	for (x = 0; (x < 4) && Bench_Key_Used[x]; x++)
+	{
+		if (Bench_Key_Owner[x] == b)
+			return &Bench_Key[x];
+	}
+	if (b != NULL)
+		b->Init(&Bench_Key[x], Bench_AES_Key);
+	else
+		aes128_init(&Bench_Key[x], Bench_AES_Key);
+	Bench_Key_Owner[x] = b;
+	Bench_Key_Used[x] = 1;
+	return &Bench_Key[x];
+}
+
+static void Run_AES_Encrypt(const tBenchCase *c, unsigned char *Data, size_t Length)
+{
+	const tAESBackend *b = (const tAESBackend *)c->Arg;
+	const aes128_ctx *ctx = Bench_Context(b);
+
+	if (Length == MAX_LENGTH)
+		b->Encrypt(ctx, Data);
+	else
+		b->EncryptBlocks(ctx, Data, Length / MAX_LENGTH);
+}
+
+static void Run_AES_Decrypt(const tBenchCase *c, unsigned char *Data, size_t Length)
+{
+	const tAESBackend *b = (const tAESBackend *)c->Arg;
+	const aes128_ctx *ctx = Bench_Context(b);
+
+	if (Length == MAX_LENGTH)
+		b->Decrypt(ctx, Data);
+	else
+		b->DecryptBlocks(ctx, Data, Length / MAX_LENGTH);
+}
+
+// The legacy key-index API, block by block as bootloader code calls it
+static void Run_Cipher_AES(const tBenchCase *c, unsigned char *Data, size_t Length)
+{
+	size_t x;
+
+	(void)c;
+	for (x = 0; x + MAX_LENGTH <= Length; x += MAX_LENGTH)
+		cipher_AES(Data + x, 0);
+}
+
+static void Run_Decipher_AES(const tBenchCase *c, unsigned char *Data, size_t Length)
+{
+	size_t x;
+
+	(void)c;
+	for (x = 0; x + MAX_LENGTH <= Length; x += MAX_LENGTH)
+		decipher_AES(Data + x, 0);
+}
+
+static void Run_AES_CTR(const tBenchCase *c, unsigned char *Data, size_t Length)
+{
+	unsigned char Counter[MAX_LENGTH] = { 0 };
+
+	(void)c;
+	aes128_ctr_xcrypt(Bench_Context(NULL), Counter, Data, Data, Length);
+}
+
+typedef void (*tFIPS202Hash)(const unsigned char *input, unsigned int inputByteLen, unsigned char *output);
+typedef void (*tFIPS202XOF)(const unsigned char *input, unsigned int inputByteLen, unsigned char *output, int outputByteLen);
+
+static void Run_FIPS202_Hash(const tBenchCase *c, unsigned char *Data, size_t Length)
+{
+	unsigned char Digest[64];
+
+	(*(const tFIPS202Hash *)c->Arg)(Data, (unsigned int)Length, Digest);
+	Bench_Sink ^= Digest[0];
+}
+
+static void Run_FIPS202_XOF(const tBenchCase *c, unsigned char *Data, size_t Length)
+{
+	unsigned char Digest[32];
+
+	(*(const tFIPS202XOF *)c->Arg)(Data, (unsigned int)Length, Digest, sizeof(Digest));
+	Bench_Sink ^= Digest[0];
+}
+
+typedef void (*tPermuteRounds)(void *state, unsigned int nr);
+
+static void Run_Permute_Kernel(const tBenchCase *c, unsigned char *Data, size_t Length)
+{
+	(void)Length;
+	(*(const tPermuteRounds *)c->Arg)(Data, 24);
+}
+
+static void Run_Permute(const tBenchCase *c, unsigned char *Data, size_t Length)
+{
+	(void)c;
+	(void)Length;
+	KeccakF1600_StatePermute(Data);
+}
+
+static void Run_Permute_Reference(const tBenchCase *c, unsigned char *Data, size_t Length)
+{
+	(void)c;
+	(void)Length;
+	KeccakF1600_StatePermute_Reference(Data);
+}
+
+// The buffer cut into 64 byte messages (the last may be shorter) through the multi-buffer lanes
+static void Run_SHA3_Batch(const tBenchCase *c, unsigned char *Data, size_t Length)
+{
+	const unsigned char *inputs[64];
+	unsigned char *outputs[64];
+	unsigned char Digests[64][32];
+	size_t lens[64], x, n;
+
+	(void)c;
+	for (x = 0; x < Length; )
+	{
+		for (n = 0; (n < 64) && (x < Length); n++, x += lens[n - 1])
+		{
+			inputs[n] = Data + x;
+			lens[n] = (Length - x < 64) ? (Length - x) : 64;
+			outputs[n] = Digests[n];
+		}
+		sha3_256_batch(inputs, lens, outputs, n);
+	}
+	Bench_Sink ^= Digests[0][0];
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+// Runner
+//--------------------------------------------------------------------------------------------------------------------------
+
+static void *Bench_Thread(void *arg)
+{
+	tBenchThread *t = (tBenchThread *)arg;
+	unsigned long n;
+
+	for (n = 0; n < t->Iterations; n++)
+		t->Case->Run(t->Case, t->Data, t->Length);
+	return NULL;
+}
+
+// Name: Bench_Report
+// Function: Prints one result as a table row or a JSON record
+//--------------------------------------------------------------------------------------------------------------------------
+static void Bench_Report(const tBenchCase *c, unsigned int Threads, size_t Length, unsigned long Iterations, double Seconds, unsigned long long Cycles)
+{
+	double ns = Seconds * 1e9 / Iterations;
+	double mbs = (double)Length * Iterations * Threads / Seconds / 1e6;
+	double cpb = (double)Cycles / ((double)Length * Iterations * Threads);		// Wall clock cycles per byte over all threads
+
+	if (Bench_JSON)
+	{
+		printf("%s\n    {\"name\": \"%s\", \"backend\": \"%s\", \"threads\": %u, \"bytes\": %lu, \"iterations\": %lu, "
+			   "\"ns_per_call\": %.1f, \"mb_per_s\": %.2f, \"cycles_per_byte\": ",
+			   Bench_First ? "" : ",", c->Name, c->Backend, Threads, (unsigned long)Length, Iterations, ns, mbs);
+#ifdef BENCH_HAVE_TSC
+		printf("%.3f}", cpb);
+#else
+		printf("null}");
+#endif
+		Bench_First = 0;
+	}
+	else
+	{
+		printf("%-22s %-10s %3u %10lu %14.1f %11.2f ", c->Name, c->Backend, Threads, (unsigned long)Length, ns, mbs);
+#ifdef BENCH_HAVE_TSC
+		printf("%9.2f\n", cpb);
+#else
+		printf("%9s\n", "-");
+#endif
+	}
+	fflush(stdout);
+}
+
+// Name: Bench_Measure
+// Function: Warms up, sizes the iteration count to the target time from a trial run, then times Threads copies of the case
+//--------------------------------------------------------------------------------------------------------------------------
+static void Bench_Measure(const tBenchCase *c, unsigned char **Buffers, size_t Length, unsigned int Threads)
+{
+	pthread_t tid[BENCH_MAX_THREADS];
+	tBenchThread job[BENCH_MAX_THREADS];
+	unsigned long Iterations = 1;
+	unsigned long long Cycles;
+	double start, elapsed;
+	unsigned int x, started;
+
+	// Warm-up, then double the count until a run is long enough to time reliably
+	c->Run(c, Buffers[0], Length);
+	for (;;)
+	{
+		start = Bench_Now();
+		for (x = 0; x < Iterations; x++)
+			c->Run(c, Buffers[0], Length);
+		elapsed = Bench_Now() - start;
+		if (elapsed >= Bench_Target / 8)
+			break;
+		Iterations *= 2;
+	}
+	Iterations = (unsigned long)(Iterations * (Bench_Target / elapsed)) + 1;
+
+	for (x = 0; x < Threads; x++)
+	{
+		job[x].Case = c;
+		job[x].Data = Buffers[x];
+		job[x].Length = Length;
+		job[x].Iterations = Iterations;
+	}
+	start = Bench_Now();
+	Cycles = Bench_Cycles();
+	for (started = 1; started < Threads; started++)
+	{
+		if (pthread_create(&tid[started], NULL, Bench_Thread, &job[started]) != 0)
+			break;
+	}
+	Bench_Thread(&job[0]);
+	for (x = 1; x < started; x++)
+		pthread_join(tid[x], NULL);
+	Cycles = Bench_Cycles() - Cycles;
+	elapsed = Bench_Now() - start;
+
+	// Threads that failed to start are reported as missing rather than serialised into the timing
+	Bench_Report(c, started, Length, Iterations, elapsed, Cycles);
+}
+
+// Name: Bench_Case
+// Function: Runs one case over every size (or its fixed size), single-threaded and then multi-threaded
+//--------------------------------------------------------------------------------------------------------------------------
+static void Bench_Case(const tBenchCase *c, unsigned char **Buffers)
+{
+	size_t Length;
+
+	if ((Bench_Filter != NULL) && (strstr(c->Name, Bench_Filter) == NULL) && (strstr(c->Backend, Bench_Filter) == NULL))
+		return;
+
+	if (c->Fixed != 0)
+	{
+		Bench_Measure(c, Buffers, c->Fixed, 1);
+		if (Bench_Threads > 1)
+			Bench_Measure(c, Buffers, c->Fixed, Bench_Threads);
+		return;
+	}
+	for (Length = 16; Length <= Bench_Max; Length *= 4)
+		Bench_Measure(c, Buffers, Length, 1);
+	if (Bench_Threads > 1)
+		Bench_Measure(c, Buffers, (Bench_Max < BENCH_MT_LENGTH) ? Bench_Max : BENCH_MT_LENGTH, Bench_Threads);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+// Main
+//--------------------------------------------------------------------------------------------------------------------------
+
+int main(int argc, char **argv)
+{
+	static const tFIPS202Hash SHA3_224 = FIPS202_SHA3_224, SHA3_256 = FIPS202_SHA3_256, SHA3_384 = FIPS202_SHA3_384, SHA3_512 = FIPS202_SHA3_512;
+	static const tFIPS202XOF SHAKE128 = FIPS202_SHAKE128, SHAKE256 = FIPS202_SHAKE256;
+	static const tPermuteRounds Scalar = KeccakP1600_Permute_Scalar;
+#ifdef SHA3_SIMD
+	static const tPermuteRounds AVX2 = KeccakP1600_Permute_AVX2, AVX512 = KeccakP1600_Permute_AVX512;
+#endif
+	const tAESBackend *Engines[3];
+	unsigned char *Buffers[BENCH_MAX_THREADS];
+	unsigned int Engine_Count = 0, x;
+	size_t Size;
+	long cpus;
+	int arg;
+
+	cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	Bench_Threads = (cpus > 1) ? (unsigned int)cpus : 1;
+	for (arg = 1; arg < argc; arg++)
+	{
+		if (strcmp(argv[arg], "-q") == 0)
+		{
+			Bench_Max = 1024 * 1024;
+			Bench_Target = 0.05;
+		}
+		else if (strcmp(argv[arg], "-J") == 0)
+			Bench_JSON = 1;
+		else if ((strcmp(argv[arg], "-t") == 0) && (arg + 1 < argc))
+			Bench_Target = atof(argv[++arg]);
+		else if ((strcmp(argv[arg], "-m") == 0) && (arg + 1 < argc))
+			Bench_Max = (size_t)strtoul(argv[++arg], NULL, 0);
+		else if ((strcmp(argv[arg], "-T") == 0) && (arg + 1 < argc))
+			Bench_Threads = (unsigned int)atoi(argv[++arg]);
+		else if (argv[arg][0] == '-')
+		{
+			fprintf(stderr, "usage: %s [-q] [-J] [-t seconds] [-m max bytes] [-T threads] [filter]\n", argv[0]);
+			return 2;
+		}
+		else
+			Bench_Filter = argv[arg];
+	}
+	if ((Bench_Target <= 0) || (Bench_Max < 16) || (Bench_Max > BENCH_MAX_LENGTH))
+	{
+		fprintf(stderr, "%s: bad -t or -m value\n", argv[0]);
+		return 2;
+	}
+	if (Bench_Threads < 1)
+		Bench_Threads = 1;
+	if (Bench_Threads > BENCH_MAX_THREADS)
+		Bench_Threads = BENCH_MAX_THREADS;
+
+	// Buffer 0 carries the size sweep, the others only the multi-thread runs
+	for (x = 0; x < Bench_Threads; x++)
+	{
+		Size = (x == 0) ? ((Bench_Max > BENCH_MT_LENGTH) ? Bench_Max : BENCH_MT_LENGTH) : BENCH_MT_LENGTH;
+		Buffers[x] = (unsigned char *)malloc(Size);
+		if (Buffers[x] == NULL)
+		{
+			fprintf(stderr, "%s: out of memory\n", argv[0]);
+			return 1;
+		}
+		memset(Buffers[x], 0x5A + x, Size);
+	}
+
+	Engines[Engine_Count++] = &Portable_Backend;
+#ifdef AES_BITSLICE
+	Engines[Engine_Count++] = &Bitslice_Backend;
+#endif
+#ifdef AES_NI
+	if (AESNI_Supported())
+		Engines[Engine_Count++] = &AESNI_Backend;
+#endif
+
+	if (Bench_JSON)
+		printf("{\n  \"aes_backend\": \"%s\", \"sha3_multi_backend\": \"%s\", \"cpus\": %ld, \"tsc\": %s,\n  \"results\": [",
+			   aes128_backend_name(), sha3_multi_backend_name(), cpus,
+#ifdef BENCH_HAVE_TSC
+			   "true"
+#else
+			   "false"
+#endif
+			   );
+	else
+		printf("%-22s %-10s %3s %10s %14s %11s %9s\n", "case", "backend", "thr", "bytes", "ns/call", "MB/s", "cyc/byte");
+
+	for (x = 0; x < Engine_Count; x++)
+	{
+		const tBenchCase Cases[5] =
+		{
+			{ "aes128.key_expand", Engines[x]->Name, Run_AES_Init, Engines[x], MAX_LENGTH },
+			{ "aes128.encrypt_block", Engines[x]->Name, Run_AES_Encrypt, Engines[x], MAX_LENGTH },
+			{ "aes128.decrypt_block", Engines[x]->Name, Run_AES_Decrypt, Engines[x], MAX_LENGTH },
+			{ "aes128.encrypt_blocks", Engines[x]->Name, Run_AES_Encrypt, Engines[x], 0 },
+			{ "aes128.decrypt_blocks", Engines[x]->Name, Run_AES_Decrypt, Engines[x], 0 },
+		};
+		unsigned int y;
+
+		for (y = 0; y < 5; y++)
+			Bench_Case(&Cases[y], Buffers);
+	}
+
+	{
+		const tBenchCase Cases[] =
+		{
+			{ "cipher_AES", aes128_backend_name(), Run_Cipher_AES, NULL, 0 },
+			{ "decipher_AES", aes128_backend_name(), Run_Decipher_AES, NULL, 0 },
+			{ "aes128.ctr", aes128_backend_name(), Run_AES_CTR, NULL, 0 },
+			{ "FIPS202_SHA3_224", "dispatch", Run_FIPS202_Hash, &SHA3_224, 0 },
+			{ "FIPS202_SHA3_256", "dispatch", Run_FIPS202_Hash, &SHA3_256, 0 },
+			{ "FIPS202_SHA3_384", "dispatch", Run_FIPS202_Hash, &SHA3_384, 0 },
+			{ "FIPS202_SHA3_512", "dispatch", Run_FIPS202_Hash, &SHA3_512, 0 },
+			{ "FIPS202_SHAKE128", "dispatch", Run_FIPS202_XOF, &SHAKE128, 0 },
+			{ "FIPS202_SHAKE256", "dispatch", Run_FIPS202_XOF, &SHAKE256, 0 },
+			{ "sha3_256_batch.64B", sha3_multi_backend_name(), Run_SHA3_Batch, NULL, 0 },
+			{ "keccak_f1600", "dispatch", Run_Permute, NULL, 200 },
+			{ "keccak_f1600", "reference", Run_Permute_Reference, NULL, 200 },
+			{ "keccak_f1600", "scalar", Run_Permute_Kernel, &Scalar, 200 },
+		};
+
+		for (x = 0; x < sizeof(Cases) / sizeof(Cases[0]); x++)
+			Bench_Case(&Cases[x], Buffers);
+	}
+#ifdef SHA3_SIMD
+	{
+		const tBenchCase Permute_AVX2 = { "keccak_f1600", "avx2", Run_Permute_Kernel, &AVX2, 200 };
+		const tBenchCase Permute_AVX512 = { "keccak_f1600", "avx512", Run_Permute_Kernel, &AVX512, 200 };
+
+		if (SHA3_AVX2_Supported())
+			Bench_Case(&Permute_AVX2, Buffers);
+		if (SHA3_AVX512_Supported())
+			Bench_Case(&Permute_AVX512, Buffers);
+	}
+#endif
+
+	if (Bench_JSON)
+		printf("\n  ]\n}\n");
+	for (x = 0; x < Bench_Threads; x++)
+		free(Buffers[x]);
+	return (int)(Bench_Sink & 0);
+}
@@ -0,0 +1,784 @@
+//
+//          Filename: crypto_queue.c
+//          Function: Asynchronous crypto job queue- a lock-free ring of posted jobs drained by a pool of worker threads
+//
+//          Posting never blocks: crypto_queue_submit claims a ring cell with one compare-and-swap (a bounded multi-producer,
+//          multi-consumer ring where each cell carries a sequence number saying whose turn it is) and bumps a semaphore.
+//          If the ring is full it says so rather than waiting, and the caller can run the job inline or retry.
+//
+//          Each worker is pinned to a CPU (Linux) and sleeps on the semaphore. When it wakes it takes up to 32 jobs off the
+//          ring at once and runs the small ones of each type as one multi-buffer batch- sha3_256_batch, aes128_cmac_batch or
+//          the 8 lane ECB batch- instead of one call each. Large CTR and ECB jobs are split into 64K shares: the same job is
+//          posted again once per extra share, and every worker that takes it claims shares until none are left. The last
+//          worker to finish completes the job, so jobs can complete out of order.
+//
+//          Build with -pthread alongside aes.c, aes_modes.c, aes_cmac.c, sha3.c and their engines. Needs C11 atomics.
+//          CryptoQueueUT checks the queue's results against the single-call APIs.
+//
+//--------------------------------------------------------------------------------------------------------------------------------------
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE						// pthread_setaffinity_np
+#endif
+
+#include "common.h"
+#include "crypto_queue.h"
+#include <errno.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "debug.h"
+
+// Name: CQ_Post
+// Function: Puts a job on the ring without locking
+// Returns: 1 if posted, 0 if the ring is full
+//---------------------------------------------------------------------------------------------
+static int CQ_Post(crypto_queue *q, crypto_job *Job)
+{
+	crypto_queue_cell *cell;
+	size_t pos, seq;
+	intptr_t dif;
+
+	pos = atomic_load_explicit(&q->Head, memory_order_relaxed);
+	for (;;)
+	{
+		cell = &q->Cells[pos & q->Mask];
+		seq = atomic_load_explicit(&cell->Sequence, memory_order_acquire);
+		dif = (intptr_t)seq - (intptr_t)pos;
+		if (dif == 0)
+		{
+			// The cell is free for this lap- claim the position
+			if (atomic_compare_exchange_weak_explicit(&q->Head, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed))
+				break;
+		}
+		else if (dif < 0)
+			return 0;
+		else
+			pos = atomic_load_explicit(&q->Head, memory_order_relaxed);
+	}
+	cell->Job = Job;
+	atomic_store_explicit(&cell->Sequence, pos + 1, memory_order_release);
+	return 1;
+}
+
+// Name: CQ_Take
+// Function: Takes the oldest job off the ring without locking
+// Returns: The job, NULL if the ring is empty
+//---------------------------------------------------------------------------------------------
+static crypto_job *CQ_Take(crypto_queue *q)
+{
+	crypto_queue_cell *cell;
+	crypto_job *Job;
+	size_t pos, seq;
+	intptr_t dif;
+
+	pos = atomic_load_explicit(&q->Tail, memory_order_relaxed);
+	for (;;)
+	{
+		cell = &q->Cells[pos & q->Mask];
+		seq = atomic_load_explicit(&cell->Sequence, memory_order_acquire);
+		dif = (intptr_t)seq - (intptr_t)(pos + 1);
+		if (dif == 0)
+		{
+			if (atomic_compare_exchange_weak_explicit(&q->Tail, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed))
+				break;
+		}
+		else if (dif < 0)
+			return NULL;
+		else
+			pos = atomic_load_explicit(&q->Tail, memory_order_relaxed);
+	}
+	Job = cell->Job;
+	// Hand the cell to the poster one lap on
+	atomic_store_explicit(&cell->Sequence, pos + q->Mask + 1, memory_order_release);
+	return Job;
+}
+
+// Name: CQ_Counter_Add
+// Function: Adds Blocks to a 16 byte big-endian counter block
+//---------------------------------------------------------------------------------------------
+static void CQ_Counter_Add(unsigned char *Counter, size_t Blocks)
+{
+	unsigned int carry = 0;
+	unsigned char x = MAX_LENGTH;
+
+	while ((x > 0) && ((Blocks != 0) || (carry != 0)))
+	{
+		x--;
+		carry += Counter[x] + (unsigned int)(Blocks & 0xff);
+		Counter[x] = (unsigned char)carry;
+		carry >>= 8;
+		Blocks >>= 8;
+	}
+}
+
+// Name: CQ_Complete
+// Function: Hands a job back to its owner- through the callback, or by marking it done for polling. The job is not touched
+//           after that, since the owner may free it straight away
+//---------------------------------------------------------------------------------------------
+static void CQ_Complete(crypto_job *Job, int Result)
+{
+	tCryptoCallback Callback = Job->Callback;
+	void *Arg = Job->Arg;
+
+	Job->Result = Result;
+	if (Callback != NULL)
+		Callback(Job, Arg);
+	else
+		atomic_store_explicit(&Job->Done, 1, memory_order_release);
+}
+
+// Name: CQ_Check
+// Returns: 1 if the job has what its type needs, 0 if not
+//---------------------------------------------------------------------------------------------
+static int CQ_Check(const crypto_job *Job)
+{
+	switch (Job->Op)
+	{
+	case CQ_AES_CTR:
+		return (Job->Key != NULL) && (Job->Counter != NULL);
+	case CQ_AES_ECB_ENCRYPT:
+	case CQ_AES_ECB_DECRYPT:
+		return (Job->Key != NULL) && ((Job->Length % MAX_LENGTH) == 0);
+	case CQ_SHA3_256:
+		return 1;
+	case CQ_AES_CMAC:
+		return (Job->MacKey != NULL);
+	default:
+		return 0;
+	}
+}
+
+// Name: CQ_Run_One
+// Function: Runs a whole job on this thread
+//---------------------------------------------------------------------------------------------
+static void CQ_Run_One(crypto_job *Job)
+{
+	aes128_cmac_job mac;
+	keccak_ctx hash;
+
+	switch (Job->Op)
+	{
+	case CQ_AES_CTR:
+		aes128_ctr_xcrypt(Job->Key, Job->Counter, Job->in, Job->out, Job->Length);
+		break;
+	case CQ_AES_ECB_ENCRYPT:
+		aes128_ecb_encrypt(Job->Key, Job->in, Job->out, Job->Length / MAX_LENGTH);
+		break;
+	case CQ_AES_ECB_DECRYPT:
+		aes128_ecb_decrypt(Job->Key, Job->in, Job->out, Job->Length / MAX_LENGTH);
+		break;
+	case CQ_SHA3_256:
+		keccak_init(&hash, 1088, 512, 0x06);
+		keccak_update(&hash, Job->in, Job->Length);
+		keccak_final(&hash, Job->out, 32);
+		break;
+	case CQ_AES_CMAC:
+		mac.ctx = Job->MacKey;
+		mac.in = Job->in;
+		mac.Length = Job->Length;
+		mac.Tag = Job->out;
+		aes128_cmac_batch(&mac, 1);
+		break;
+	}
+}
+
+// Name: CQ_Run_Parts
+// Function: Claims shares of a split job and runs them until none are left, then lets go of the job. Whoever lets go last
+//           completes it- by then every share is done and no copy of it is left on the ring
+//---------------------------------------------------------------------------------------------
+static void CQ_Run_Parts(crypto_job *Job)
+{
+	unsigned char ctr[MAX_LENGTH];
+	unsigned int Part;
+	size_t offset, len;
+
+	while ((Part = atomic_fetch_add_explicit(&Job->NextPart, 1, memory_order_relaxed)) < Job->Parts)
+	{
+		offset = (size_t)Part * Job->PartLength;
+		len = Job->Length - offset;
+		if (len > Job->PartLength)
+			len = Job->PartLength;
+
+		if (Job->Op == CQ_AES_CTR)
+		{
+			memcpy(ctr, Job->Base, MAX_LENGTH);
+			CQ_Counter_Add(ctr, offset / MAX_LENGTH);
+			aes128_ctr_xcrypt(Job->Key, ctr, Job->in + offset, Job->out + offset, len);
+		}
+		else if (Job->Op == CQ_AES_ECB_ENCRYPT)
+			aes128_ecb_encrypt(Job->Key, Job->in + offset, Job->out + offset, len / MAX_LENGTH);
+		else
+			aes128_ecb_decrypt(Job->Key, Job->in + offset, Job->out + offset, len / MAX_LENGTH);
+	}
+
+	if (atomic_fetch_sub_explicit(&Job->Holds, 1, memory_order_acq_rel) == 1)
+	{
+		if (Job->Op == CQ_AES_CTR)
+		{
+			memcpy(Job->Counter, Job->Base, MAX_LENGTH);
+			CQ_Counter_Add(Job->Counter, (Job->Length + MAX_LENGTH - 1) / MAX_LENGTH);
+		}
+		CQ_Complete(Job, 1);
+	}
+}
+
+// Name: CQ_Split
+// Function: Cuts a large CTR/ECB job into shares and posts it again once per extra share, waking a worker for each. A copy
+//           that does not fit on the ring just leaves its share to whoever gets there first, this thread included
+//---------------------------------------------------------------------------------------------
+static void CQ_Split(crypto_queue *q, crypto_job *Job)
+{
+	unsigned int Parts, ii;
+	size_t PartLength;
+
+	Parts = q->MaxParts;
+	if (Job->Length / CQ_PART_LENGTH < Parts)
+		Parts = (unsigned int)(Job->Length / CQ_PART_LENGTH);
+	PartLength = (Job->Length + Parts - 1) / Parts;
+	PartLength = (PartLength + MAX_LENGTH - 1) & ~(size_t)(MAX_LENGTH - 1);
+
+	Job->Parts = (unsigned int)((Job->Length + PartLength - 1) / PartLength);
+	Job->PartLength = PartLength;
+	if (Job->Op == CQ_AES_CTR)
+		memcpy(Job->Base, Job->Counter, MAX_LENGTH);
+	atomic_store_explicit(&Job->NextPart, 0, memory_order_relaxed);
+	atomic_store_explicit(&Job->Holds, Job->Parts, memory_order_relaxed);
+
+	for (ii = 1; ii < Job->Parts; ii++)
+	{
+		if (CQ_Post(q, Job))
+			sem_post(&q->Work);
+		else
+			atomic_fetch_sub_explicit(&Job->Holds, 1, memory_order_relaxed);
+	}
+	CQ_Run_Parts(Job);
+}
+
+// Name: CQ_Run
+// Function: Runs a handful of jobs taken off the ring together. Shares of split jobs and large jobs go one at a time; the
+//           small ones are gathered by type and each type goes through its multi-buffer batch call
+//---------------------------------------------------------------------------------------------
+static void CQ_Run(crypto_queue *q, crypto_job **Jobs, unsigned int Count)
+{
+	const unsigned char *hashIn[CQ_COALESCE_MAX];
+	unsigned char *hashOut[CQ_COALESCE_MAX];
+	size_t hashLen[CQ_COALESCE_MAX];
+	aes128_cmac_job mac[CQ_COALESCE_MAX];
+	aes128_job ecb[2][CQ_COALESCE_MAX];
+	crypto_job *batched[CQ_COALESCE_MAX];
+	unsigned int nHash = 0, nMac = 0, nEcb[2] = {0, 0}, nBatched = 0;
+	unsigned int x, d;
+	crypto_job *Job;
+
+	for (x = 0; x < Count; x++)
+	{
+		Job = Jobs[x];
+		if (Job->Parts > 0)
+		{
+			// Another share of a job some worker has split
+			CQ_Run_Parts(Job);
+			continue;
+		}
+		if (!CQ_Check(Job))
+		{
+			CQ_Complete(Job, 0);
+			continue;
+		}
+		if ((Job->Op <= CQ_AES_ECB_DECRYPT) && (Job->Length >= CQ_SPLIT_LENGTH) && (q->MaxParts > 1))
+		{
+			CQ_Split(q, Job);
+			continue;
+		}
+		if ((Job->Length > CQ_SMALL_LENGTH) || (Job->Op == CQ_AES_CTR))
+		{
+			// No multi-key CTR batch- one key stream per job is already pipelined 8 blocks deep
+			CQ_Run_One(Job);
+			CQ_Complete(Job, 1);
+			continue;
+		}
+
+		switch (Job->Op)
+		{
+		case CQ_SHA3_256:
+			hashIn[nHash] = Job->in;
+			hashLen[nHash] = Job->Length;
+			hashOut[nHash] = Job->out;
+			nHash++;
+			break;
+		case CQ_AES_CMAC:
+			mac[nMac].ctx = Job->MacKey;
+			mac[nMac].in = Job->in;
+			mac[nMac].Length = Job->Length;
+			mac[nMac].Tag = Job->out;
+			nMac++;
+			break;
+		default:
+			d = (Job->Op == CQ_AES_ECB_DECRYPT);
+			ecb[d][nEcb[d]].ctx = Job->Key;
+			ecb[d][nEcb[d]].in = Job->in;
+			ecb[d][nEcb[d]].out = Job->out;
+			ecb[d][nEcb[d]].Blocks = Job->Length / MAX_LENGTH;
+			nEcb[d]++;
+			break;
+		}
+		batched[nBatched++] = Job;
+	}
+
+	if (nHash > 0)
+		sha3_256_batch(hashIn, hashLen, hashOut, nHash);
+	if (nMac > 0)
+		aes128_cmac_batch(mac, nMac);
+	if (nEcb[0] > 0)
+		aes128_encrypt_batch(ecb[0], nEcb[0]);
+	if (nEcb[1] > 0)
+		aes128_decrypt_batch(ecb[1], nEcb[1]);
+	for (x = 0; x < nBatched; x++)
+		CQ_Complete(batched[x], 1);
+}
+
+// Name: CQ_Gather
+// Function: Takes up to CQ_COALESCE_MAX jobs off the ring, stopping after the first large one so it is not held up behind
+//           the batch. The semaphore counts of the extra jobs are taken too, so workers are not woken for nothing
+// Returns: Jobs taken, 0 if the ring was empty
+//---------------------------------------------------------------------------------------------
+static unsigned int CQ_Gather(crypto_queue *q, crypto_job **Jobs)
+{
+	unsigned int n = 0;
+	crypto_job *Job;
+
+	while (n < CQ_COALESCE_MAX)
+	{
+		Job = CQ_Take(q);
+		if (Job == NULL)
+			break;
+		Jobs[n++] = Job;
+		if (n > 1)
+			sem_trywait(&q->Work);
+		if (Job->Length > CQ_SMALL_LENGTH)
+			break;
+	}
+	return n;
+}
+
+// Name: CQ_Worker
+// Function: Sleeps until jobs are posted, then drains the ring. Once the queue is stopped it drains it one last time- everything
+//           posted before crypto_queue_shutdown is visible by then- and passes the wake-up on to the next sleeping worker
+//           as it exits, so one post from crypto_queue_shutdown stops them all
+//---------------------------------------------------------------------------------------------
+static void *CQ_Worker(void *arg)
+{
+	crypto_queue *q = (crypto_queue *)arg;
+	crypto_job *Jobs[CQ_COALESCE_MAX];
+	unsigned int n;
+
+	for (;;)
+	{
+		while ((sem_wait(&q->Work) != 0) && (errno == EINTR))
+			;
+		while ((n = CQ_Gather(q, Jobs)) > 0)
+			CQ_Run(q, Jobs, n);
+		if (atomic_load_explicit(&q->Stop, memory_order_acquire))
+		{
+			while ((n = CQ_Gather(q, Jobs)) > 0)
+				CQ_Run(q, Jobs, n);
+			sem_post(&q->Work);
+			return NULL;
+		}
+	}
+}
+
+// Name: CQ_Pin
+// Function: Ties worker ii to one CPU so its keys and tables stay in that core's cache. Best effort, and Linux only
+//---------------------------------------------------------------------------------------------
+static void CQ_Pin(pthread_t Thread, unsigned int ii, long cpus)
+{
+#ifdef __linux__
+	cpu_set_t set;
+
+	CPU_ZERO(&set);
+	CPU_SET(ii % (unsigned int)cpus, &set);
+	pthread_setaffinity_np(Thread, sizeof(set), &set);
+#else
+	(void)Thread;
+	(void)ii;
+	(void)cpus;
+#endif
+}
+
+// Name: crypto_queue_init
+// Function: Sets up the ring and starts the workers
+// Parameters: Queue, ring cells and their count (a power of 2, the most jobs that can be waiting), worker count (0 for one
+//             per online CPU, at most CQ_MAX_WORKERS)
+// Returns: 1 on success, 0 if the cell count is not a power of 2 or no worker could be started
+//--------------------------------------------------------------------------
+int crypto_queue_init(crypto_queue *q, crypto_queue_cell *Cells, size_t CellCount, unsigned int Workers)
+{
+	long cpus;
+	size_t x;
+	unsigned int ii;
+
+	if ((CellCount < 2) || ((CellCount & (CellCount - 1)) != 0))
+		return 0;
+
+	q->Cells = Cells;
+	q->Mask = CellCount - 1;
+	for (x = 0; x < CellCount; x++)
+		atomic_init(&Cells[x].Sequence, x);
+	atomic_init(&q->Head, 0);
+	atomic_init(&q->Tail, 0);
+	atomic_init(&q->Stop, 0);
+	if (sem_init(&q->Work, 0, 0) != 0)
+		return 0;
+
+	cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	if (cpus < 1)
+		cpus = 1;
+	if (Workers == 0)
+		Workers = (unsigned int)cpus;
+	if (Workers > CQ_MAX_WORKERS)
+		Workers = CQ_MAX_WORKERS;
+	q->MaxParts = Workers;
+
+	for (ii = 0; ii < Workers; ii++)
+	{
+		if (pthread_create(&q->Workers[ii], NULL, CQ_Worker, q) != 0)
+			break;
+		CQ_Pin(q->Workers[ii], ii, cpus);
+	}
+	q->WorkerCount = ii;
+	if (ii == 0)
+	{
+		sem_destroy(&q->Work);
+		return 0;
+	}
+	return 1;
+}
+
+// Name: crypto_queue_submit
+// Function: Posts a job. Never blocks- the job is run by a worker and completed through its callback or crypto_job_done
+// Parameters: Queue, job (owned by the queue until it completes)
+// Returns: 1 if posted, 0 if the ring is full- the job is untouched and may be retried or run some other way
+//--------------------------------------------------------------------------
+int crypto_queue_submit(crypto_queue *q, crypto_job *Job)
+{
+	Job->Result = 0;
+	Job->Parts = 0;
+	atomic_store_explicit(&Job->Done, 0, memory_order_relaxed);
+	if (!CQ_Post(q, Job))
+		return 0;
+	sem_post(&q->Work);
+	return 1;
+}
+
+// Name: crypto_queue_shutdown
+// Function: Lets the workers finish every job already posted, then stops them. Nothing may be posted once this is called
+//--------------------------------------------------------------------------
+void crypto_queue_shutdown(crypto_queue *q)
+{
+	unsigned int ii;
+
+	atomic_store_explicit(&q->Stop, 1, memory_order_release);
+	sem_post(&q->Work);
+	for (ii = 0; ii < q->WorkerCount; ii++)
+		pthread_join(q->Workers[ii], NULL);
+	sem_destroy(&q->Work);
+}
+
+// Name: crypto_job_done
+// Function: Polls a job posted without a callback
+// Returns: 1 once it has completed (Result then says whether it ran), 0 while it is still queued or running
+//--------------------------------------------------------------------------
+int crypto_job_done(crypto_job *Job)
+{
+	return atomic_load_explicit(&Job->Done, memory_order_acquire);
+}
+
+// Name: crypto_job_wait
+// Function: Waits for a job posted without a callback, yielding the CPU while it is outstanding
+//--------------------------------------------------------------------------
+void crypto_job_wait(crypto_job *Job)
+{
+	while (!crypto_job_done(Job))
+		sched_yield();
+}
+
+
+// Unit test
+//--------------------------------------------------------------------------
+
+static atomic_int CQ_UT_Gate;					// The parked worker stays in CQ_UT_Hold while this is 1 and the queue runs
+static atomic_int CQ_UT_Held;
+
+// Name: CQ_UT_Hold
+// Function: Callback that keeps the worker which ran its job busy until the gate opens or its queue (Arg) is shut down, so
+//           the ring fills up behind it
+//---------------------------------------------------------------------------------------------
+static void CQ_UT_Hold(crypto_job *Job, void *Arg)
+{
+	crypto_queue *q = (crypto_queue *)Arg;
+
+	(void)Job;
+	atomic_store(&CQ_UT_Held, 1);
+	while (atomic_load(&CQ_UT_Gate) && !atomic_load(&q->Stop))
+		sched_yield();
+}
+
+// Name: CQ_UT_Park
+// Function: Ties up the only worker of a queue with a job whose callback waits on the gate. Returns once the worker holds it,
+//           so jobs posted after this sit on the ring until CQ_UT_Release or crypto_queue_shutdown
+// Returns: 1 if the worker is parked, 0 if the job could not be posted
+//---------------------------------------------------------------------------------------------
+static int CQ_UT_Park(crypto_queue *q, crypto_job *Job, unsigned char *Digest)
+{
+	memset(Job, 0, sizeof(*Job));
+	Job->Op = CQ_SHA3_256;
+	Job->in = Digest;
+	Job->out = Digest;
+	Job->Callback = CQ_UT_Hold;
+	Job->Arg = q;
+	atomic_store(&CQ_UT_Gate, 1);
+	atomic_store(&CQ_UT_Held, 0);
+	if (!crypto_queue_submit(q, Job))
+		return 0;
+	while (!atomic_load(&CQ_UT_Held))
+		sched_yield();
+	return 1;
+}
+
+static void CQ_UT_Release(void)
+{
+	atomic_store(&CQ_UT_Gate, 0);
+}
+
+// Name: CQ_UT_Fill
+// Function: Fills a buffer with a pattern that differs from byte to byte and from Seed to Seed
+//---------------------------------------------------------------------------------------------
+static void CQ_UT_Fill(unsigned char *Buffer, size_t Length, unsigned int Seed)
+{
+	size_t x;
+
+	for (x = 0; x < Length; x++)
+		Buffer[x] = (unsigned char)((x * 31) + (x >> 8) + (Seed * 97));
+}
+
+// Name: CQ_UT_Split
+// Function: A CTR job large enough to be shared out over 4 workers, starting on a counter that carries into the next byte
+//           partway through. Its output and final counter must match one aes128_ctr_xcrypt call
+// Returns: 1 if it matches, 0 if not
+//---------------------------------------------------------------------------------------------
+static int CQ_UT_Split(const aes128_ctx *Key)
+{
+	const size_t Length = CQ_SPLIT_LENGTH + (3 * MAX_LENGTH) + 5;			// Uneven shares and a partial last block
+	crypto_queue_cell cells[16];
+	crypto_queue q;
+	crypto_job job;
+	unsigned char counter[MAX_LENGTH], refCounter[MAX_LENGTH];
+	unsigned char *in, *out, *ref;
+	int pass = 0;
+
+	in = malloc(Length);
+	out = malloc(Length);
+	ref = malloc(Length);
+	if ((in == NULL) || (out == NULL) || (ref == NULL) || !crypto_queue_init(&q, cells, 16, 4))
+	{
+		free(in);
+		free(out);
+		free(ref);
+		return 0;
+	}
+
+	CQ_UT_Fill(in, Length, 1);
+	memset(counter, 0xA5, MAX_LENGTH);
+	counter[13] = 0xff;
+	counter[14] = 0xf0;
+	counter[15] = 0x00;
+	memcpy(refCounter, counter, MAX_LENGTH);
+	aes128_ctr_xcrypt(Key, refCounter, in, ref, Length);
+
+	memset(&job, 0, sizeof(job));
+	job.Op = CQ_AES_CTR;
+	job.Key = Key;
+	job.Counter = counter;
+	job.in = in;
+	job.out = out;
+	job.Length = Length;
+	if (crypto_queue_submit(&q, &job))
+	{
+		crypto_job_wait(&job);
+		pass = (job.Result == 1) && (job.Parts > 1) && (memcmp(out, ref, Length) == 0) &&
+			   (memcmp(counter, refCounter, MAX_LENGTH) == 0);
+	}
+	crypto_queue_shutdown(&q);
+
+	free(in);
+	free(out);
+	free(ref);
+	return pass;
+}
+
+// Name: CQ_UT_Coalesce
+// Function: Small SHA3, CMAC and ECB jobs of assorted lengths, held on the ring behind a parked worker so that it takes them
+//           all at once and runs each type as one batch. Every result must match the single-call API
+// Returns: 1 if they all match, 0 if not
+//---------------------------------------------------------------------------------------------
+static int CQ_UT_Coalesce(const aes128_ctx *Key, const unsigned char *RawKey)
+{
+	static const size_t HashLengths[7] = {0, 1, 135, 136, 137, 500, CQ_SMALL_LENGTH};
+	static const size_t MacLengths[5] = {0, 15, 16, 17, 1000};
+	static const size_t EcbBlocks[4] = {1, 7, 8, 33};
+	static unsigned char in[CQ_SMALL_LENGTH];
+	static unsigned char ecbOut[2][4][33 * MAX_LENGTH];
+	unsigned char digest[7][32], tag[5][MAX_LENGTH], ref[33 * MAX_LENGTH];
+	unsigned char parkDigest[32];
+	crypto_queue_cell cells[32];
+	crypto_queue q;
+	crypto_job park, hash[7], mac[5], ecb[2][4];
+	aes128_cmac_ctx macKey;
+	unsigned int x, d;
+	int pass = 1;
+
+	if (!crypto_queue_init(&q, cells, 32, 1))
+		return 0;
+	CQ_UT_Fill(in, sizeof(in), 2);
+	aes128_cmac_init(&macKey, RawKey);
+
+	if (!CQ_UT_Park(&q, &park, parkDigest))
+	{
+		crypto_queue_shutdown(&q);
+		return 0;
+	}
+	for (x = 0; x < 7; x++)
+	{
+		memset(&hash[x], 0, sizeof(hash[x]));
+		hash[x].Op = CQ_SHA3_256;
+		hash[x].in = in;
+		hash[x].out = digest[x];
+		hash[x].Length = HashLengths[x];
+		pass &= crypto_queue_submit(&q, &hash[x]);
+	}
+	for (x = 0; x < 5; x++)
+	{
+		memset(&mac[x], 0, sizeof(mac[x]));
+		mac[x].Op = CQ_AES_CMAC;
+		mac[x].MacKey = &macKey;
+		mac[x].in = in + x;
+		mac[x].out = tag[x];
+		mac[x].Length = MacLengths[x];
+		pass &= crypto_queue_submit(&q, &mac[x]);
+	}
+	for (d = 0; d < 2; d++)
+		for (x = 0; x < 4; x++)
+		{
+			memset(&ecb[d][x], 0, sizeof(ecb[d][x]));
+			ecb[d][x].Op = d ? CQ_AES_ECB_DECRYPT : CQ_AES_ECB_ENCRYPT;
+			ecb[d][x].Key = Key;
+			ecb[d][x].in = in + (x * MAX_LENGTH);
+			ecb[d][x].out = ecbOut[d][x];
+			ecb[d][x].Length = EcbBlocks[x] * MAX_LENGTH;
+			pass &= crypto_queue_submit(&q, &ecb[d][x]);
+		}
+	CQ_UT_Release();
+
+	for (x = 0; x < 7; x++)
+	{
+		crypto_job_wait(&hash[x]);
+		FIPS202_SHA3_256(in, (unsigned int)HashLengths[x], ref);
+		pass &= (hash[x].Result == 1) && (memcmp(digest[x], ref, 32) == 0);
+	}
+	for (x = 0; x < 5; x++)
+	{
+		crypto_job_wait(&mac[x]);
+		aes128_cmac(RawKey, in + x, MacLengths[x], ref);
+		pass &= (mac[x].Result == 1) && (memcmp(tag[x], ref, MAX_LENGTH) == 0);
+	}
+	for (d = 0; d < 2; d++)
+		for (x = 0; x < 4; x++)
+		{
+			crypto_job_wait(&ecb[d][x]);
+			if (d)
+				aes128_ecb_decrypt(Key, in + (x * MAX_LENGTH), ref, EcbBlocks[x]);
+			else
+				aes128_ecb_encrypt(Key, in + (x * MAX_LENGTH), ref, EcbBlocks[x]);
+			pass &= (ecb[d][x].Result == 1) && (memcmp(ecbOut[d][x], ref, EcbBlocks[x] * MAX_LENGTH) == 0);
+		}
+	crypto_queue_shutdown(&q);
+	return pass;
+}
+
+// Name: CQ_UT_Full
+// Function: Fills a 4 cell ring behind a parked worker- a fifth submit must be turned away and leave the job untouched. Shutdown
+//           is what lets the worker go, so the 4 jobs are still on the ring when the queue stops and must all complete
+// Returns: 1 if it behaves, 0 if not
+//---------------------------------------------------------------------------------------------
+static int CQ_UT_Full(const aes128_ctx *Key)
+{
+	unsigned char in[100], out[5][100], ref[100];
+	unsigned char counter[5][MAX_LENGTH], refCounter[MAX_LENGTH];
+	unsigned char parkDigest[32];
+	crypto_queue_cell cells[4];
+	crypto_queue q;
+	crypto_job park, job[5];
+	unsigned int x;
+	int pass = 1;
+
+	if (!crypto_queue_init(&q, cells, 4, 1))
+		return 0;
+	CQ_UT_Fill(in, sizeof(in), 3);
+	if (!CQ_UT_Park(&q, &park, parkDigest))
+	{
+		crypto_queue_shutdown(&q);
+		return 0;
+	}
+
+	for (x = 0; x < 5; x++)
+	{
+		memset(&job[x], 0, sizeof(job[x]));
+		memset(counter[x], (int)x, MAX_LENGTH);
+		job[x].Op = CQ_AES_CTR;
+		job[x].Key = Key;
+		job[x].Counter = counter[x];
+		job[x].in = in;
+		job[x].out = out[x];
+		job[x].Length = sizeof(in);
+	}
+	for (x = 0; x < 4; x++)
+		pass &= crypto_queue_submit(&q, &job[x]);
+	memset(out[4], 0, sizeof(in));
+	pass &= (crypto_queue_submit(&q, &job[4]) == 0);
+
+	crypto_queue_shutdown(&q);
+	CQ_UT_Release();
+
+	for (x = 0; x < 4; x++)
+	{
+		memset(refCounter, (int)x, MAX_LENGTH);
+		aes128_ctr_xcrypt(Key, refCounter, in, ref, sizeof(in));
+		pass &= crypto_job_done(&job[x]) && (job[x].Result == 1) && (memcmp(out[x], ref, sizeof(in)) == 0) &&
+				(memcmp(counter[x], refCounter, MAX_LENGTH) == 0);
+	}
+	memset(ref, 0, sizeof(in));
+	pass &= (memcmp(out[4], ref, sizeof(in)) == 0) && (counter[4][0] == 4);
+	return pass;
+}
+
+// Name: CryptoQueueUT
+// Function: Runs jobs of every type through the queue and checks them against the single-call APIs
+//--------------------------------------------------------------------------
+void CryptoQueueUT(void){
+		static const unsigned char RawKey[MAX_LENGTH] = {0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6,
+														 0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c};
+		aes128_ctx Key;
+		unsigned char pass = TRUE;
+
+		Debug("Entering Crypto Queue Unit Test...", TRUE);
+		aes128_init(&Key, RawKey);
+
+		pass &= CQ_UT_Split(&Key);
+		pass &= CQ_UT_Coalesce(&Key, RawKey);
+		pass &= CQ_UT_Full(&Key);
+
+		Debug(pass ? "Crypto queue tests passed!" : "Crypto queue tests FAILED!", TRUE);
+}
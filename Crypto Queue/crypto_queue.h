@@ -0,0 +1,97 @@
+//
+//               Filename: crypto_queue.h
+//               Description: Asynchronous job queue for the AES-128 and SHA-3 libraries- callers post jobs to a lock-free ring
+//                            and a pool of worker threads runs them, batching small ones and splitting large ones
+//
+//
+//------------------------------------------------------------------------------------------------------------------------------------
+
+#ifndef CRYPTO_QUEUE_H_
+#define CRYPTO_QUEUE_H_
+
+#include "aes.h"
+#include "aes_cmac.h"
+#include "sha3.h"
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+
+// Definitions
+//-------------
+#define CQ_MAX_WORKERS			16
+#define CQ_COALESCE_MAX			32				// Jobs a worker takes off the ring in one go to batch together
+#define CQ_SMALL_LENGTH			4096			// Jobs up to this size are batched with others of the same type
+#define CQ_SPLIT_LENGTH			(256 * 1024)	// CTR/ECB jobs from this size up are shared out over the workers
+#define CQ_PART_LENGTH			(64 * 1024)		// Smallest share of a split job. Multiple of 16
+
+// Job types
+#define CQ_AES_CTR				0				// out = in ^ keystream from Key and Counter (Counter is updated)
+#define CQ_AES_ECB_ENCRYPT		1				// Length a multiple of 16
+#define CQ_AES_ECB_DECRYPT		2
+#define CQ_SHA3_256				3				// out gets the 32 byte digest of in
+#define CQ_AES_CMAC				4				// out gets the 16 byte tag of in under MacKey
+
+typedef struct crypto_job crypto_job;
+
+// Runs on a worker thread when a job completes. The job belongs to the caller again from the moment this is called
+typedef void (*tCryptoCallback)(crypto_job *Job, void *Arg);
+
+// One job. The caller fills in the first block of fields and keeps the job, its key and its buffers alive until it completes
+struct crypto_job
+{
+	unsigned char Op;							// CQ_*
+	const aes128_ctx *Key;						// CTR and ECB
+	const aes128_cmac_ctx *MacKey;				// CMAC
+	unsigned char *Counter;						// CTR- 16 byte counter block, set to the next unused counter on completion
+	const unsigned char *in;
+	unsigned char *out;							// Output data (may equal in), or the digest/tag
+	size_t Length;								// Input bytes
+	tCryptoCallback Callback;					// NULL to poll with crypto_job_done instead
+	void *Arg;
+
+	// Private to the queue
+	int Result;									// 1 on success, 0 if the job was malformed
+	atomic_int Done;
+	atomic_uint Holds;							// Workers still working on a split job
+	atomic_uint NextPart;
+	unsigned int Parts;
+	size_t PartLength;
+	unsigned char Base[MAX_LENGTH];				// CTR counter the parts of a split job count on from
+};
+
+// One ring entry
+typedef struct
+{
+	atomic_size_t Sequence;
+	crypto_job *Job;
+} crypto_queue_cell;
+
+// The queue. The ring array is supplied by the caller, which bounds the memory used
+typedef struct
+{
+	crypto_queue_cell *Cells;
+	size_t Mask;								// Cell count - 1, the count being a power of 2
+	atomic_size_t Head;							// Next position to post to
+	unsigned char Pad[64];						// Keeps posting and taking on separate cache lines
+	atomic_size_t Tail;							// Next position to take from
+	sem_t Work;									// One count per posted job, so idle workers sleep
+	atomic_int Stop;
+	unsigned int MaxParts;						// Most shares a large job is split into- the worker count asked for
+	pthread_t Workers[CQ_MAX_WORKERS];
+	unsigned int WorkerCount;					// Workers actually started
+} crypto_queue;
+
+
+// Function Prototypes
+//---------------------
+int crypto_queue_init(crypto_queue *q, crypto_queue_cell *Cells, size_t CellCount, unsigned int Workers);
+int crypto_queue_submit(crypto_queue *q, crypto_job *Job);
+void crypto_queue_shutdown(crypto_queue *q);
+int crypto_job_done(crypto_job *Job);
+void crypto_job_wait(crypto_job *Job);
+
+// Unit test Prototypes
+//----------------------
+void CryptoQueueUT(void);
+
+#endif
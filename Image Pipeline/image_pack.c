@@ -0,0 +1,92 @@
+//
+//          Filename: image_pack.c
+//          Function: Command line front end for image_pipeline.c- encrypts a firmware image and prints its SHA3-256 digest
+//
+//          Usage: image_pack [-c] [-a] <key hex32> <counter hex32> <input> <output>
+//              -c  digest the encrypted image rather than the plain one
+//              -a  append the 32 byte digest to the output file as well
+//
+//          Build alongside aes.c, aes_modes.c, sha3.c and their engines, e.g.
+//              cc -O2 -DIMAGE_THREADS -pthread image_pack.c image_pipeline.c aes*.c sha3*.c -o image_pack
+//
+//--------------------------------------------------------------------------------------------------------------------------------------
+
+#include "image_pipeline.h"
+#include <stdio.h>
+#include <string.h>
+
+// Name: Pack_Hex
+// Function: Parses exactly 2*Length hex digits into Length bytes
+// Returns: 1 on success, 0 if the string is the wrong length or not hex
+//--------------------------------------------------------------------------
+static int Pack_Hex(const char *Text, unsigned char *Bytes, size_t Length)
+{
+	unsigned int v;
+	size_t x;
+
+	if (strlen(Text) != 2 * Length)
+		return 0;
+	for (x = 0; x < Length; x++)
+	{
+		if (sscanf(Text + 2 * x, "%2x", &v) != 1)
+			return 0;
+		Bytes[x] = (unsigned char)v;
+	}
+	return 1;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned char Key[MAX_LENGTH], IV[MAX_LENGTH], Digest[IMAGE_DIGEST_LENGTH];
+	unsigned char HashMode = IMAGE_HASH_PLAIN;
+	int Append = 0, arg = 1, ok;
+	FILE *in, *out;
+	size_t x;
+
+	for (; (arg < argc) && (argv[arg][0] == '-'); arg++)
+	{
+		if (strcmp(argv[arg], "-c") == 0)
+			HashMode = IMAGE_HASH_CIPHER;
+		else if (strcmp(argv[arg], "-a") == 0)
+			Append = 1;
+		else
+			break;
+	}
+	if ((argc - arg != 4) || !Pack_Hex(argv[arg], Key, MAX_LENGTH) || !Pack_Hex(argv[arg + 1], IV, MAX_LENGTH))
+	{
+		fprintf(stderr, "usage: %s [-c] [-a] <key hex32> <counter hex32> <input> <output>\n", argv[0]);
+		return 2;
+	}
+
+	in = fopen(argv[arg + 2], "rb");
+	if (in == NULL)
+	{
+		perror(argv[arg + 2]);
+		return 1;
+	}
+	out = fopen(argv[arg + 3], "wb");
+	if (out == NULL)
+	{
+		perror(argv[arg + 3]);
+		fclose(in);
+		return 1;
+	}
+
+	ok = image_encrypt_file(in, out, Key, IV, HashMode, Digest);
+	if (ok && Append)
+		ok = (fwrite(Digest, 1, IMAGE_DIGEST_LENGTH, out) == IMAGE_DIGEST_LENGTH);
+	fclose(in);
+	if (fclose(out) != 0)
+		ok = 0;
+	memset(Key, 0, sizeof(Key));
+
+	if (!ok)
+	{
+		fprintf(stderr, "%s: failed to encrypt %s\n", argv[0], argv[arg + 2]);
+		return 1;
+	}
+	for (x = 0; x < IMAGE_DIGEST_LENGTH; x++)
+		printf("%02x", Digest[x]);
+	printf("\n");
+	return 0;
+}
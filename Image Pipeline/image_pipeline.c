@@ -0,0 +1,168 @@
+//
+//          Filename: image_pipeline.c
+//          Function: Encrypts a firmware image with AES-128-CTR and takes its SHA3-256 digest in a single pass
+//
+//          Every slice of IMAGE_SLICE_LENGTH bytes is hashed and encrypted back to back, so the second operation finds the data
+//          still in cache and the image is only brought in from memory once. image_encrypt_file streams a file through two
+//          IMAGE_CHUNK_LENGTH buffers: with IMAGE_THREADS a worker thread runs the crypto on one buffer while the calling thread
+//          writes out the other and refills it, so disk and crypto overlap. Memory use is the two buffers, whatever the image size.
+//
+//--------------------------------------------------------------------------------------------------------------------------------------
+
+#include "image_pipeline.h"
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef IMAGE_THREADS
+#include <pthread.h>
+#endif
+
+// One buffer's worth of work for the crypto thread
+typedef struct
+{
+	image_ctx *ctx;
+	unsigned char *Data;
+	size_t Length;
+} tImageChunk;
+
+// Name: image_init
+// Function: Sets up the CTR key and initial counter block and starts SHA3-256
+// Parameters: Context, 16 byte key, 16 byte initial counter block, IMAGE_HASH_PLAIN or IMAGE_HASH_CIPHER
+// Returns: void
+//--------------------------------------------------------------------------
+void image_init(image_ctx *ctx, const unsigned char *Key, const unsigned char *IV, unsigned char HashMode)
+{
+	aes128_init(&ctx->Key, Key);
+	memcpy(ctx->Counter, IV, MAX_LENGTH);
+	keccak_init(&ctx->Hash, 1088, 512, 0x06);
+	ctx->HashMode = HashMode;
+}
+
+// Name: image_update
+// Function: Encrypts and hashes the next Length bytes of the image, one cache-sized slice at a time. in and out may be the
+//           same buffer. Every call but the last must be a multiple of 16 bytes so the counter stream carries on
+// Parameters: Context, input, output, length in bytes
+// Returns: void
+//--------------------------------------------------------------------------
+void image_update(image_ctx *ctx, const unsigned char *in, unsigned char *out, size_t Length)
+{
+	size_t slice;
+
+	while (Length > 0)
+	{
+		slice = (Length < IMAGE_SLICE_LENGTH) ? Length : IMAGE_SLICE_LENGTH;
+		if (ctx->HashMode == IMAGE_HASH_CIPHER)
+		{
+			aes128_ctr_xcrypt(&ctx->Key, ctx->Counter, in, out, slice);
+			keccak_update(&ctx->Hash, out, slice);
+		}
+		else
+		{
+			keccak_update(&ctx->Hash, in, slice);
+			aes128_ctr_xcrypt(&ctx->Key, ctx->Counter, in, out, slice);
+		}
+		in += slice;
+		out += slice;
+		Length -= slice;
+	}
+}
+
+// Name: image_final
+// Function: Writes the 32 byte SHA3-256 digest and clears the key material from the context
+//--------------------------------------------------------------------------
+void image_final(image_ctx *ctx, unsigned char *Digest)
+{
+	keccak_final(&ctx->Hash, Digest, IMAGE_DIGEST_LENGTH);
+	memset(ctx, 0, sizeof(image_ctx));
+}
+
+// Name: Image_Read
+// Function: Fills a buffer from the file, retrying short reads so that only the last chunk of the file can be partial
+// Returns: Bytes read, 0 at end of file
+//--------------------------------------------------------------------------
+static size_t Image_Read(FILE *in, unsigned char *Buffer, size_t Length)
+{
+	size_t got = 0, n;
+
+	while (got < Length)
+	{
+		n = fread(Buffer + got, 1, Length - got, in);
+		if (n == 0)
+			break;
+		got += n;
+	}
+	return got;
+}
+
+// Name: Image_Worker
+//--------------------------------------------------------------------------
+static void *Image_Worker(void *arg)
+{
+	tImageChunk *chunk = (tImageChunk *)arg;
+
+	image_update(chunk->ctx, chunk->Data, chunk->Data, chunk->Length);
+	return NULL;
+}
+
+// Name: image_encrypt_file
+// Function: Streams in to out, encrypted, and returns the digest of the image. Chunk i is encrypted and hashed while chunk i-1
+//           is written and chunk i+1 is read
+// Parameters: Input file, output file (both opened in binary mode), 16 byte key, 16 byte initial counter block, hash mode,
+//             32 byte digest out
+// Returns: 1 on success, 0 on a read/write error or if the buffers cannot be allocated
+//--------------------------------------------------------------------------
+int image_encrypt_file(FILE *in, FILE *out, const unsigned char *Key, const unsigned char *IV, unsigned char HashMode, unsigned char *Digest)
+{
+	unsigned char *Buffer[2];
+	size_t Length[2];
+	tImageChunk chunk;
+	image_ctx ctx;
+	int cur = 0, pending = 0, ok = 1;
+#ifdef IMAGE_THREADS
+	pthread_t tid;
+	int threaded;
+#endif
+
+	Buffer[0] = (unsigned char *)malloc(2 * (size_t)IMAGE_CHUNK_LENGTH);
+	if (Buffer[0] == NULL)
+		return 0;
+	Buffer[1] = Buffer[0] + IMAGE_CHUNK_LENGTH;
+
+	image_init(&ctx, Key, IV, HashMode);
+	chunk.ctx = &ctx;
+
+	Length[cur] = Image_Read(in, Buffer[cur], IMAGE_CHUNK_LENGTH);
+	while (Length[cur] > 0)
+	{
+		chunk.Data = Buffer[cur];
+		chunk.Length = Length[cur];
+#ifdef IMAGE_THREADS
+		threaded = (pthread_create(&tid, NULL, Image_Worker, &chunk) == 0);
+		if (!threaded)
+			Image_Worker(&chunk);
+#else
+		Image_Worker(&chunk);
+#endif
+
+		// The other buffer holds the previous chunk, already processed- write it and refill it
+		if (pending && (fwrite(Buffer[1 - cur], 1, Length[1 - cur], out) != Length[1 - cur]))
+			ok = 0;
+		Length[1 - cur] = ok ? Image_Read(in, Buffer[1 - cur], IMAGE_CHUNK_LENGTH) : 0;
+
+#ifdef IMAGE_THREADS
+		if (threaded)
+			pthread_join(tid, NULL);
+#endif
+		pending = 1;
+		cur = 1 - cur;
+	}
+	if (pending && ok && (fwrite(Buffer[1 - cur], 1, Length[1 - cur], out) != Length[1 - cur]))
+		ok = 0;
+	if (ferror(in))
+		ok = 0;
+
+	image_final(&ctx, Digest);
+	memset(Buffer[0], 0, 2 * (size_t)IMAGE_CHUNK_LENGTH);
+	free(Buffer[0]);
+	return ok;
+}
@@ -0,0 +1,44 @@
+//
+//               Filename: image_pipeline.h
+//               Description: Single-pass firmware image packaging- AES-128-CTR encryption and SHA3-256 in one walk over the data
+//
+//
+//------------------------------------------------------------------------------------------------------------------------------------
+
+#ifndef IMAGE_PIPELINE_H_
+#define IMAGE_PIPELINE_H_
+
+#include "aes.h"
+#include "sha3.h"
+#include <stdio.h>
+
+// Definitions
+//-------------
+// Define IMAGE_THREADS (and link with -pthread) to encrypt and hash each chunk on a worker thread while the calling thread
+// writes the previous chunk and reads the next
+//#define IMAGE_THREADS
+#define IMAGE_CHUNK_LENGTH		(1024 * 1024)	// File bytes per pipeline buffer, two buffers in use. Multiple of 16
+#define IMAGE_SLICE_LENGTH		(16 * 1024)		// Bytes hashed and encrypted back to back, small enough to stay in L1/L2
+#define IMAGE_DIGEST_LENGTH		32
+
+#define IMAGE_HASH_PLAIN		0				// Digest over the plain image- what the bootloader sees after decrypting
+#define IMAGE_HASH_CIPHER		1				// Digest over the encrypted image- checkable before decrypting
+
+// Pipeline context- the CTR key and running counter plus the streaming SHA3-256 state
+typedef struct
+{
+	aes128_ctx Key;
+	unsigned char Counter[MAX_LENGTH];
+	keccak_ctx Hash;
+	unsigned char HashMode;
+} image_ctx;
+
+
+// Function Prototypes
+//---------------------
+void image_init(image_ctx *ctx, const unsigned char *Key, const unsigned char *IV, unsigned char HashMode);
+void image_update(image_ctx *ctx, const unsigned char *in, unsigned char *out, size_t Length);
+void image_final(image_ctx *ctx, unsigned char *Digest);
+int image_encrypt_file(FILE *in, FILE *out, const unsigned char *Key, const unsigned char *IV, unsigned char HashMode, unsigned char *Digest);
+
+#endif
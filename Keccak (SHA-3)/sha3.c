@@ -21,21 +21,62 @@
 
 #include "common.h"
 #include "sha3.h"
+#include "sha3_backend.h"
 #include <string.h>
 #include <stdio.h>
 #include "debug.h"
 
-#define BIG_ENDIAN
-
 //--------------------------------------------------------------------------------------------------------------------------
 // Hash functions
 //--------------------------------------------------------------------------------------------------------------------------
 
+// Name: Keccak_Sponge
+// Function: One-shot sponge for the fixed-rate entry points below. Every caller passes a constant rate (bytes, a multiple of
+//           the lane size) and suffix, and the function is forced inline, so each entry point gets its own copy with the rate
+//           folded in: no rate checks or divisions as in keccak_init, and an absorb loop with a fixed trip count the compiler
+//           unrolls. The suffix must have its top bit clear (0x06, 0x1F) so the padding never needs a block of its own
+//--------------------------------------------------------------------------------------------------------------------------
+#if defined(__GNUC__)
+__attribute__((always_inline))
+#endif
+static inline void Keccak_Sponge(unsigned int rate, unsigned char suffix, const unsigned char *input, unsigned long long int inputByteLen,
+                                 unsigned char *output, unsigned long long int outputByteLen)
+{
+    UINT8 state[200];
+    unsigned int chunk;
+    unsigned int i;
+
+    memset(state, 0, sizeof(state));
+    while (inputByteLen >= rate) {
+#pragma GCC unroll 21
+        for(i = 0; i < rate; i += sizeof(tKeccakLane))
+            xor64(state + i, load64(input + i));
+        KeccakP1600_Permute(state, 24);
+        input += rate;
+        inputByteLen -= rate;
+    }
+    for(i = 0; i < inputByteLen; i++)
+        state[i] ^= input[i];
+    state[inputByteLen] ^= suffix;
+    state[rate - 1] ^= 0x80;
+    KeccakP1600_Permute(state, 24);
+
+    for(;;) {
+        chunk = (unsigned int)MIN(outputByteLen, rate);
+        memcpy(output, state, chunk);
+        output += chunk;
+        outputByteLen -= chunk;
+        if (outputByteLen == 0)
+            break;
+        KeccakP1600_Permute(state, 24);
+    }
+}
+
 //  Function to compute SHAKE128 on the input message with any output length.
 //------------------------------------------------------------------------------
 void FIPS202_SHAKE128(const unsigned char *input, unsigned int inputByteLen, unsigned char *output, int outputByteLen)
 {
-    Keccak(1344, 256, input, inputByteLen, 0x1F, output, outputByteLen);
+    Keccak_Sponge(168, 0x1F, input, inputByteLen, output, (unsigned int)outputByteLen);
 }
 
 
@@ -43,7 +84,43 @@ void FIPS202_SHAKE128(const unsigned char *input, unsigned int inputByteLen, uns
 //-------------------------------------------------------------------------------
 void FIPS202_SHAKE256(const unsigned char *input, unsigned int inputByteLen, unsigned char *output, int outputByteLen)
 {
-    Keccak(1088, 512, input, inputByteLen, 0x1F, output, outputByteLen);
+    Keccak_Sponge(136, 0x1F, input, inputByteLen, output, (unsigned int)outputByteLen);
+}
+
+
+// Name: shake128_init
+// Function: Starts SHAKE128 as an XOF- feed it with keccak_update, then read any amount with keccak_squeeze
+//------------------------------------------------------------------------------
+void shake128_init(keccak_ctx *ctx)
+{
+    keccak_init(ctx, 1344, 256, 0x1F);
+}
+
+
+// Name: shake256_init
+// Function: Starts SHAKE256 as an XOF
+//------------------------------------------------------------------------------
+void shake256_init(keccak_ctx *ctx)
+{
+    keccak_init(ctx, 1088, 512, 0x1F);
+}
+
+
+// Name: shake128
+// Function: One-shot SHAKE128 with 64-bit input and output lengths
+//------------------------------------------------------------------------------
+void shake128(const unsigned char *input, unsigned long long int inputByteLen, unsigned char *output, unsigned long long int outputByteLen)
+{
+    Keccak_Sponge(168, 0x1F, input, inputByteLen, output, outputByteLen);
+}
+
+
+// Name: shake256
+// Function: One-shot SHAKE256 with 64-bit input and output lengths
+//------------------------------------------------------------------------------
+void shake256(const unsigned char *input, unsigned long long int inputByteLen, unsigned char *output, unsigned long long int outputByteLen)
+{
+    Keccak_Sponge(136, 0x1F, input, inputByteLen, output, outputByteLen);
 }
 
 
@@ -51,7 +128,7 @@ void FIPS202_SHAKE256(const unsigned char *input, unsigned int inputByteLen, uns
 //-----------------------------------------------------------------------------------------------
 void FIPS202_SHA3_224(const unsigned char *input, unsigned int inputByteLen, unsigned char *output)
 {
-    Keccak(1152, 448, input, inputByteLen, 0x06, output, 28);
+    Keccak_Sponge(144, 0x06, input, inputByteLen, output, 28);
 }
 
 
@@ -59,64 +136,35 @@ void FIPS202_SHA3_224(const unsigned char *input, unsigned int inputByteLen, uns
 //-----------------------------------------------------------------------------------------------
 void FIPS202_SHA3_256(const unsigned char *input, unsigned int inputByteLen, unsigned char *output)
 {
-    Keccak(1088, 512, input, inputByteLen, 0x06, output, 32);
+    Keccak_Sponge(136, 0x06, input, inputByteLen, output, 32);
+}
+
+// Name: sha3_256_iov
+// Function: SHA3-256 of a message held in a list of segments. The output length is fixed to 32 bytes.
+//-----------------------------------------------------------------------------------------------
+void sha3_256_iov(const keccak_iovec *segments, size_t count, unsigned char *output)
+{
+    keccak_ctx ctx;
+
+    keccak_init(&ctx, 1088, 512, 0x06);
+    keccak_update_iov(&ctx, segments, count);
+    keccak_final(&ctx, output, 32);
 }
 
 //  Function to compute SHA3-384 on the input message. The output length is fixed to 48 bytes.
 //
 void FIPS202_SHA3_384(const unsigned char *input, unsigned int inputByteLen, unsigned char *output)
 {
-    Keccak(832, 768, input, inputByteLen, 0x06, output, 48);
+    Keccak_Sponge(104, 0x06, input, inputByteLen, output, 48);
 }
 
 //  Function to compute SHA3-512 on the input message. The output length is fixed to 64 bytes.
 //
 void FIPS202_SHA3_512(const unsigned char *input, unsigned int inputByteLen, unsigned char *output)
 {
-    Keccak(576, 1024, input, inputByteLen, 0x06, output, 64);
+    Keccak_Sponge(72, 0x06, input, inputByteLen, output, 64);
 }
 
-//---------------------------------------------------------------------
-// Assistant functions
-//---------------------------------------------------------------------
-#ifndef LITTLE_ENDIAN
-
-	// load64: load 64-bit value using LE convention
-	// This is a cast-less operation to make the code more portable IMHO
-	static UINT64 load64(const UINT8 *x){
-    	int i;
-    	UINT64 u=0;
-
-    	for(i = 7; i >= 0; --i){
-        	u <<= 8;
-        	u |= x[i];
-    	}
-    	return u;
-	}
-
-	// store64: store 64-bit value using LE convention
-	// This is a cast-less operation to make the code more portable IMHO
-	static void store64(UINT8 *x, UINT64 u){
-    	unsigned int i;
-
-    	for(i = 0; i < 8; ++i){
-        	x[i] = u;
-        	u >>= 8;
-    	}
-	}
-
-	// xor64: xor into 64-bit value using LE convention
-	// Again, a cast-less operation to make sure it does exactly what it is supposed to
-	static void xor64(UINT8 *x, UINT64 u){
-    	unsigned int i;
-
-    	for(i = 0; i < 8; ++i){
-        	x[i] ^= u;
-        	u >>= 8;
-    	}
-	}
-#endif
-
 
 //-------------------------------------------------------------------------------------------------------
 // Macros to implement ROTATELEFT64, readLane, writeLane, XORLane
@@ -126,15 +174,10 @@ void FIPS202_SHA3_512(const unsigned char *input, unsigned int inputByteLen, uns
 #define ROL64(a, offset) ((((UINT64)a) << offset) ^ (((UINT64)a) >> (64-offset)))
 #define i(x, y) ((x)+5*(y))
 
-#ifdef LITTLE_ENDIAN
-    #define readLane(x, y)          (((tKeccakLane*)state)[i(x, y)])
-    #define writeLane(x, y, lane)   (((tKeccakLane*)state)[i(x, y)]) = (lane)
-    #define XORLane(x, y, lane)     (((tKeccakLane*)state)[i(x, y)]) ^= (lane)
-#else
-    #define readLane(x, y)          load64((UINT8*)state+sizeof(tKeccakLane)*i(x, y))
-    #define writeLane(x, y, lane)   store64((UINT8*)state+sizeof(tKeccakLane)*i(x, y), lane)
-    #define XORLane(x, y, lane)     xor64((UINT8*)state+sizeof(tKeccakLane)*i(x, y), lane)
-#endif
+// Lanes are always reached through load64/store64/xor64 (sha3_backend.h)- direct 64-bit accesses on little-endian hosts, byte by byte elsewhere
+#define readLane(x, y)          load64((UINT8*)state+sizeof(tKeccakLane)*i(x, y))
+#define writeLane(x, y, lane)   store64((UINT8*)state+sizeof(tKeccakLane)*i(x, y), lane)
+#define XORLane(x, y, lane)     xor64((UINT8*)state+sizeof(tKeccakLane)*i(x, y), lane)
 
 //-------------------------------------------------------------------------------------------------------
 // Specialized functions
@@ -153,10 +196,11 @@ int LFSR86540(UINT8 *LFSR){
     return result;
 }
 
-// Name: KeccakF1600_StatePermute
-// Function: Perform a state permutation of the Keccak algorithm
+// Name: KeccakF1600_StatePermute_Reference
+// Function: Perform a state permutation of the Keccak algorithm. This is the readable form, kept as the reference the unrolled
+//           KeccakF1600_StatePermute is checked against
 //------------------------------------------------------------------------------------------------------------
-void KeccakF1600_StatePermute(void *state){
+void KeccakF1600_StatePermute_Reference(void *state){
     unsigned int round, x, y, j, t;
     UINT8 LFSRstate = 0x01;
 
@@ -217,59 +261,214 @@ void KeccakF1600_StatePermute(void *state){
     }
 }
 
+// Round constants for ι, the 24 outputs of LFSR86540 placed at bit positions 2^j-1
+//------------------------------------------------------------------------------------------------------------
+const UINT64 KeccakF_RoundConstants[24] =
+{
+    0x0000000000000001ULL, 0x0000000000008082ULL, 0x800000000000808AULL, 0x8000000080008000ULL,
+    0x000000000000808BULL, 0x0000000080000001ULL, 0x8000000080008081ULL, 0x8000000000008009ULL,
+    0x000000000000008AULL, 0x0000000000000088ULL, 0x0000000080008009ULL, 0x000000008000000AULL,
+    0x000000008000808BULL, 0x800000000000008BULL, 0x8000000000008089ULL, 0x8000000000008003ULL,
+    0x8000000000008002ULL, 0x8000000000000080ULL, 0x000000000000800AULL, 0x800000008000000AULL,
+    0x8000000080008081ULL, 0x8000000000008080ULL, 0x0000000080000001ULL, 0x8000000080008008ULL
+};
+
+// Name: KeccakP1600_Permute_Scalar
+// Function: Perform the last nr rounds of the Keccak permutation (nr even- 24 for Keccak-f, 12 for TurboSHAKE). The 25 lanes
+//           are held in locals throughout, every step is unrolled and the round constants come from a table
+//           (KECCAK_PERMUTE_BODY in sha3_backend.h)
+//------------------------------------------------------------------------------------------------------------
+void KeccakP1600_Permute_Scalar(void *state, unsigned int nr){
+    KECCAK_PERMUTE_BODY(nr)
+}
+
+// The kernel KeccakP1600_Permute runs- picked at startup from what the CPU supports
+static void (*KeccakP_Permute)(void *state, unsigned int nr) = KeccakP1600_Permute_Scalar;
+
+#ifdef SHA3_SIMD
+// Name: SHA3_Select_Permute
+// Function: Runs once at startup and switches to the widest single-state kernel the CPU and OS support
+//------------------------------------------------------------------------------------------------------------
+__attribute__((constructor)) static void SHA3_Select_Permute(void){
+    if (SHA3_AVX512_Supported())
+        KeccakP_Permute = KeccakP1600_Permute_AVX512;
+    else if (SHA3_AVX2_Supported())
+        KeccakP_Permute = KeccakP1600_Permute_AVX2;
+}
+#endif
+
+// Name: KeccakP1600_Permute
+// Function: Perform the last nr rounds of the Keccak permutation with the kernel selected at startup- AVX-512, AVX2 or scalar.
+//           The scalar kernel runs rounds in pairs, so nr must be even and 2..24 (12 for K12/TurboSHAKE, 24 for Keccak-f)
+// Returns: 1 on success, 0 with the state untouched if nr is not a supported round count
+//------------------------------------------------------------------------------------------------------------
+int KeccakP1600_Permute(void *state, unsigned int nr){
+    if ((nr == 0) || (nr > 24) || ((nr & 1) != 0))
+        return 0;
+    KeccakP_Permute(state, nr);
+    return 1;
+}
+
+// Name: KeccakF1600_StatePermute
+// Function: Perform a state permutation of the Keccak algorithm, all 24 rounds
+//------------------------------------------------------------------------------------------------------------
+void KeccakF1600_StatePermute(void *state){
+    KeccakP_Permute(state, 24);
+}
+
 //--------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
-// Name: Keccak
-// Function: Core Keccak routine
+// Name: keccak_init
+// Function: Starts a sponge with the given rate and capacity (in bits). delimitedSuffix holds the domain bits followed by the first
+//           padding bit, e.g. 0x06 for SHA3-*, 0x1F for SHAKE*
 //--------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 
-void Keccak(unsigned int rate, unsigned int capacity, const unsigned char *input, unsigned long long int inputByteLen, unsigned char delimitedSuffix, unsigned char *output, unsigned long long int outputByteLen)
+void keccak_init(keccak_ctx *ctx, unsigned int rate, unsigned int capacity, unsigned char delimitedSuffix)
 {
-    UINT8 state[200];
-    unsigned int rateInBytes = rate/8;
-    unsigned int blockSize = 0;
+    // === Initialize the state ===
+    memset(ctx->state, 0, sizeof(ctx->state));
+    ctx->blockSize = 0;
+    ctx->delimitedSuffix = delimitedSuffix;
+    ctx->rateInBytes = rate/8;
+    ctx->rounds = 24;
+    ctx->squeezing = 0;
+
+    if (((rate + capacity) != 1600) || ((rate % 8) != 0) || (rate == 0))
+        ctx->rateInBytes = 0;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+// Name: keccak_update
+// Function: Absorbs the next inputByteLen bytes of the message. May be called any number of times with any chunk size, a partial
+//           block is kept in the state until the next call completes it
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+
+void keccak_update(keccak_ctx *ctx, const unsigned char *input, unsigned long long int inputByteLen)
+{
+    unsigned int rateInBytes = ctx->rateInBytes;
+    unsigned int blockSize = ctx->blockSize;
+    unsigned int chunk;
     unsigned int i;
 
-    if (((rate + capacity) != 1600) || ((rate % 8) != 0))
+    if ((rateInBytes == 0) || ctx->squeezing)
         return;
 
-    // === Initialize the state ===
-    memset(state, 0, sizeof(state));
-
     // === Absorb all the input blocks ===
     while(inputByteLen > 0) {
-        blockSize = MIN(inputByteLen, rateInBytes);
-        for(i=0; i<blockSize; i++)
-            state[i] ^= input[i];
-        input += blockSize;
-        inputByteLen -= blockSize;
+        chunk = MIN(inputByteLen, rateInBytes - blockSize);
+        i = 0;
+        // Whole lanes go in 64 bits at a time once the block position is lane aligned, the input itself may be unaligned
+        if ((blockSize % sizeof(tKeccakLane)) == 0) {
+            for(; (i + sizeof(tKeccakLane)) <= chunk; i += sizeof(tKeccakLane))
+                xor64(ctx->state + blockSize + i, load64(input + i));
+        }
+        for(; i<chunk; i++)
+            ctx->state[blockSize + i] ^= input[i];
+        input += chunk;
+        inputByteLen -= chunk;
+        blockSize += chunk;
 
         if (blockSize == rateInBytes) {
-            KeccakF1600_StatePermute(state);
+            KeccakP1600_Permute(ctx->state, ctx->rounds);
             blockSize = 0;
         }
     }
+    ctx->blockSize = blockSize;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+// Name: keccak_update_iov
+// Function: Absorbs a list of segments as if they were one contiguous message, so a header, payload and trailer held apart need
+//           no staging copy. A block that straddles a segment boundary simply stays open in the state until the next segment
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+
+void keccak_update_iov(keccak_ctx *ctx, const keccak_iovec *segments, size_t count)
+{
+    size_t s;
+
+    for(s = 0; s < count; s++)
+        keccak_update(ctx, segments[s].Base, segments[s].Length);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+// Name: Keccak_Pad
+// Function: Pads the message and switches the sponge to the squeezing phase, with none of the first output block read yet
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+
+static void Keccak_Pad(keccak_ctx *ctx)
+{
+    unsigned int rateInBytes = ctx->rateInBytes;
+    unsigned int blockSize = ctx->blockSize;
+    unsigned char delimitedSuffix = ctx->delimitedSuffix;
 
-    // === Do the padding and switch to the squeezing phase ===
     // Absorb the last few bits and add the first bit of padding (which coincides with the delimiter in delimitedSuffix)
-    state[blockSize] ^= delimitedSuffix;
+    ctx->state[blockSize] ^= delimitedSuffix;
     // If the first bit of padding is at position rate-1, we need a whole new block for the second bit of padding
     if (((delimitedSuffix & 0x80) != 0) && (blockSize == (rateInBytes-1)))
-        KeccakF1600_StatePermute(state);
+        KeccakP1600_Permute(ctx->state, ctx->rounds);
     // Add the second bit of padding
-    state[rateInBytes-1] ^= 0x80;
+    ctx->state[rateInBytes-1] ^= 0x80;
     // Switch to the squeezing phase
-    KeccakF1600_StatePermute(state);
+    KeccakP1600_Permute(ctx->state, ctx->rounds);
+    ctx->blockSize = 0;
+    ctx->squeezing = 1;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+// Name: keccak_squeeze
+// Function: Reads the next outputByteLen bytes of output. The first call pads the message; after that it may be called any number
+//           of times with any chunk size and the output runs on exactly as if it had been read in one go. Each pass copies as
+//           much of the current block as is wanted, and the permutation for the next block is only run when it is needed
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+
+void keccak_squeeze(keccak_ctx *ctx, unsigned char *output, unsigned long long int outputByteLen)
+{
+    unsigned int rateInBytes = ctx->rateInBytes;
+    unsigned int blockSize;
+    unsigned int chunk;
 
-    // === Squeeze out all the output blocks ===
+    if (rateInBytes == 0)
+        return;
+    if (!ctx->squeezing)
+        Keccak_Pad(ctx);
+
+    blockSize = ctx->blockSize;
     while(outputByteLen > 0) {
-        blockSize = MIN(outputByteLen, rateInBytes);
-        memcpy(output, state, blockSize);
-        output += blockSize;
-        outputByteLen -= blockSize;
+        if (blockSize == rateInBytes) {
+            KeccakP1600_Permute(ctx->state, ctx->rounds);
+            blockSize = 0;
+        }
 
-        if (outputByteLen > 0)
-            KeccakF1600_StatePermute(state);
+        chunk = MIN(outputByteLen, rateInBytes - blockSize);
+        memcpy(output, ctx->state + blockSize, chunk);
+        output += chunk;
+        outputByteLen -= chunk;
+        blockSize += chunk;
     }
+    ctx->blockSize = blockSize;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+// Name: keccak_final
+// Function: Pads the message and squeezes outputByteLen bytes. For an XOF, keccak_squeeze can carry on reading after it
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+
+void keccak_final(keccak_ctx *ctx, unsigned char *output, unsigned long long int outputByteLen)
+{
+    keccak_squeeze(ctx, output, outputByteLen);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+// Name: Keccak
+// Function: Core Keccak routine, one-shot form of keccak_init/keccak_update/keccak_final
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+
+void Keccak(unsigned int rate, unsigned int capacity, const unsigned char *input, unsigned long long int inputByteLen, unsigned char delimitedSuffix, unsigned char *output, unsigned long long int outputByteLen)
+{
+    keccak_ctx ctx;
+
+    keccak_init(&ctx, rate, capacity, delimitedSuffix);
+    keccak_update(&ctx, input, inputByteLen);
+    keccak_final(&ctx, output, outputByteLen);
 }
 
 
@@ -296,4 +495,280 @@ void SHA3UT(void){
 		Debug("SHA3 Digest computed!", TRUE);
 		DebugHex(output, 32, TRUE);
 
+		// Streaming- the same message fed in 1 byte chunks must give the same digest
+		{
+			keccak_ctx ctx;
+			BYTE streamed[32];
+			unsigned int i;
+
+			keccak_init(&ctx, 1088, 512, 0x06);
+			for (i = 0; i < 3; i++)
+				keccak_update(&ctx, &input[i], 1);
+			keccak_final(&ctx, streamed, 32);
+			if (memcmp(streamed, output, 32) == 0)
+				Debug("SHA3 streaming digest matches", TRUE);
+			else
+				Debug("SHA3 streaming digest MISMATCH", TRUE);
+		}
+
+		// Scatter/gather- segments that end on, stop short of and run across the 136 byte rate, with empty ones in among
+		// them, must hash as the joined message does. So must no segments at all, or only empty ones
+		{
+			static const size_t layouts[3][10] = {
+				{ 0, 100, 0, 36, 1, 135, 0, 200, 29, 0 },
+				{ 137, 0, 0, 272, 0, 92, 0, 0, 0, 0 },
+				{ 501, 0, 0, 0, 0, 0, 0, 0, 0, 0 }
+			};
+			BYTE message[501], joined[32], gathered[32];
+			keccak_iovec segments[10];
+			size_t offset;
+			unsigned int i, j, good = 1;
+
+			for (i = 0; i < sizeof(message); i++)
+				message[i] = (BYTE)(i * 7 + 3);
+			FIPS202_SHA3_256(message, sizeof(message), joined);
+			for (i = 0; i < 3; i++)
+			{
+				offset = 0;
+				for (j = 0; j < 10; j++)
+				{
+					segments[j].Base = message + offset;
+					segments[j].Length = layouts[i][j];
+					offset += layouts[i][j];
+				}
+				sha3_256_iov(segments, 10, gathered);
+				good &= (memcmp(gathered, joined, 32) == 0);
+			}
+
+			FIPS202_SHA3_256(message, 0, joined);
+			sha3_256_iov(segments, 0, gathered);
+			good &= (memcmp(gathered, joined, 32) == 0);
+			for (j = 0; j < 10; j++)
+				segments[j].Length = 0;
+			sha3_256_iov(segments, 10, gathered);
+			good &= (memcmp(gathered, joined, 32) == 0);
+
+			if (good)
+				Debug("SHA3 scatter/gather digest matches", TRUE);
+			else
+				Debug("SHA3 scatter/gather digest MISMATCH", TRUE);
+		}
+
+		// XOF- SHAKE128 read in uneven pieces must give the same stream as one long read
+		{
+			keccak_ctx ctx;
+			BYTE whole[400], pieces[400];
+			unsigned int done, n;
+
+			shake128(input, 3, whole, sizeof(whole));
+			shake128_init(&ctx);
+			keccak_update(&ctx, input, 3);
+			for (done = 0, n = 1; done < sizeof(pieces); done += n, n = n * 2 + 5)
+				keccak_squeeze(&ctx, pieces + done, MIN(n, sizeof(pieces) - done));
+			if (memcmp(whole, pieces, sizeof(whole)) == 0)
+				Debug("SHAKE incremental squeeze matches", TRUE);
+			else
+				Debug("SHAKE incremental squeeze MISMATCH", TRUE);
+		}
+
+		// Fixed-rate one-shot sponges against keccak_ctx, at message lengths either side of every rate and, for SHAKE, output
+		// longer than one block
+		{
+			static const struct {
+				void (*Hash)(const unsigned char *input, unsigned int inputByteLen, unsigned char *output);
+				unsigned int rate, digestLen;
+			} fixed[4] = { { FIPS202_SHA3_224, 144, 28 }, { FIPS202_SHA3_256, 136, 32 }, { FIPS202_SHA3_384, 104, 48 }, { FIPS202_SHA3_512, 72, 64 } };
+			static BYTE message[400];
+			BYTE oneshot[400], streamed[400];
+			keccak_ctx ctx;
+			unsigned int i, len, good = 1;
+
+			for (i = 0; i < sizeof(message); i++)
+				message[i] = (BYTE)(i * 29 + 7);
+			for (i = 0; i < 4; i++)
+			{
+				for (len = fixed[i].rate - 1; len <= 2 * fixed[i].rate + 1; len += fixed[i].rate / 2 + 1)
+				{
+					fixed[i].Hash(message, len, oneshot);
+					keccak_init(&ctx, fixed[i].rate * 8, 1600 - fixed[i].rate * 8, 0x06);
+					keccak_update(&ctx, message, len);
+					keccak_final(&ctx, streamed, fixed[i].digestLen);
+					good &= (memcmp(oneshot, streamed, fixed[i].digestLen) == 0);
+				}
+			}
+			for (len = 135; len <= 337; len += 101)
+			{
+				shake128(message, len, oneshot, sizeof(oneshot));
+				shake128_init(&ctx);
+				keccak_update(&ctx, message, len);
+				keccak_squeeze(&ctx, streamed, sizeof(streamed));
+				good &= (memcmp(oneshot, streamed, sizeof(oneshot)) == 0);
+				FIPS202_SHAKE256(message, len, oneshot, sizeof(oneshot));
+				shake256_init(&ctx);
+				keccak_update(&ctx, message, len);
+				keccak_squeeze(&ctx, streamed, sizeof(streamed));
+				good &= (memcmp(oneshot, streamed, sizeof(oneshot)) == 0);
+			}
+			if (good)
+				Debug("SHA3 fixed-rate sponges match", TRUE);
+			else
+				Debug("SHA3 fixed-rate sponges MISMATCH", TRUE);
+		}
+
+		// Differential- the unrolled permutation must match the readable reference
+		{
+			UINT8 fast[200], reference[200];
+			unsigned int i;
+
+			for (i = 0; i < 200; i++)
+				fast[i] = reference[i] = (UINT8)(i * 37 + 11);
+			for (i = 0; i < 4; i++)
+			{
+				KeccakF1600_StatePermute(fast);
+				KeccakF1600_StatePermute_Reference(reference);
+			}
+			if (memcmp(fast, reference, 200) == 0)
+				Debug("Keccak-f permutation matches reference", TRUE);
+			else
+				Debug("Keccak-f permutation MISMATCH", TRUE);
+		}
+
+		// Multi-buffer- 4 messages of different lengths must hash as they do one at a time
+		{
+			static const unsigned char message[200] = "The quick brown fox jumps over the lazy dog";
+			const unsigned char *inputs[4];
+			unsigned char *outputs[4];
+			size_t lens[4] = { 0, 3, 136, 200 };
+			BYTE digests[4][32], single[32];
+			unsigned int i, good = 1;
+
+			for (i = 0; i < 4; i++)
+			{
+				inputs[i] = message;
+				outputs[i] = digests[i];
+			}
+			sha3_256_x4(inputs, lens, outputs);
+			for (i = 0; i < 4; i++)
+			{
+				FIPS202_SHA3_256(message, (unsigned int)lens[i], single);
+				good &= (memcmp(single, digests[i], 32) == 0);
+			}
+			Debug(sha3_multi_backend_name(), TRUE);
+			if (good)
+				Debug("SHA3 multi-buffer digests match", TRUE);
+			else
+				Debug("SHA3 multi-buffer digests MISMATCH", TRUE);
+		}
+
+		// KangarooTwelve- RFC 9861 vector for the empty message and customisation
+		{
+			static const BYTE expected[32] = {
+				0x1A, 0xC2, 0xD4, 0x50, 0xFC, 0x3B, 0x42, 0x05, 0xD1, 0x9D, 0xA7, 0xBF, 0xCA, 0x1B, 0x37, 0x51,
+				0x3C, 0x08, 0x03, 0x57, 0x7A, 0xC7, 0x16, 0x7F, 0x06, 0xFE, 0x2C, 0xE1, 0xF0, 0xEF, 0x39, 0xE5 };
+			BYTE k12[32];
+
+			kangarootwelve(NULL, 0, NULL, 0, k12, 32);
+			if (memcmp(k12, expected, 32) == 0)
+				Debug("KangarooTwelve digest matches", TRUE);
+			else
+				Debug("KangarooTwelve digest MISMATCH", TRUE);
+		}
+
+		// KangarooTwelve and TurboSHAKE128- RFC 9861 vectors on the ptn(n) pattern (byte i is i mod 251). ptn(17^4) is long
+		// enough for the tree with a partial last leaf; ptn(41^3) as customisation after 7 bytes of FF runs the custom string
+		// itself across leaves
+		{
+			static BYTE pattern[83521];
+			static const BYTE expected_17_4[32] = {
+				0x87, 0x01, 0x04, 0x5E, 0x22, 0x20, 0x53, 0x45, 0xFF, 0x4D, 0xDA, 0x05, 0x55, 0x5C, 0xBB, 0x5C,
+				0x3A, 0xF1, 0xA7, 0x71, 0xC2, 0xB8, 0x9B, 0xAE, 0xF3, 0x7D, 0xB4, 0x3D, 0x99, 0x98, 0xB9, 0xFE };
+			static const BYTE expected_41_3[32] = {
+				0x75, 0xD2, 0xF8, 0x6A, 0x2E, 0x64, 0x45, 0x66, 0x72, 0x6B, 0x4F, 0xBC, 0xFC, 0x56, 0x57, 0xB9,
+				0xDB, 0xCF, 0x07, 0x0C, 0x7B, 0x0D, 0xCA, 0x06, 0x45, 0x0A, 0xB2, 0x91, 0xD7, 0x44, 0x3B, 0xCF };
+			static const BYTE expected_turbo[32] = {
+				0x9C, 0x97, 0xD0, 0x36, 0xA3, 0xBA, 0xC8, 0x19, 0xDB, 0x70, 0xED, 0xE0, 0xCA, 0x55, 0x4E, 0xC6,
+				0xE4, 0xC2, 0xA1, 0xA4, 0xFF, 0xBF, 0xD9, 0xEC, 0x26, 0x9C, 0xA6, 0xA1, 0x11, 0x16, 0x12, 0x33 };
+			static const BYTE ones[7] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+			BYTE digest[32];
+			unsigned int i;
+
+			for (i = 0; i < sizeof(pattern); i++)
+				pattern[i] = (BYTE)(i % 251);
+
+			kangarootwelve(pattern, sizeof(pattern), NULL, 0, digest, 32);
+			if (memcmp(digest, expected_17_4, 32) == 0)
+				Debug("KangarooTwelve ptn(17^4) digest matches", TRUE);
+			else
+				Debug("KangarooTwelve ptn(17^4) digest MISMATCH", TRUE);
+
+			kangarootwelve(ones, sizeof(ones), pattern, 68921, digest, 32);
+			if (memcmp(digest, expected_41_3, 32) == 0)
+				Debug("KangarooTwelve customised digest matches", TRUE);
+			else
+				Debug("KangarooTwelve customised digest MISMATCH", TRUE);
+
+			turboshake128(pattern, 17, 0x1F, digest, 32);
+			if (memcmp(digest, expected_turbo, 32) == 0)
+				Debug("TurboSHAKE128 digest matches", TRUE);
+			else
+				Debug("TurboSHAKE128 digest MISMATCH", TRUE);
+		}
+
+		// ParallelHash128- SP 800-185 samples 1 and 2, three 8 byte blocks without and with a customisation string
+		{
+			static const BYTE data[24] = {
+				0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17,
+				0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27 };
+			static const BYTE expected[2][32] = {
+				{ 0xBA, 0x8D, 0xC1, 0xD1, 0xD9, 0x79, 0x33, 0x1D, 0x3F, 0x81, 0x36, 0x03, 0xC6, 0x7F, 0x72, 0x60,
+				  0x9A, 0xB5, 0xE4, 0x4B, 0x94, 0xA0, 0xB8, 0xF9, 0xAF, 0x46, 0x51, 0x44, 0x54, 0xA2, 0xB4, 0xF5 },
+				{ 0xFC, 0x48, 0x4D, 0xCB, 0x3F, 0x84, 0xDC, 0xEE, 0xDC, 0x35, 0x34, 0x38, 0x15, 0x1B, 0xEE, 0x58,
+				  0x15, 0x7D, 0x6E, 0xFE, 0xD0, 0x44, 0x5A, 0x81, 0xF1, 0x65, 0xE4, 0x95, 0x79, 0x5B, 0x72, 0x06 } };
+			BYTE digest[32];
+			unsigned int good = 1;
+
+			good &= parallelhash128(data, sizeof(data), 8, NULL, 0, digest, 32);
+			good &= (memcmp(digest, expected[0], 32) == 0);
+			good &= parallelhash128(data, sizeof(data), 8, (const unsigned char *)"Parallel Data", 13, digest, 32);
+			good &= (memcmp(digest, expected[1], 32) == 0);
+
+			// A block size of 0 is refused, with the output zeroed rather than left as it was
+			memset(digest, 0xAA, 32);
+			good &= (parallelhash128(data, sizeof(data), 0, NULL, 0, digest, 32) == 0);
+			good &= (digest[0] == 0) && (memcmp(digest, digest + 1, 31) == 0);
+			memset(digest, 0xAA, 32);
+			good &= (parallelhash256(data, sizeof(data), 0, NULL, 0, digest, 32) == 0);
+			good &= (digest[0] == 0) && (memcmp(digest, digest + 1, 31) == 0);
+			if (good)
+				Debug("ParallelHash128 digests match", TRUE);
+			else
+				Debug("ParallelHash128 digests MISMATCH", TRUE);
+		}
+
+		// KMAC- SP 800-185 sample 1, computed twice from one cached keyed state
+		{
+			static const BYTE expected[32] = {
+				0xE5, 0x78, 0x0B, 0x0D, 0x3E, 0xA6, 0xF7, 0xD3, 0xA4, 0x29, 0xC5, 0x70, 0x6A, 0xA4, 0x3A, 0x00,
+				0xFA, 0xDB, 0xD7, 0xD4, 0x96, 0x28, 0x83, 0x9E, 0x31, 0x87, 0x24, 0x3F, 0x45, 0x6E, 0xE1, 0x4E };
+			static const BYTE data[4] = { 0x00, 0x01, 0x02, 0x03 };
+			keccak_ctx keyed, ctx;
+			BYTE key[32], mac[32];
+			unsigned int i, good = 1;
+
+			for (i = 0; i < 32; i++)
+				key[i] = (BYTE)(0x40 + i);
+			kmac128_init(&keyed, key, 32, NULL, 0);
+			for (i = 0; i < 2; i++)
+			{
+				kmac_clone(&ctx, &keyed);
+				keccak_update(&ctx, data, sizeof(data));
+				kmac_final(&ctx, mac, 32);
+				good &= (memcmp(mac, expected, 32) == 0);
+			}
+			if (good)
+				Debug("KMAC digest matches", TRUE);
+			else
+				Debug("KMAC digest MISMATCH", TRUE);
+		}
+
 }
@@ -20,6 +20,43 @@ typedef unsigned long long int UINT64;
 typedef UINT64 tKeccakLane;
 
 #define MIN(a, b) ((a) < (b) ? (a) : (b))
+// Define SHA3_THREADS (and link with -pthread) to spread the tree hash leaves over worker threads
+//#define SHA3_THREADS
+// Define SHA3_SIMD on x86 GCC/Clang hosts to build the AVX2/AVX-512 kernels in sha3_simd.c. They are only used when CPUID
+// reports the instructions, otherwise the scalar permutation runs
+//#define SHA3_SIMD
+#define SHA3_MULTI_LANES	8		// Most messages sha3_256_batch hashes side by side
+
+#include <stddef.h>
+
+// Lane byte order. SHA3_LITTLE_ENDIAN selects direct 64-bit lane access and is worked out from the compiler where it can be-
+// define SHA3_LITTLE_ENDIAN or SHA3_BIG_ENDIAN to force it. Anything else takes the portable byte-wise path
+#if !defined(SHA3_LITTLE_ENDIAN) && !defined(SHA3_BIG_ENDIAN)
+	#if defined(__BYTE_ORDER__) && defined(__ORDER_LITTLE_ENDIAN__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+		#define SHA3_LITTLE_ENDIAN
+	#elif defined(_M_IX86) || defined(_M_X64) || defined(_M_ARM) || defined(_M_ARM64)
+		#define SHA3_LITTLE_ENDIAN
+	#endif
+#endif
+
+// Streaming sponge- holds the state and the partial block between keccak_update calls, so memory stays at one state
+// whatever the message length
+typedef struct
+{
+	UINT8 state[200];
+	unsigned int rateInBytes;			// 0 if keccak_init was given a bad rate/capacity
+	unsigned int blockSize;				// Bytes of the current block absorbed so far- or, once squeezing, read so far
+	unsigned int rounds;				// 24 for Keccak-f[1600], 12 for TurboSHAKE
+	unsigned char delimitedSuffix;
+	unsigned char squeezing;			// Set by the first keccak_squeeze/keccak_final, no more input is taken after it
+} keccak_ctx;
+
+// One segment for the scatter/gather calls- same layout as POSIX struct iovec
+typedef struct
+{
+	const UINT8 *Base;
+	size_t Length;
+} keccak_iovec;
 
 // Macros
 //---------------------------------------------------------------
@@ -35,8 +72,53 @@ void FIPS202_SHA3_256(const unsigned char *input, unsigned int inputByteLen, uns
 void FIPS202_SHA3_384(const unsigned char *input, unsigned int inputByteLen, unsigned char *output);
 void FIPS202_SHA3_512(const unsigned char *input, unsigned int inputByteLen, unsigned char *output);
 
+void KeccakF1600_StatePermute(void *state);
+int KeccakP1600_Permute(void *state, unsigned int nr);            // nr even, 2..24- returns 0 and does nothing otherwise
+void KeccakF1600_StatePermute_Reference(void *state);
+
+void keccak_init(keccak_ctx *ctx, unsigned int rate, unsigned int capacity, unsigned char delimitedSuffix);
+void keccak_update(keccak_ctx *ctx, const unsigned char *input, unsigned long long int inputByteLen);
+void keccak_final(keccak_ctx *ctx, unsigned char *output, unsigned long long int outputByteLen);
+void keccak_squeeze(keccak_ctx *ctx, unsigned char *output, unsigned long long int outputByteLen);
+void keccak_update_iov(keccak_ctx *ctx, const keccak_iovec *segments, size_t count);
+void sha3_256_iov(const keccak_iovec *segments, size_t count, unsigned char *output);
+
+// SHAKE as an XOF- absorb with keccak_update, then keccak_squeeze any number of times in any chunk size
+void shake128_init(keccak_ctx *ctx);
+void shake256_init(keccak_ctx *ctx);
+void shake128(const unsigned char *input, unsigned long long int inputByteLen, unsigned char *output, unsigned long long int outputByteLen);
+void shake256(const unsigned char *input, unsigned long long int inputByteLen, unsigned char *output, unsigned long long int outputByteLen);
+
 void Keccak(unsigned int rate, unsigned int capacity, const unsigned char *input, unsigned long long int inputByteLen, unsigned char delimitedSuffix, unsigned char *output, unsigned long long int outputByteLen);
 
+// Multi-buffer (sha3_multi.c)- independent messages hashed side by side in SIMD lanes
+void sha3_256_x4(const unsigned char *const *inputs, const size_t *lens, unsigned char *const *outputs);
+void sha3_256_x8(const unsigned char *const *inputs, const size_t *lens, unsigned char *const *outputs);
+void sha3_256_batch(const unsigned char *const *inputs, const size_t *lens, unsigned char *const *outputs, size_t Count);
+const char *sha3_multi_backend_name(void);
+
+// Tree hashes- leaves are hashed over worker threads (SHA3_THREADS) and multi-buffer lanes
+void turboshake128_init(keccak_ctx *ctx, unsigned char D);
+void turboshake256_init(keccak_ctx *ctx, unsigned char D);
+void turboshake128(const unsigned char *input, size_t inputByteLen, unsigned char D, unsigned char *output, size_t outputByteLen);
+void turboshake256(const unsigned char *input, size_t inputByteLen, unsigned char D, unsigned char *output, size_t outputByteLen);
+void kangarootwelve(const unsigned char *input, size_t inputByteLen, const unsigned char *custom, size_t customByteLen, unsigned char *output, size_t outputByteLen);
+int parallelhash128(const unsigned char *input, size_t inputByteLen, size_t blockByteLen, const unsigned char *custom, size_t customByteLen, unsigned char *output, size_t outputByteLen);
+int parallelhash256(const unsigned char *input, size_t inputByteLen, size_t blockByteLen, const unsigned char *custom, size_t customByteLen, unsigned char *output, size_t outputByteLen);
+
+// SP 800-185- kmac*_init builds a keyed state once, kmac_clone copies it per message, keccak_update feeds it
+void cshake128_init(keccak_ctx *ctx, const unsigned char *N, size_t NLen, const unsigned char *S, size_t SLen);
+void cshake256_init(keccak_ctx *ctx, const unsigned char *N, size_t NLen, const unsigned char *S, size_t SLen);
+void cshake128(const unsigned char *input, size_t inputByteLen, const unsigned char *N, size_t NLen, const unsigned char *S, size_t SLen, unsigned char *output, size_t outputByteLen);
+void cshake256(const unsigned char *input, size_t inputByteLen, const unsigned char *N, size_t NLen, const unsigned char *S, size_t SLen, unsigned char *output, size_t outputByteLen);
+void kmac128_init(keccak_ctx *ctx, const unsigned char *key, size_t keyByteLen, const unsigned char *S, size_t SLen);
+void kmac256_init(keccak_ctx *ctx, const unsigned char *key, size_t keyByteLen, const unsigned char *S, size_t SLen);
+void kmac_clone(keccak_ctx *dst, const keccak_ctx *src);
+void kmac_final(keccak_ctx *ctx, unsigned char *output, size_t outputByteLen);
+void kmac_xof_final(keccak_ctx *ctx, unsigned char *output, size_t outputByteLen);
+void kmac128(const unsigned char *key, size_t keyByteLen, const unsigned char *input, size_t inputByteLen, const unsigned char *S, size_t SLen, unsigned char *output, size_t outputByteLen);
+void kmac256(const unsigned char *key, size_t keyByteLen, const unsigned char *input, size_t inputByteLen, const unsigned char *S, size_t SLen, unsigned char *output, size_t outputByteLen);
+
 // Unit test Prototypes
 //----------------------
 void SHA3UT(void);
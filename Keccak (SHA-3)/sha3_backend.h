@@ -0,0 +1,218 @@
+//
+//							Filename: sha3_backend.h
+//							Function: Internals shared by the Keccak permutation kernels. Not for use by application code
+//
+//
+//-------------------------------------------------------------------------------------------------------------------------------------------------
+
+#ifndef SHA3_BACKEND_H_
+#define SHA3_BACKEND_H_
+
+#include "sha3.h"
+#include <string.h>
+
+// Definitions
+//-------------
+
+// One full round from the 25 lanes A?? into E??. Lane names are row (b g k m s = y 0..4) then column (a e i o u = x 0..4).
+// The ρ offsets and π moves are folded into the operand order. Lanes be, bi, go, ki, mi and sa are held complemented
+// (lane complementing), which turns most of the NOTs in χ into ORs- only one NOT is left per plane. ROL64 is taken from the
+// including file, so the same round serves scalar lanes and vector lanes
+//------------------------------------------------------------------------------------------------------------
+#define KECCAK_ROUND(A, E, rc) \
+    Ca = A##ba ^ A##ga ^ A##ka ^ A##ma ^ A##sa; \
+    Ce = A##be ^ A##ge ^ A##ke ^ A##me ^ A##se; \
+    Ci = A##bi ^ A##gi ^ A##ki ^ A##mi ^ A##si; \
+    Co = A##bo ^ A##go ^ A##ko ^ A##mo ^ A##so; \
+    Cu = A##bu ^ A##gu ^ A##ku ^ A##mu ^ A##su; \
+    Da = Cu ^ ROL64(Ce, 1); \
+    De = Ca ^ ROL64(Ci, 1); \
+    Di = Ce ^ ROL64(Co, 1); \
+    Do = Ci ^ ROL64(Cu, 1); \
+    Du = Co ^ ROL64(Ca, 1); \
+    \
+    Ba = A##ba ^ Da; \
+    Be = ROL64(A##ge ^ De, 44); \
+    Bi = ROL64(A##ki ^ Di, 43); \
+    Bo = ROL64(A##mo ^ Do, 21); \
+    Bu = ROL64(A##su ^ Du, 14); \
+    E##ba = Ba ^ (Be | Bi) ^ (rc); \
+    E##be = Be ^ ((~Bi) | Bo); \
+    E##bi = Bi ^ (Bo & Bu); \
+    E##bo = Bo ^ (Bu | Ba); \
+    E##bu = Bu ^ (Ba & Be); \
+    \
+    Ba = ROL64(A##bo ^ Do, 28); \
+    Be = ROL64(A##gu ^ Du, 20); \
+    Bi = ROL64(A##ka ^ Da, 3); \
+    Bo = ROL64(A##me ^ De, 45); \
+    Bu = ROL64(A##si ^ Di, 61); \
+    E##ga = Ba ^ (Be | Bi); \
+    E##ge = Be ^ (Bi & Bo); \
+    E##gi = Bi ^ (Bo | (~Bu)); \
+    E##go = Bo ^ (Bu | Ba); \
+    E##gu = Bu ^ (Ba & Be); \
+    \
+    Ba = ROL64(A##be ^ De, 1); \
+    Be = ROL64(A##gi ^ Di, 6); \
+    Bi = ROL64(A##ko ^ Do, 25); \
+    Bo = ROL64(A##mu ^ Du, 8); \
+    Bu = ROL64(A##sa ^ Da, 18); \
+    E##ka = Ba ^ (Be | Bi); \
+    E##ke = Be ^ (Bi & Bo); \
+    E##ki = Bi ^ ((~Bo) & Bu); \
+    E##ko = (~Bo) ^ (Bu | Ba); \
+    E##ku = Bu ^ (Ba & Be); \
+    \
+    Ba = ROL64(A##bu ^ Du, 27); \
+    Be = ROL64(A##ga ^ Da, 36); \
+    Bi = ROL64(A##ke ^ De, 10); \
+    Bo = ROL64(A##mi ^ Di, 15); \
+    Bu = ROL64(A##so ^ Do, 56); \
+    E##ma = Ba ^ (Be & Bi); \
+    E##me = Be ^ (Bi | Bo); \
+    E##mi = Bi ^ ((~Bo) | Bu); \
+    E##mo = (~Bo) ^ (Bu & Ba); \
+    E##mu = Bu ^ (Ba | Be); \
+    \
+    Ba = ROL64(A##bi ^ Di, 62); \
+    Be = ROL64(A##go ^ Do, 55); \
+    Bi = ROL64(A##ku ^ Du, 39); \
+    Bo = ROL64(A##ma ^ Da, 41); \
+    Bu = ROL64(A##se ^ De, 2); \
+    E##sa = Ba ^ ((~Be) & Bi); \
+    E##se = (~Be) ^ (Bi | Bo); \
+    E##si = Bi ^ (Bo & Bu); \
+    E##so = Bo ^ (Bu | Ba); \
+    E##su = Bu ^ (Ba & Be);
+
+
+//---------------------------------------------------------------------
+// Assistant functions
+//---------------------------------------------------------------------
+#ifdef SHA3_LITTLE_ENDIAN
+
+	// load64: load 64-bit value using LE convention
+	// The host is little-endian so this is a plain 64-bit load. memcpy keeps it safe for unaligned input and compiles to one move
+	static inline UINT64 load64(const UINT8 *x){
+    	UINT64 u;
+
+    	memcpy(&u, x, sizeof(u));
+    	return u;
+	}
+
+	// store64: store 64-bit value using LE convention
+	static inline void store64(UINT8 *x, UINT64 u){
+    	memcpy(x, &u, sizeof(u));
+	}
+
+	// xor64: xor into 64-bit value using LE convention
+	static inline void xor64(UINT8 *x, UINT64 u){
+    	store64(x, load64(x) ^ u);
+	}
+#else
+
+	// load64: load 64-bit value using LE convention
+	// This is a cast-less operation to make the code more portable IMHO
+	static inline UINT64 load64(const UINT8 *x){
+    	int i;
+    	UINT64 u=0;
+
+    	for(i = 7; i >= 0; --i){
+        	u <<= 8;
+        	u |= x[i];
+    	}
+    	return u;
+	}
+
+	// store64: store 64-bit value using LE convention
+	// This is a cast-less operation to make the code more portable IMHO
+	static inline void store64(UINT8 *x, UINT64 u){
+    	unsigned int i;
+
+    	for(i = 0; i < 8; ++i){
+        	x[i] = u;
+        	u >>= 8;
+    	}
+	}
+
+	// xor64: xor into 64-bit value using LE convention
+	// Again, a cast-less operation to make sure it does exactly what it is supposed to
+	static inline void xor64(UINT8 *x, UINT64 u){
+    	unsigned int i;
+
+    	for(i = 0; i < 8; ++i){
+        	x[i] ^= u;
+        	u >>= 8;
+    	}
+	}
+#endif
+
+
+// Body of the scalar permutation, shared by the plain build and the AVX2 (BMI) build of it. Loads the 25 lanes of state,
+// complementing the six held inverted, runs the last nr rounds (nr even, 2..24- checked by KeccakP1600_Permute) two at a
+// time swapping the A and E lane sets, and stores them back
+//------------------------------------------------------------------------------------------------------------
+#define KECCAK_LANE(k)  ((UINT8 *)state + sizeof(tKeccakLane) * (k))
+#define KECCAK_PERMUTE_BODY(nr) \
+    tKeccakLane Aba, Abe, Abi, Abo, Abu, Aga, Age, Agi, Ago, Agu, Aka, Ake, Aki, Ako, Aku; \
+    tKeccakLane Ama, Ame, Ami, Amo, Amu, Asa, Ase, Asi, Aso, Asu; \
+    tKeccakLane Eba, Ebe, Ebi, Ebo, Ebu, Ega, Ege, Egi, Ego, Egu, Eka, Eke, Eki, Eko, Eku; \
+    tKeccakLane Ema, Eme, Emi, Emo, Emu, Esa, Ese, Esi, Eso, Esu; \
+    tKeccakLane Ba, Be, Bi, Bo, Bu, Ca, Ce, Ci, Co, Cu, Da, De, Di, Do, Du; \
+    unsigned int round; \
+    \
+    Aba = load64(KECCAK_LANE( 0)); Abe = ~load64(KECCAK_LANE( 1)); Abi = ~load64(KECCAK_LANE( 2)); Abo = load64(KECCAK_LANE( 3)); Abu = load64(KECCAK_LANE( 4)); \
+    Aga = load64(KECCAK_LANE( 5)); Age = load64(KECCAK_LANE( 6)); Agi = load64(KECCAK_LANE( 7)); Ago = ~load64(KECCAK_LANE( 8)); Agu = load64(KECCAK_LANE( 9)); \
+    Aka = load64(KECCAK_LANE(10)); Ake = load64(KECCAK_LANE(11)); Aki = ~load64(KECCAK_LANE(12)); Ako = load64(KECCAK_LANE(13)); Aku = load64(KECCAK_LANE(14)); \
+    Ama = load64(KECCAK_LANE(15)); Ame = load64(KECCAK_LANE(16)); Ami = ~load64(KECCAK_LANE(17)); Amo = load64(KECCAK_LANE(18)); Amu = load64(KECCAK_LANE(19)); \
+    Asa = ~load64(KECCAK_LANE(20)); Ase = load64(KECCAK_LANE(21)); Asi = load64(KECCAK_LANE(22)); Aso = load64(KECCAK_LANE(23)); Asu = load64(KECCAK_LANE(24)); \
+    \
+    for(round = 24 - (nr); round < 24; round += 2) { \
+        KECCAK_ROUND(A, E, KeccakF_RoundConstants[round]) \
+        KECCAK_ROUND(E, A, KeccakF_RoundConstants[round + 1]) \
+    } \
+    \
+    store64(KECCAK_LANE( 0), Aba); store64(KECCAK_LANE( 1), ~Abe); store64(KECCAK_LANE( 2), ~Abi); store64(KECCAK_LANE( 3), Abo); store64(KECCAK_LANE( 4), Abu); \
+    store64(KECCAK_LANE( 5), Aga); store64(KECCAK_LANE( 6), Age); store64(KECCAK_LANE( 7), Agi); store64(KECCAK_LANE( 8), ~Ago); store64(KECCAK_LANE( 9), Agu); \
+    store64(KECCAK_LANE(10), Aka); store64(KECCAK_LANE(11), Ake); store64(KECCAK_LANE(12), ~Aki); store64(KECCAK_LANE(13), Ako); store64(KECCAK_LANE(14), Aku); \
+    store64(KECCAK_LANE(15), Ama); store64(KECCAK_LANE(16), Ame); store64(KECCAK_LANE(17), ~Ami); store64(KECCAK_LANE(18), Amo); store64(KECCAK_LANE(19), Amu); \
+    store64(KECCAK_LANE(20), ~Asa); store64(KECCAK_LANE(21), Ase); store64(KECCAK_LANE(22), Asi); store64(KECCAK_LANE(23), Aso); store64(KECCAK_LANE(24), Asu);
+
+
+// A run of equal-length leaves for the tree hashes. Leaf i is leafLen bytes at input + i * leafLen and its chaining value,
+// the first cvLen bytes squeezed from the sponge (rateInBytes, suffix, rounds), goes to cvs + i * cvLen
+typedef struct
+{
+	const unsigned char *input;
+	size_t leafLen;
+	size_t count;
+	unsigned int rateInBytes;
+	unsigned int rounds;
+	unsigned char suffix;
+	unsigned int cvLen;					// At most one rate block
+	unsigned char *cvs;
+} tSHA3Leaves;
+
+
+// External, static or other variables
+//--------------------------------------
+extern const UINT64 KeccakF_RoundConstants[24];
+
+
+// Function Prototypes
+//---------------------
+void KeccakP1600_Permute_Scalar(void *state, unsigned int nr);
+void SHA3_Multi_Hash(unsigned int rateInBytes, unsigned char suffix, unsigned int rounds, unsigned int outLen,
+					 const unsigned char *const *inputs, const size_t *lens, unsigned char *const *outputs, size_t Count);
+void SHA3_Hash_Leaves(const tSHA3Leaves *job);
+#ifdef SHA3_SIMD
+void KeccakP1600_Permute_AVX2(void *state, unsigned int nr);
+void KeccakP1600_Permute_AVX512(void *state, unsigned int nr);
+int SHA3_AVX2_Supported(void);
+int SHA3_AVX512_Supported(void);
+void KeccakP1600_Times4_AVX2(UINT64 *states, unsigned int nr);
+void KeccakP1600_Times8_AVX512(UINT64 *states, unsigned int nr);
+#endif
+
+#endif
@@ -0,0 +1,193 @@
+//
+//					Filename: sha3_k12.c
+//                  TurboSHAKE and KangarooTwelve (RFC 9861)
+//
+//					TurboSHAKE is SHAKE on the 12-round Keccak-p[1600] with a caller-chosen domain byte D (0x01 - 0x7F).
+//                  KangarooTwelve runs TurboSHAKE128 as a tree: S = message || customisation || length_encode(|customisation|)
+//                  is cut into 8192 byte chunks, chunks 1.. are hashed into 32 byte chaining values (in parallel through
+//                  sha3_tree.c) and chunk 0 plus the chaining values make the final node.
+//
+//------------------------------------------------------------------------------------------------------------------------------------------------------------
+
+#include "sha3.h"
+#include "sha3_backend.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define K12_CHUNK			8192
+#define K12_RATE			168		// TurboSHAKE128, bytes
+#define K12_CV				32
+#define K12_WINDOW			16384	// Chaining values produced per leaf pass- 128M of message, 512K of CVs
+#define K12_SMALL_WINDOW	64		// Used if the window buffer cannot be allocated
+
+// The virtual message S = M || C || length_encode(|C|), read in place without being joined
+typedef struct
+{
+	const unsigned char *M;
+	size_t MLen;
+	const unsigned char *C;
+	size_t CLen;
+	unsigned char Enc[sizeof(size_t) + 1];
+	size_t EncLen;
+	size_t Total;
+} tK12Message;
+
+// Name: turboshake128_init
+// Function: Starts a TurboSHAKE128 sponge with domain byte D. Feed it with keccak_update, read it with keccak_final
+//--------------------------------------------------------------------------------------------------------------------------
+void turboshake128_init(keccak_ctx *ctx, unsigned char D)
+{
+	keccak_init(ctx, 1344, 256, D);
+	ctx->rounds = 12;
+}
+
+// Name: turboshake256_init
+// Function: Starts a TurboSHAKE256 sponge with domain byte D
+//--------------------------------------------------------------------------------------------------------------------------
+void turboshake256_init(keccak_ctx *ctx, unsigned char D)
+{
+	keccak_init(ctx, 1088, 512, D);
+	ctx->rounds = 12;
+}
+
+// Name: turboshake128
+// Function: One-shot TurboSHAKE128 with domain byte D and any output length
+//--------------------------------------------------------------------------------------------------------------------------
+void turboshake128(const unsigned char *input, size_t inputByteLen, unsigned char D, unsigned char *output, size_t outputByteLen)
+{
+	keccak_ctx ctx;
+
+	turboshake128_init(&ctx, D);
+	keccak_update(&ctx, input, inputByteLen);
+	keccak_final(&ctx, output, outputByteLen);
+}
+
+// Name: turboshake256
+// Function: One-shot TurboSHAKE256 with domain byte D and any output length
+//--------------------------------------------------------------------------------------------------------------------------
+void turboshake256(const unsigned char *input, size_t inputByteLen, unsigned char D, unsigned char *output, size_t outputByteLen)
+{
+	keccak_ctx ctx;
+
+	turboshake256_init(&ctx, D);
+	keccak_update(&ctx, input, inputByteLen);
+	keccak_final(&ctx, output, outputByteLen);
+}
+
+// Name: K12_Length_Encode
+// Function: length_encode(x)- x big-endian with no leading zero bytes, then the number of bytes used (0 encodes as 0x00)
+// Returns: Bytes written
+//--------------------------------------------------------------------------------------------------------------------------
+static size_t K12_Length_Encode(unsigned char *out, size_t x)
+{
+	size_t n = 0, i;
+	size_t v;
+
+	for (v = x; v > 0; v >>= 8)
+		n++;
+	for (i = 0; i < n; i++)
+		out[i] = (unsigned char)(x >> (8 * (n - 1 - i)));
+	out[n] = (unsigned char)n;
+	return n + 1;
+}
+
+// Name: K12_Absorb
+// Function: Feeds bytes from .. to-1 of S into a sponge, walking across the message, customisation and encoding parts
+//--------------------------------------------------------------------------------------------------------------------------
+static void K12_Absorb(keccak_ctx *ctx, const tK12Message *S, size_t from, size_t to)
+{
+	size_t n;
+
+	if (from < S->MLen)
+	{
+		n = MIN(to, S->MLen) - from;
+		keccak_update(ctx, S->M + from, n);
+		from += n;
+	}
+	if ((from < to) && (from < S->MLen + S->CLen))
+	{
+		n = MIN(to, S->MLen + S->CLen) - from;
+		keccak_update(ctx, S->C + (from - S->MLen), n);
+		from += n;
+	}
+	if (from < to)
+		keccak_update(ctx, S->Enc + (from - S->MLen - S->CLen), to - from);
+}
+
+// Name: kangarootwelve
+// Function: KangarooTwelve of input with customisation string custom, any output length. Chunks that lie wholly inside the
+//           message are hashed in place through the leaf engine, the one or two at the end that reach into the
+//           customisation are hashed here
+// Parameters: Message, message length, customisation (may be NULL if its length is 0), customisation length, output, output length
+// Returns: void
+//--------------------------------------------------------------------------------------------------------------------------
+void kangarootwelve(const unsigned char *input, size_t inputByteLen, const unsigned char *custom, size_t customByteLen, unsigned char *output, size_t outputByteLen)
+{
+	static const unsigned char ChunkZeroSuffix[8] = { 0x03, 0, 0, 0, 0, 0, 0, 0 };
+	static const unsigned char Terminator[2] = { 0xFF, 0xFF };
+	unsigned char smallCVs[K12_SMALL_WINDOW * K12_CV];
+	unsigned char enc[sizeof(size_t) + 1];
+	unsigned char *cvs;
+	tK12Message S;
+	tSHA3Leaves leaves;
+	keccak_ctx final, leaf;
+	size_t chunks, inMessage, window, i, n;
+
+	S.M = input;
+	S.MLen = inputByteLen;
+	S.C = custom;
+	S.CLen = customByteLen;
+	S.EncLen = K12_Length_Encode(S.Enc, customByteLen);
+	S.Total = inputByteLen + customByteLen + S.EncLen;
+
+	// Short input- a single node
+	if (S.Total <= K12_CHUNK)
+	{
+		turboshake128_init(&final, 0x07);
+		K12_Absorb(&final, &S, 0, S.Total);
+		keccak_final(&final, output, outputByteLen);
+		return;
+	}
+
+	turboshake128_init(&final, 0x06);
+	K12_Absorb(&final, &S, 0, K12_CHUNK);
+	keccak_update(&final, ChunkZeroSuffix, sizeof(ChunkZeroSuffix));
+
+	chunks = (S.Total + K12_CHUNK - 1) / K12_CHUNK;
+	inMessage = MIN(chunks, inputByteLen / K12_CHUNK);		// Chunks 1 .. inMessage-1 are all message
+
+	cvs = (inMessage > 1) ? (unsigned char *)malloc(K12_WINDOW * K12_CV) : NULL;
+	window = (cvs != NULL) ? K12_WINDOW : K12_SMALL_WINDOW;
+	if (cvs == NULL)
+		cvs = smallCVs;
+
+	leaves.leafLen = K12_CHUNK;
+	leaves.rateInBytes = K12_RATE;
+	leaves.rounds = 12;
+	leaves.suffix = 0x0B;
+	leaves.cvLen = K12_CV;
+	leaves.cvs = cvs;
+	for (i = 1; i < inMessage; i += n)
+	{
+		n = MIN(window, inMessage - i);
+		leaves.input = input + i * K12_CHUNK;
+		leaves.count = n;
+		SHA3_Hash_Leaves(&leaves);
+		keccak_update(&final, cvs, n * K12_CV);
+	}
+
+	// Chunks that run into the customisation string
+	for (i = (inMessage > 1) ? inMessage : 1; i < chunks; i++)
+	{
+		turboshake128_init(&leaf, 0x0B);
+		K12_Absorb(&leaf, &S, i * K12_CHUNK, MIN(S.Total, (i + 1) * K12_CHUNK));
+		keccak_final(&leaf, cvs, K12_CV);
+		keccak_update(&final, cvs, K12_CV);
+	}
+	if (cvs != smallCVs)
+		free(cvs);
+
+	keccak_update(&final, enc, K12_Length_Encode(enc, chunks - 1));
+	keccak_update(&final, Terminator, sizeof(Terminator));
+	keccak_final(&final, output, outputByteLen);
+}
@@ -0,0 +1,222 @@
+//
+//					Filename: sha3_multi.c
+//                  Multi-buffer sponge hashing- many small, independent messages hashed side by side (SHA3-256, tree leaves)
+//
+//					A single Keccak state is one long dependency chain and cannot fill a vector unit, but N unrelated messages can:
+//                  each gets one 64-bit element of every vector and the AVX2 (N = 4) or AVX-512 (N = 8) kernel in sha3_simd.c
+//                  permutes them all at once.
+//
+//					Messages rarely have the same length, so the lanes are scheduled rather than run in lock step. Every pass absorbs
+//                  one block into each live lane and permutes; a lane whose message is finished is squeezed and refilled with
+//                  the next message straight away. The last message left runs on alone in the scalar permutation.
+//
+//					Without SHA3_SIMD, or on a CPU without AVX2, every call falls back to the scalar sponge one message at a time.
+//
+//------------------------------------------------------------------------------------------------------------------------------------------------------------
+
+#include "sha3.h"
+#include "sha3_backend.h"
+#include <string.h>
+
+#define SHA3_256_RATE		136		// Bytes
+#define SHA3_256_DIGEST		32
+#define SHA3_SUFFIX			0x06
+
+typedef void (*tKeccakTimes)(UINT64 *states, unsigned int nr);
+
+// External, static or other variables
+//--------------------------------------
+static tKeccakTimes Multi_Times4 = NULL;		// Filled in at startup when the CPU has the instructions
+static tKeccakTimes Multi_Times8 = NULL;
+
+
+#ifdef SHA3_SIMD
+// Name: SHA3_Select_Multi
+// Function: Runs once at startup and picks up the vector kernels the CPU supports
+//--------------------------------------------------------------------------------------------------------------------------
+__attribute__((constructor)) static void SHA3_Select_Multi(void)
+{
+	if (SHA3_AVX2_Supported())
+		Multi_Times4 = KeccakP1600_Times4_AVX2;
+	if (SHA3_AVX512_Supported())
+		Multi_Times8 = KeccakP1600_Times8_AVX512;
+}
+#endif
+
+// Name: Multi_Absorb
+// Function: XORs the next block of a message into lane j of the interleaved states. A short block is the last one and gets
+//           the padding too (suffix must not have bit 7 set, true for SHA-3 and SHAKE)
+// Returns: 1 if the message is now fully padded, so the lane can be squeezed after the next permutation
+//--------------------------------------------------------------------------------------------------------------------------
+static int Multi_Absorb(UINT64 *states, unsigned int Lanes, unsigned int j, const unsigned char **in, size_t *left, unsigned int rateInBytes, unsigned char suffix)
+{
+	const unsigned char *p = *in;
+	unsigned int w, b, n;
+
+	if (*left >= rateInBytes)
+	{
+		for (w = 0; w < rateInBytes / 8; w++)
+			states[w * Lanes + j] ^= load64(p + 8 * w);
+		*in = p + rateInBytes;
+		*left -= rateInBytes;
+		return 0;
+	}
+
+	n = (unsigned int)*left;
+	for (w = 0; w < n / 8; w++)
+		states[w * Lanes + j] ^= load64(p + 8 * w);
+	for (b = w * 8; b < n; b++)
+		states[(b / 8) * Lanes + j] ^= (UINT64)p[b] << (8 * (b % 8));
+	states[(n / 8) * Lanes + j] ^= (UINT64)suffix << (8 * (n % 8));
+	states[((rateInBytes - 1) / 8) * Lanes + j] ^= (UINT64)0x80 << (8 * ((rateInBytes - 1) % 8));
+	*left = 0;
+	return 1;
+}
+
+// Name: Multi_Finish_Scalar
+// Function: Moves lane j into a keccak_ctx and finishes the message with the scalar sponge
+//--------------------------------------------------------------------------------------------------------------------------
+static void Multi_Finish_Scalar(const UINT64 *states, unsigned int Lanes, unsigned int j, const unsigned char *in, size_t left, unsigned char *out, unsigned int rateInBytes, unsigned char suffix, unsigned int rounds, unsigned int outLen)
+{
+	keccak_ctx ctx;
+	unsigned int w;
+
+	for (w = 0; w < 25; w++)
+		store64(ctx.state + 8 * w, states[w * Lanes + j]);
+	ctx.rateInBytes = rateInBytes;
+	ctx.rounds = rounds;
+	ctx.blockSize = 0;
+	ctx.delimitedSuffix = suffix;
+	ctx.squeezing = 0;
+	keccak_update(&ctx, in, left);
+	keccak_final(&ctx, out, outLen);
+}
+
+// Name: Multi_Run
+// Function: Lane scheduler. Keeps up to Lanes messages live, one block each per permutation, and refills a lane as soon as its
+//           message has been squeezed. outLen must not exceed the rate
+//--------------------------------------------------------------------------------------------------------------------------
+static void Multi_Run(tKeccakTimes Permute, unsigned int Lanes, unsigned int rateInBytes, unsigned char suffix, unsigned int rounds, unsigned int outLen,
+					  const unsigned char *const *inputs, const size_t *lens, unsigned char *const *outputs, size_t Count)
+{
+	UINT64 states[25 * SHA3_MULTI_LANES];
+	const unsigned char *in[SHA3_MULTI_LANES];
+	unsigned char *out[SHA3_MULTI_LANES];
+	size_t left[SHA3_MULTI_LANES];
+	unsigned char live[SHA3_MULTI_LANES], padded[SHA3_MULTI_LANES];
+	size_t next = 0;
+	unsigned int active, j, w;
+
+	memset(live, 0, sizeof(live));
+	for (;;)
+	{
+		// Refill idle lanes from the queue with a fresh all-zero state
+		active = 0;
+		for (j = 0; j < Lanes; j++)
+		{
+			if (!live[j] && (next < Count))
+			{
+				in[j] = inputs[next];
+				left[j] = lens[next];
+				out[j] = outputs[next];
+				for (w = 0; w < 25; w++)
+					states[w * Lanes + j] = 0;
+				live[j] = 1;
+				next++;
+			}
+			active += live[j];
+		}
+		if (active == 0)
+			break;
+
+		// Queue empty and one message left- a full-width permutation would carry it alone, the scalar one is cheaper
+		if ((active == 1) && (next >= Count))
+		{
+			for (j = 0; !live[j]; j++)
+				;
+			Multi_Finish_Scalar(states, Lanes, j, in[j], left[j], out[j], rateInBytes, suffix, rounds, outLen);
+			break;
+		}
+
+		for (j = 0; j < Lanes; j++)
+			padded[j] = live[j] ? (unsigned char)Multi_Absorb(states, Lanes, j, &in[j], &left[j], rateInBytes, suffix) : 0;
+
+		Permute(states, rounds);
+
+		// Squeeze the lanes whose last block just went through
+		for (j = 0; j < Lanes; j++)
+		{
+			if (!padded[j])
+				continue;
+			for (w = 0; w < outLen / 8; w++)
+				store64(out[j] + 8 * w, states[w * Lanes + j]);
+			for (w *= 8; w < outLen; w++)
+				out[j][w] = (unsigned char)(states[(w / 8) * Lanes + j] >> (8 * (w % 8)));
+			live[j] = 0;
+		}
+	}
+}
+
+// Name: SHA3_Multi_Hash
+// Function: Hashes Count independent messages with any sponge that fits the lane scheduler- rate in bytes, suffix without
+//           bit 7, rounds (24 or 12) and a digest of at most one rate block. Used by sha3_256_batch and the tree hashes
+//--------------------------------------------------------------------------------------------------------------------------
+void SHA3_Multi_Hash(unsigned int rateInBytes, unsigned char suffix, unsigned int rounds, unsigned int outLen,
+					 const unsigned char *const *inputs, const size_t *lens, unsigned char *const *outputs, size_t Count)
+{
+	keccak_ctx ctx;
+	size_t k;
+
+	if ((Multi_Times8 != NULL) && (Count > 4))
+		Multi_Run(Multi_Times8, 8, rateInBytes, suffix, rounds, outLen, inputs, lens, outputs, Count);
+	else if ((Multi_Times4 != NULL) && (Count > 1))
+		Multi_Run(Multi_Times4, 4, rateInBytes, suffix, rounds, outLen, inputs, lens, outputs, Count);
+	else
+	{
+		for (k = 0; k < Count; k++)
+		{
+			keccak_init(&ctx, rateInBytes * 8, 1600 - rateInBytes * 8, suffix);
+			ctx.rounds = rounds;
+			keccak_update(&ctx, inputs[k], lens[k]);
+			keccak_final(&ctx, outputs[k], outLen);
+		}
+	}
+}
+
+// Name: sha3_256_batch
+// Function: SHA3-256 of Count independent messages, inputs[k] (lens[k] bytes) to outputs[k] (32 bytes). Lengths may differ freely
+// Parameters: Message pointers, message lengths, digest pointers, number of messages
+// Returns: void
+//--------------------------------------------------------------------------------------------------------------------------
+void sha3_256_batch(const unsigned char *const *inputs, const size_t *lens, unsigned char *const *outputs, size_t Count)
+{
+	SHA3_Multi_Hash(SHA3_256_RATE, SHA3_SUFFIX, 24, SHA3_256_DIGEST, inputs, lens, outputs, Count);
+}
+
+// Name: sha3_256_x4
+// Function: SHA3-256 of 4 independent messages
+//--------------------------------------------------------------------------------------------------------------------------
+void sha3_256_x4(const unsigned char *const *inputs, const size_t *lens, unsigned char *const *outputs)
+{
+	sha3_256_batch(inputs, lens, outputs, 4);
+}
+
+// Name: sha3_256_x8
+// Function: SHA3-256 of 8 independent messages
+//--------------------------------------------------------------------------------------------------------------------------
+void sha3_256_x8(const unsigned char *const *inputs, const size_t *lens, unsigned char *const *outputs)
+{
+	sha3_256_batch(inputs, lens, outputs, 8);
+}
+
+// Name: sha3_multi_backend_name
+// Function: Names the widest kernel sha3_256_batch will use
+//--------------------------------------------------------------------------------------------------------------------------
+const char *sha3_multi_backend_name(void)
+{
+	if (Multi_Times8 != NULL)
+		return "avx512 x8";
+	if (Multi_Times4 != NULL)
+		return "avx2 x4";
+	return "scalar";
+}
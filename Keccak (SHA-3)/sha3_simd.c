@@ -0,0 +1,249 @@
+//
+//					Filename: sha3_simd.c
+//                  Keccak-f[1600] kernels for x86 vector units
+//
+//					Only built when SHA3_SIMD is defined. Each function carries its own target attribute, so the rest of the library
+//                  is compiled for the baseline CPU and still runs where AVX2/AVX-512 are missing- the callers only pick these
+//                  kernels when CPUID (and the OS, through XGETBV) say the registers are usable.
+//
+//					The single-state AVX-512 kernel keeps the state as 5 row vectors (lanes x = 0..4 of plane y in one zmm) for all 24
+//                  rounds. θ and χ are VPTERNLOGQ, ρ is VPROLVQ and π is a lane permute per row followed by a 5x5 transpose.
+//
+//					The multi-state kernels run 4 (AVX2) or 8 (AVX-512) independent permutations at once. The states are interleaved
+//                  lane by lane- word w of state j sits at states[w * N + j]- so one vector holds the same lane of every state and
+//                  the round is the scalar KECCAK_ROUND applied to vectors.
+//
+//------------------------------------------------------------------------------------------------------------------------------------------------------------
+
+#include "sha3.h"
+#include "sha3_backend.h"
+
+#ifdef SHA3_SIMD
+
+#include <cpuid.h>
+#include <immintrin.h>
+
+#define SHA3_AVX2_TARGET	__attribute__((target("avx2")))
+#define SHA3_BMI_TARGET		__attribute__((target("avx2,bmi,bmi2")))
+#define SHA3_AVX512_TARGET	__attribute__((target("avx512f")))
+
+typedef UINT64 tKeccakV4 __attribute__((vector_size(32)));
+typedef UINT64 tKeccakV8 __attribute__((vector_size(64)));
+
+// Vector rotate- the compiler turns this into VPROLQ under AVX-512 and a shift pair under AVX2
+#undef ROL64
+#define ROL64(a, offset) (((a) << (offset)) | ((a) >> (64 - (offset))))
+
+//--------------------------------------------------------------------------------------------------------------------------
+// CPU checks
+//--------------------------------------------------------------------------------------------------------------------------
+
+// Name: SHA3_XCR0
+// Function: Reads XCR0, the register state the OS saves on a context switch. Only valid once CPUID has reported OSXSAVE
+//--------------------------------------------------------------------------------------------------------------------------
+static unsigned int SHA3_XCR0(void)
+{
+	unsigned int eax, edx;
+
+	__asm__ volatile ("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+	return eax;
+}
+
+// Name: SHA3_AVX2_Supported
+// Function: CPUID leaf 1 ECX bits 27/28 (OSXSAVE, AVX), XCR0 bits 1/2 (XMM/YMM state), CPUID leaf 7 EBX bits 5/3/8
+//           (AVX2, BMI1, BMI2- every AVX2 core has them and the AVX2 tier uses them)
+//--------------------------------------------------------------------------------------------------------------------------
+int SHA3_AVX2_Supported(void)
+{
+	unsigned int eax, ebx, ecx, edx;
+
+	if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+		return 0;
+	if (((ecx & (1u << 27)) == 0) || ((ecx & (1u << 28)) == 0))
+		return 0;
+	if ((SHA3_XCR0() & 0x06) != 0x06)
+		return 0;
+	if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx))
+		return 0;
+	return ((ebx & (1u << 5)) != 0) && ((ebx & (1u << 3)) != 0) && ((ebx & (1u << 8)) != 0);
+}
+
+// Name: SHA3_AVX512_Supported
+// Function: As SHA3_AVX2_Supported, plus XCR0 bits 5-7 (opmask/ZMM state) and CPUID leaf 7 EBX bit 16 (AVX-512F)
+//--------------------------------------------------------------------------------------------------------------------------
+int SHA3_AVX512_Supported(void)
+{
+	unsigned int eax, ebx, ecx, edx;
+
+	if (!SHA3_AVX2_Supported())
+		return 0;
+	if ((SHA3_XCR0() & 0xE6) != 0xE6)
+		return 0;
+	if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx))
+		return 0;
+	return (ebx & (1u << 16)) != 0;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+// Single-state kernels
+//--------------------------------------------------------------------------------------------------------------------------
+
+// Name: KeccakP1600_Permute_AVX2
+// Function: The scalar permutation (last nr rounds) built for AVX2-generation cores. A 5-lane plane does not fit a 4-lane ymm register without
+//           the shuffles costing more than they save, so this tier keeps the lanes in general registers and gains from the
+//           BMI1/BMI2 ANDN and RORX that ship alongside AVX2 (non-destructive rotates, fewer register copies)
+//--------------------------------------------------------------------------------------------------------------------------
+SHA3_BMI_TARGET void KeccakP1600_Permute_AVX2(void *state, unsigned int nr)
+{
+	KECCAK_PERMUTE_BODY(nr)
+}
+
+// Name: KeccakP1600_Permute_AVX512
+// Function: Perform the last nr rounds of the Keccak permutation on one state held in 5 zmm registers, one plane each.
+//           After ρ the row permutes leave the π-moved state as columns, χ runs across the column registers and a 5x5
+//           transpose turns the result back into rows for the next θ
+//--------------------------------------------------------------------------------------------------------------------------
+SHA3_AVX512_TARGET void KeccakP1600_Permute_AVX512(void *state, unsigned int nr)
+{
+	UINT64 *lanes = (UINT64 *)state;
+	const __m512i thetaPrev = _mm512_setr_epi64(4, 0, 1, 2, 3, 5, 6, 7);
+	const __m512i thetaNext = _mm512_setr_epi64(1, 2, 3, 4, 0, 5, 6, 7);
+	const __m512i rho0 = _mm512_setr_epi64( 0,  1, 62, 28, 27, 0, 0, 0);
+	const __m512i rho1 = _mm512_setr_epi64(36, 44,  6, 55, 20, 0, 0, 0);
+	const __m512i rho2 = _mm512_setr_epi64( 3, 10, 43, 25, 39, 0, 0, 0);
+	const __m512i rho3 = _mm512_setr_epi64(41, 45, 15, 21,  8, 0, 0, 0);
+	const __m512i rho4 = _mm512_setr_epi64(18,  2, 61, 56, 14, 0, 0, 0);
+	// π: column x of the new state is row x of the old one, lane y taken from old lane (x + 3y) mod 5
+	const __m512i pi0 = _mm512_setr_epi64(0, 3, 1, 4, 2, 5, 6, 7);
+	const __m512i pi1 = _mm512_setr_epi64(1, 4, 2, 0, 3, 5, 6, 7);
+	const __m512i pi2 = _mm512_setr_epi64(2, 0, 3, 1, 4, 5, 6, 7);
+	const __m512i pi3 = _mm512_setr_epi64(3, 1, 4, 2, 0, 5, 6, 7);
+	const __m512i pi4 = _mm512_setr_epi64(4, 2, 0, 3, 1, 5, 6, 7);
+	// Transpose: pair up two columns lane by lane, then pick one row out of two pairs and drop in the fifth column's lane
+	const __m512i pairLow = _mm512_setr_epi64(0, 8, 1, 9, 2, 10, 3, 11);
+	const __m512i pairHigh = _mm512_setr_epi64(4, 12, 4, 12, 4, 12, 4, 12);
+	const __m512i pick0 = _mm512_setr_epi64(0, 1,  8,  9, 0, 0, 0, 0);
+	const __m512i pick1 = _mm512_setr_epi64(2, 3, 10, 11, 0, 0, 0, 0);
+	const __m512i pick2 = _mm512_setr_epi64(4, 5, 12, 13, 0, 0, 0, 0);
+	const __m512i pick3 = _mm512_setr_epi64(6, 7, 14, 15, 0, 0, 0, 0);
+	__m512i r0, r1, r2, r3, r4, b0, b1, b2, b3, b4, c, p, q;
+	unsigned int round;
+
+	r0 = _mm512_maskz_loadu_epi64(0x1F, lanes);
+	r1 = _mm512_maskz_loadu_epi64(0x1F, lanes + 5);
+	r2 = _mm512_maskz_loadu_epi64(0x1F, lanes + 10);
+	r3 = _mm512_maskz_loadu_epi64(0x1F, lanes + 15);
+	r4 = _mm512_maskz_loadu_epi64(0x1F, lanes + 20);
+
+	for (round = 24 - nr; round < 24; round++)
+	{
+		// θ: column parities, then C[x-1] ^ ROL(C[x+1], 1) into every row
+		c = _mm512_ternarylogic_epi64(r0, r1, r2, 0x96);
+		c = _mm512_ternarylogic_epi64(c, r3, r4, 0x96);
+		p = _mm512_permutexvar_epi64(thetaPrev, c);
+		q = _mm512_rol_epi64(_mm512_permutexvar_epi64(thetaNext, c), 1);
+		r0 = _mm512_ternarylogic_epi64(r0, p, q, 0x96);
+		r1 = _mm512_ternarylogic_epi64(r1, p, q, 0x96);
+		r2 = _mm512_ternarylogic_epi64(r2, p, q, 0x96);
+		r3 = _mm512_ternarylogic_epi64(r3, p, q, 0x96);
+		r4 = _mm512_ternarylogic_epi64(r4, p, q, 0x96);
+
+		// ρ and π, giving the columns of the moved state
+		b0 = _mm512_permutexvar_epi64(pi0, _mm512_rolv_epi64(r0, rho0));
+		b1 = _mm512_permutexvar_epi64(pi1, _mm512_rolv_epi64(r1, rho1));
+		b2 = _mm512_permutexvar_epi64(pi2, _mm512_rolv_epi64(r2, rho2));
+		b3 = _mm512_permutexvar_epi64(pi3, _mm512_rolv_epi64(r3, rho3));
+		b4 = _mm512_permutexvar_epi64(pi4, _mm512_rolv_epi64(r4, rho4));
+
+		// χ across the columns, a ^ (~b & c) in one VPTERNLOGQ, then ι on lane (0, 0)
+		r0 = _mm512_ternarylogic_epi64(b0, b1, b2, 0xD2);
+		r1 = _mm512_ternarylogic_epi64(b1, b2, b3, 0xD2);
+		r2 = _mm512_ternarylogic_epi64(b2, b3, b4, 0xD2);
+		r3 = _mm512_ternarylogic_epi64(b3, b4, b0, 0xD2);
+		r4 = _mm512_ternarylogic_epi64(b4, b0, b1, 0xD2);
+		r0 = _mm512_xor_si512(r0, _mm512_maskz_set1_epi64(0x01, (long long)KeccakF_RoundConstants[round]));
+
+		// Columns back to rows
+		p = _mm512_permutex2var_epi64(r0, pairLow, r1);
+		q = _mm512_permutex2var_epi64(r2, pairLow, r3);
+		b0 = _mm512_permutex2var_epi64(r0, pairHigh, r1);
+		b1 = _mm512_permutex2var_epi64(r2, pairHigh, r3);
+		b4 = _mm512_mask_blend_epi64(0x10, _mm512_permutex2var_epi64(b0, pick0, b1), _mm512_permutexvar_epi64(_mm512_set1_epi64(4), r4));
+		b0 = _mm512_mask_blend_epi64(0x10, _mm512_permutex2var_epi64(p, pick0, q), _mm512_permutexvar_epi64(_mm512_set1_epi64(0), r4));
+		b1 = _mm512_mask_blend_epi64(0x10, _mm512_permutex2var_epi64(p, pick1, q), _mm512_permutexvar_epi64(_mm512_set1_epi64(1), r4));
+		b2 = _mm512_mask_blend_epi64(0x10, _mm512_permutex2var_epi64(p, pick2, q), _mm512_permutexvar_epi64(_mm512_set1_epi64(2), r4));
+		b3 = _mm512_mask_blend_epi64(0x10, _mm512_permutex2var_epi64(p, pick3, q), _mm512_permutexvar_epi64(_mm512_set1_epi64(3), r4));
+		r0 = b0;
+		r1 = b1;
+		r2 = b2;
+		r3 = b3;
+		r4 = b4;
+	}
+
+	_mm512_mask_storeu_epi64(lanes, 0x1F, r0);
+	_mm512_mask_storeu_epi64(lanes + 5, 0x1F, r1);
+	_mm512_mask_storeu_epi64(lanes + 10, 0x1F, r2);
+	_mm512_mask_storeu_epi64(lanes + 15, 0x1F, r3);
+	_mm512_mask_storeu_epi64(lanes + 20, 0x1F, r4);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+// Multi-state kernels
+//--------------------------------------------------------------------------------------------------------------------------
+
+// Body shared by the multi-state kernels. tV is the vector type, one state per 64-bit element. The lanes are loaded with
+// memcpy so the caller's array only needs 8 byte alignment, and are complemented on the way in and out like the scalar kernel
+//--------------------------------------------------------------------------------------------------------------------------
+#define KECCAK_TIMES_BODY(tV, nr) \
+    tV Aba, Abe, Abi, Abo, Abu, Aga, Age, Agi, Ago, Agu, Aka, Ake, Aki, Ako, Aku; \
+    tV Ama, Ame, Ami, Amo, Amu, Asa, Ase, Asi, Aso, Asu; \
+    tV Eba, Ebe, Ebi, Ebo, Ebu, Ega, Ege, Egi, Ego, Egu, Eka, Eke, Eki, Eko, Eku; \
+    tV Ema, Eme, Emi, Emo, Emu, Esa, Ese, Esi, Eso, Esu; \
+    tV Ba, Be, Bi, Bo, Bu, Ca, Ce, Ci, Co, Cu, Da, De, Di, Do, Du; \
+    const unsigned int N = sizeof(tV) / sizeof(UINT64); \
+    unsigned int round; \
+    \
+    memcpy(&Aba, &states[ 0 * N], sizeof(tV)); memcpy(&Abe, &states[ 1 * N], sizeof(tV)); memcpy(&Abi, &states[ 2 * N], sizeof(tV)); \
+    memcpy(&Abo, &states[ 3 * N], sizeof(tV)); memcpy(&Abu, &states[ 4 * N], sizeof(tV)); memcpy(&Aga, &states[ 5 * N], sizeof(tV)); \
+    memcpy(&Age, &states[ 6 * N], sizeof(tV)); memcpy(&Agi, &states[ 7 * N], sizeof(tV)); memcpy(&Ago, &states[ 8 * N], sizeof(tV)); \
+    memcpy(&Agu, &states[ 9 * N], sizeof(tV)); memcpy(&Aka, &states[10 * N], sizeof(tV)); memcpy(&Ake, &states[11 * N], sizeof(tV)); \
+    memcpy(&Aki, &states[12 * N], sizeof(tV)); memcpy(&Ako, &states[13 * N], sizeof(tV)); memcpy(&Aku, &states[14 * N], sizeof(tV)); \
+    memcpy(&Ama, &states[15 * N], sizeof(tV)); memcpy(&Ame, &states[16 * N], sizeof(tV)); memcpy(&Ami, &states[17 * N], sizeof(tV)); \
+    memcpy(&Amo, &states[18 * N], sizeof(tV)); memcpy(&Amu, &states[19 * N], sizeof(tV)); memcpy(&Asa, &states[20 * N], sizeof(tV)); \
+    memcpy(&Ase, &states[21 * N], sizeof(tV)); memcpy(&Asi, &states[22 * N], sizeof(tV)); memcpy(&Aso, &states[23 * N], sizeof(tV)); \
+    memcpy(&Asu, &states[24 * N], sizeof(tV)); \
+    Abe = ~Abe; Abi = ~Abi; Ago = ~Ago; Aki = ~Aki; Ami = ~Ami; Asa = ~Asa; \
+    \
+    for(round = 24 - (nr); round < 24; round += 2) { \
+        KECCAK_ROUND(A, E, KeccakF_RoundConstants[round]) \
+        KECCAK_ROUND(E, A, KeccakF_RoundConstants[round + 1]) \
+    } \
+    \
+    Abe = ~Abe; Abi = ~Abi; Ago = ~Ago; Aki = ~Aki; Ami = ~Ami; Asa = ~Asa; \
+    memcpy(&states[ 0 * N], &Aba, sizeof(tV)); memcpy(&states[ 1 * N], &Abe, sizeof(tV)); memcpy(&states[ 2 * N], &Abi, sizeof(tV)); \
+    memcpy(&states[ 3 * N], &Abo, sizeof(tV)); memcpy(&states[ 4 * N], &Abu, sizeof(tV)); memcpy(&states[ 5 * N], &Aga, sizeof(tV)); \
+    memcpy(&states[ 6 * N], &Age, sizeof(tV)); memcpy(&states[ 7 * N], &Agi, sizeof(tV)); memcpy(&states[ 8 * N], &Ago, sizeof(tV)); \
+    memcpy(&states[ 9 * N], &Agu, sizeof(tV)); memcpy(&states[10 * N], &Aka, sizeof(tV)); memcpy(&states[11 * N], &Ake, sizeof(tV)); \
+    memcpy(&states[12 * N], &Aki, sizeof(tV)); memcpy(&states[13 * N], &Ako, sizeof(tV)); memcpy(&states[14 * N], &Aku, sizeof(tV)); \
+    memcpy(&states[15 * N], &Ama, sizeof(tV)); memcpy(&states[16 * N], &Ame, sizeof(tV)); memcpy(&states[17 * N], &Ami, sizeof(tV)); \
+    memcpy(&states[18 * N], &Amo, sizeof(tV)); memcpy(&states[19 * N], &Amu, sizeof(tV)); memcpy(&states[20 * N], &Asa, sizeof(tV)); \
+    memcpy(&states[21 * N], &Ase, sizeof(tV)); memcpy(&states[22 * N], &Asi, sizeof(tV)); memcpy(&states[23 * N], &Aso, sizeof(tV)); \
+    memcpy(&states[24 * N], &Asu, sizeof(tV));
+
+// Name: KeccakP1600_Times4_AVX2
+// Function: Runs the last nr rounds (nr even) on 4 interleaved states (100 words) with AVX2
+//--------------------------------------------------------------------------------------------------------------------------
+SHA3_AVX2_TARGET void KeccakP1600_Times4_AVX2(UINT64 *states, unsigned int nr)
+{
+	KECCAK_TIMES_BODY(tKeccakV4, nr)
+}
+
+// Name: KeccakP1600_Times8_AVX512
+// Function: Runs the last nr rounds (nr even) on 8 interleaved states (200 words) with AVX-512F
+//--------------------------------------------------------------------------------------------------------------------------
+SHA3_AVX512_TARGET void KeccakP1600_Times8_AVX512(UINT64 *states, unsigned int nr)
+{
+	KECCAK_TIMES_BODY(tKeccakV8, nr)
+}
+
+#endif
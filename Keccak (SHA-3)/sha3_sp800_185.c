@@ -0,0 +1,318 @@
+//
+//					Filename: sha3_sp800_185.c
+//                  SHA-3 derived functions from NIST SP 800-185- cSHAKE, KMAC and ParallelHash
+//
+//					cSHAKE is SHAKE with a function name and customisation string absorbed first, padded out to a whole rate block.
+//                  KMAC is cSHAKE named "KMAC" with the key absorbed as a second padded block. Both prefixes end on a block
+//                  boundary, so after kmac*_init the keccak_ctx is a complete keyed state: copy it (kmac_clone) once per message
+//                  and only the message and the final permutation are left to do.
+//
+//					ParallelHash cuts the message into blocks of B bytes, hashes each block with cSHAKE's underlying SHAKE into a
+//                  chaining value of 2 x the security strength and feeds the chaining values into a cSHAKE named "ParallelHash".
+//                  The full blocks go through the leaf engine in sha3_tree.c; a short last block is hashed here.
+//
+//------------------------------------------------------------------------------------------------------------------------------------------------------------
+
+#include "sha3.h"
+#include "sha3_backend.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define PH_WINDOW			4096	// Chaining values produced per leaf pass
+#define PH_SMALL_WINDOW		32		// Used if the window buffer cannot be allocated
+#define PH_CV_MAX			64
+
+// Name: SP800_Left_Encode
+// Function: left_encode(x)- the number of bytes, then x big-endian with no leading zeros (at least one byte)
+// Returns: Bytes written
+//--------------------------------------------------------------------------------------------------------------------------
+static size_t SP800_Left_Encode(unsigned char *out, UINT64 x)
+{
+	size_t n = 1, i;
+
+	while ((n < 8) && (x >> (8 * n)))
+		n++;
+	out[0] = (unsigned char)n;
+	for (i = 0; i < n; i++)
+		out[1 + i] = (unsigned char)(x >> (8 * (n - 1 - i)));
+	return n + 1;
+}
+
+// Name: SP800_Right_Encode
+// Function: right_encode(x)- x big-endian with no leading zeros (at least one byte), then the number of bytes
+// Returns: Bytes written
+//--------------------------------------------------------------------------------------------------------------------------
+static size_t SP800_Right_Encode(unsigned char *out, UINT64 x)
+{
+	size_t n = 1, i;
+
+	while ((n < 8) && (x >> (8 * n)))
+		n++;
+	for (i = 0; i < n; i++)
+		out[i] = (unsigned char)(x >> (8 * (n - 1 - i)));
+	out[n] = (unsigned char)n;
+	return n + 1;
+}
+
+// Name: SP800_Encode_String
+// Function: Absorbs encode_string(S) = left_encode(bit length of S) || S
+// Returns: Bytes absorbed
+//--------------------------------------------------------------------------------------------------------------------------
+static size_t SP800_Encode_String(keccak_ctx *ctx, const unsigned char *S, size_t len)
+{
+	unsigned char enc[9];
+	size_t n;
+
+	n = SP800_Left_Encode(enc, (UINT64)len * 8);
+	keccak_update(ctx, enc, n);
+	keccak_update(ctx, S, len);
+	return n + len;
+}
+
+// Name: SP800_Bytepad
+// Function: Ends a bytepad() prefix- zero fill from n bytes absorbed up to the next rate boundary
+//--------------------------------------------------------------------------------------------------------------------------
+static void SP800_Bytepad(keccak_ctx *ctx, size_t n)
+{
+	static const unsigned char Zeros[200] = { 0 };
+
+	keccak_update(ctx, Zeros, (ctx->rateInBytes - n % ctx->rateInBytes) % ctx->rateInBytes);
+}
+
+// Name: SP800_CSHAKE_Init
+// Function: Starts cSHAKE with function name N and customisation S: the prefix bytepad(encode_string(N) || encode_string(S), rate)
+//           is absorbed here. Both strings empty makes it plain SHAKE, as the standard requires
+// Parameters: Context, rate in bits (1344 or 1088), name, name length, customisation, customisation length
+//--------------------------------------------------------------------------------------------------------------------------
+static void SP800_CSHAKE_Init(keccak_ctx *ctx, unsigned int rate, const unsigned char *N, size_t NLen, const unsigned char *S, size_t SLen)
+{
+	unsigned char enc[9];
+	size_t n;
+
+	if ((NLen == 0) && (SLen == 0))
+	{
+		keccak_init(ctx, rate, 1600 - rate, 0x1F);
+		return;
+	}
+
+	keccak_init(ctx, rate, 1600 - rate, 0x04);
+	n = SP800_Left_Encode(enc, rate / 8);
+	keccak_update(ctx, enc, n);
+	n += SP800_Encode_String(ctx, N, NLen);
+	n += SP800_Encode_String(ctx, S, SLen);
+	SP800_Bytepad(ctx, n);
+}
+
+// Name: cshake128_init
+// Function: Starts cSHAKE128 with function name N and customisation S. Feed it with keccak_update, read it with keccak_final
+// Parameters: Context, name (may be NULL if its length is 0), name length, customisation, customisation length
+//--------------------------------------------------------------------------------------------------------------------------
+void cshake128_init(keccak_ctx *ctx, const unsigned char *N, size_t NLen, const unsigned char *S, size_t SLen)
+{
+	SP800_CSHAKE_Init(ctx, 1344, N, NLen, S, SLen);
+}
+
+// Name: cshake256_init
+// Function: Starts cSHAKE256 with function name N and customisation S
+//--------------------------------------------------------------------------------------------------------------------------
+void cshake256_init(keccak_ctx *ctx, const unsigned char *N, size_t NLen, const unsigned char *S, size_t SLen)
+{
+	SP800_CSHAKE_Init(ctx, 1088, N, NLen, S, SLen);
+}
+
+// Name: cshake128
+// Function: One-shot cSHAKE128, any output length
+//--------------------------------------------------------------------------------------------------------------------------
+void cshake128(const unsigned char *input, size_t inputByteLen, const unsigned char *N, size_t NLen, const unsigned char *S, size_t SLen, unsigned char *output, size_t outputByteLen)
+{
+	keccak_ctx ctx;
+
+	cshake128_init(&ctx, N, NLen, S, SLen);
+	keccak_update(&ctx, input, inputByteLen);
+	keccak_final(&ctx, output, outputByteLen);
+}
+
+// Name: cshake256
+// Function: One-shot cSHAKE256, any output length
+//--------------------------------------------------------------------------------------------------------------------------
+void cshake256(const unsigned char *input, size_t inputByteLen, const unsigned char *N, size_t NLen, const unsigned char *S, size_t SLen, unsigned char *output, size_t outputByteLen)
+{
+	keccak_ctx ctx;
+
+	cshake256_init(&ctx, N, NLen, S, SLen);
+	keccak_update(&ctx, input, inputByteLen);
+	keccak_final(&ctx, output, outputByteLen);
+}
+
+// Name: SP800_KMAC_Init
+// Function: cSHAKE named "KMAC" with customisation S, then bytepad(encode_string(K), rate). Leaves ctx on a block boundary
+//--------------------------------------------------------------------------------------------------------------------------
+static void SP800_KMAC_Init(keccak_ctx *ctx, unsigned int rate, const unsigned char *key, size_t keyByteLen, const unsigned char *S, size_t SLen)
+{
+	static const unsigned char Name[] = "KMAC";
+	unsigned char enc[9];
+	size_t n;
+
+	SP800_CSHAKE_Init(ctx, rate, Name, sizeof(Name) - 1, S, SLen);
+	n = SP800_Left_Encode(enc, rate / 8);
+	keccak_update(ctx, enc, n);
+	n += SP800_Encode_String(ctx, key, keyByteLen);
+	SP800_Bytepad(ctx, n);
+}
+
+// Name: kmac128_init
+// Function: Builds the KMAC128 keyed state for key and customisation S. Keep it and kmac_clone it for every message rather
+//           than calling this per message- the key prefix is at least two permutations
+// Parameters: Context, key, key length, customisation (may be NULL if its length is 0), customisation length
+// Returns: void
+//--------------------------------------------------------------------------------------------------------------------------
+void kmac128_init(keccak_ctx *ctx, const unsigned char *key, size_t keyByteLen, const unsigned char *S, size_t SLen)
+{
+	SP800_KMAC_Init(ctx, 1344, key, keyByteLen, S, SLen);
+}
+
+// Name: kmac256_init
+// Function: Builds the KMAC256 keyed state for key and customisation S
+//--------------------------------------------------------------------------------------------------------------------------
+void kmac256_init(keccak_ctx *ctx, const unsigned char *key, size_t keyByteLen, const unsigned char *S, size_t SLen)
+{
+	SP800_KMAC_Init(ctx, 1088, key, keyByteLen, S, SLen);
+}
+
+// Name: kmac_clone
+// Function: Copies a keyed state (or any keccak_ctx) so the original can be reused for the next message
+//--------------------------------------------------------------------------------------------------------------------------
+void kmac_clone(keccak_ctx *dst, const keccak_ctx *src)
+{
+	memcpy(dst, src, sizeof(keccak_ctx));
+}
+
+// Name: kmac_final
+// Function: Ends a KMAC over the data fed in with keccak_update: absorbs right_encode(L) and squeezes outputByteLen bytes
+//--------------------------------------------------------------------------------------------------------------------------
+void kmac_final(keccak_ctx *ctx, unsigned char *output, size_t outputByteLen)
+{
+	unsigned char enc[9];
+
+	keccak_update(ctx, enc, SP800_Right_Encode(enc, (UINT64)outputByteLen * 8));
+	keccak_final(ctx, output, outputByteLen);
+}
+
+// Name: kmac_xof_final
+// Function: Ends a KMACXOF- right_encode(0), so the output does not depend on how much is read
+//--------------------------------------------------------------------------------------------------------------------------
+void kmac_xof_final(keccak_ctx *ctx, unsigned char *output, size_t outputByteLen)
+{
+	unsigned char enc[9];
+
+	keccak_update(ctx, enc, SP800_Right_Encode(enc, 0));
+	keccak_final(ctx, output, outputByteLen);
+}
+
+// Name: kmac128
+// Function: One-shot KMAC128. For many messages under one key use kmac128_init once, then kmac_clone / keccak_update / kmac_final
+// Parameters: Key, key length, message, message length, customisation, customisation length, MAC, MAC length
+// Returns: void
+//--------------------------------------------------------------------------------------------------------------------------
+void kmac128(const unsigned char *key, size_t keyByteLen, const unsigned char *input, size_t inputByteLen, const unsigned char *S, size_t SLen, unsigned char *output, size_t outputByteLen)
+{
+	keccak_ctx ctx;
+
+	kmac128_init(&ctx, key, keyByteLen, S, SLen);
+	keccak_update(&ctx, input, inputByteLen);
+	kmac_final(&ctx, output, outputByteLen);
+}
+
+// Name: kmac256
+// Function: One-shot KMAC256
+//--------------------------------------------------------------------------------------------------------------------------
+void kmac256(const unsigned char *key, size_t keyByteLen, const unsigned char *input, size_t inputByteLen, const unsigned char *S, size_t SLen, unsigned char *output, size_t outputByteLen)
+{
+	keccak_ctx ctx;
+
+	kmac256_init(&ctx, key, keyByteLen, S, SLen);
+	keccak_update(&ctx, input, inputByteLen);
+	kmac_final(&ctx, output, outputByteLen);
+}
+
+// Name: SP800_ParallelHash
+// Function: ParallelHash with the given rate (bits) and chaining value length (bytes)
+// Returns: 1 on success, 0 if the block size is 0
+//--------------------------------------------------------------------------------------------------------------------------
+static int SP800_ParallelHash(unsigned int rate, unsigned int cvLen, const unsigned char *input, size_t inputByteLen, size_t blockByteLen,
+							   const unsigned char *custom, size_t customByteLen, unsigned char *output, size_t outputByteLen)
+{
+	static const unsigned char Name[] = "ParallelHash";
+	unsigned char smallCVs[PH_SMALL_WINDOW * PH_CV_MAX];
+	unsigned char enc[9];
+	unsigned char *cvs;
+	tSHA3Leaves leaves;
+	keccak_ctx ctx, leaf;
+	size_t blocks, full, window, i, n;
+
+	if (blockByteLen == 0)
+	{
+		memset(output, 0, outputByteLen);
+		return 0;
+	}
+
+	SP800_CSHAKE_Init(&ctx, rate, Name, sizeof(Name) - 1, custom, customByteLen);
+	keccak_update(&ctx, enc, SP800_Left_Encode(enc, blockByteLen));
+
+	full = inputByteLen / blockByteLen;
+	blocks = (inputByteLen + blockByteLen - 1) / blockByteLen;
+
+	cvs = (full > PH_SMALL_WINDOW) ? (unsigned char *)malloc(PH_WINDOW * cvLen) : NULL;
+	window = (cvs != NULL) ? PH_WINDOW : PH_SMALL_WINDOW;
+	if (cvs == NULL)
+		cvs = smallCVs;
+
+	leaves.leafLen = blockByteLen;
+	leaves.rateInBytes = rate / 8;
+	leaves.rounds = 24;
+	leaves.suffix = 0x1F;
+	leaves.cvLen = cvLen;
+	leaves.cvs = cvs;
+	for (i = 0; i < full; i += n)
+	{
+		n = MIN(window, full - i);
+		leaves.input = input + i * blockByteLen;
+		leaves.count = n;
+		SHA3_Hash_Leaves(&leaves);
+		keccak_update(&ctx, cvs, n * cvLen);
+	}
+
+	// Short last block
+	if (blocks > full)
+	{
+		keccak_init(&leaf, rate, 1600 - rate, 0x1F);
+		keccak_update(&leaf, input + full * blockByteLen, inputByteLen - full * blockByteLen);
+		keccak_final(&leaf, cvs, cvLen);
+		keccak_update(&ctx, cvs, cvLen);
+	}
+	if (cvs != smallCVs)
+		free(cvs);
+
+	keccak_update(&ctx, enc, SP800_Right_Encode(enc, blocks));
+	keccak_update(&ctx, enc, SP800_Right_Encode(enc, (UINT64)outputByteLen * 8));
+	keccak_final(&ctx, output, outputByteLen);
+	return 1;
+}
+
+// Name: parallelhash128
+// Function: ParallelHash128 of input in blocks of blockByteLen bytes, customisation custom, any output length
+// Parameters: Message, message length, block size B in bytes, customisation, customisation length, output, output length
+// Returns: 1 on success, 0 if the block size is 0- SP 800-185 needs B > 0. The output is zeroed in that case
+//--------------------------------------------------------------------------------------------------------------------------
+int parallelhash128(const unsigned char *input, size_t inputByteLen, size_t blockByteLen, const unsigned char *custom, size_t customByteLen, unsigned char *output, size_t outputByteLen)
+{
+	return SP800_ParallelHash(1344, 32, input, inputByteLen, blockByteLen, custom, customByteLen, output, outputByteLen);
+}
+
+// Name: parallelhash256
+// Function: ParallelHash256, as parallelhash128 with the 256-bit security strength
+//--------------------------------------------------------------------------------------------------------------------------
+int parallelhash256(const unsigned char *input, size_t inputByteLen, size_t blockByteLen, const unsigned char *custom, size_t customByteLen, unsigned char *output, size_t outputByteLen)
+{
+	return SP800_ParallelHash(1088, 64, input, inputByteLen, blockByteLen, custom, customByteLen, output, outputByteLen);
+}
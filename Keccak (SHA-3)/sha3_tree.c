@@ -0,0 +1,119 @@
+//
+//					Filename: sha3_tree.c
+//                  Leaf hashing for the tree modes (KangarooTwelve, ParallelHash)
+//
+//					Both tree hashes cut the message into equal leaves, hash every leaf on its own into a short chaining value and
+//                  hash the chaining values again. The leaves are independent, so they are shared out over worker threads and,
+//                  inside each thread, run through the multi-buffer lanes of sha3_multi.c. Throughput then grows with both the
+//                  core count and the vector width.
+//
+//					Define SHA3_THREADS (and link with -pthread) to use more than the calling thread.
+//
+//------------------------------------------------------------------------------------------------------------------------------------------------------------
+
+#include "sha3.h"
+#include "sha3_backend.h"
+
+#ifdef SHA3_THREADS
+#include <pthread.h>
+#include <unistd.h>
+
+#define SHA3_MAX_THREADS		16
+#define SHA3_MT_MIN_BYTES		262144	// 256K per worker- below this thread start-up costs more than it saves
+#endif
+
+#define SHA3_TREE_GROUP			64		// Leaves handed to the multi-buffer hash per call
+
+typedef struct
+{
+	const tSHA3Leaves *job;
+	size_t first;
+	size_t count;
+} tTreeRange;
+
+// Name: Tree_Hash_Range
+// Function: Hashes leaves first .. first+count-1 of the job, SHA3_TREE_GROUP at a time through the multi-buffer lanes
+//--------------------------------------------------------------------------------------------------------------------------
+static void Tree_Hash_Range(const tSHA3Leaves *job, size_t first, size_t count)
+{
+	const unsigned char *inputs[SHA3_TREE_GROUP];
+	unsigned char *outputs[SHA3_TREE_GROUP];
+	size_t lens[SHA3_TREE_GROUP];
+	size_t n, k;
+
+	while (count > 0)
+	{
+		n = MIN(count, SHA3_TREE_GROUP);
+		for (k = 0; k < n; k++)
+		{
+			inputs[k] = job->input + (first + k) * job->leafLen;
+			lens[k] = job->leafLen;
+			outputs[k] = job->cvs + (first + k) * job->cvLen;
+		}
+		SHA3_Multi_Hash(job->rateInBytes, job->suffix, job->rounds, job->cvLen, inputs, lens, outputs, n);
+		first += n;
+		count -= n;
+	}
+}
+
+#ifdef SHA3_THREADS
+// Name: Tree_Worker
+//--------------------------------------------------------------------------------------------------------------------------
+static void *Tree_Worker(void *arg)
+{
+	tTreeRange *range = (tTreeRange *)arg;
+
+	Tree_Hash_Range(range->job, range->first, range->count);
+	return NULL;
+}
+#endif
+
+// Name: SHA3_Hash_Leaves
+// Function: Hashes job->count leaves of job->leafLen bytes each into job->cvs. The leaves are all the same length, so an even
+//           split keeps every thread equally busy
+// Parameters: Leaf job
+// Returns: void
+//--------------------------------------------------------------------------------------------------------------------------
+void SHA3_Hash_Leaves(const tSHA3Leaves *job)
+{
+#ifdef SHA3_THREADS
+	pthread_t tid[SHA3_MAX_THREADS];
+	tTreeRange range[SHA3_MAX_THREADS];
+	size_t per, start, bytes;
+	long cpus;
+	unsigned int Threads, started, ii;
+
+	cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	Threads = (cpus > 1) ? (unsigned int)cpus : 1;
+	if (Threads > SHA3_MAX_THREADS)
+		Threads = SHA3_MAX_THREADS;
+	bytes = job->count * job->leafLen;
+	if (bytes / SHA3_MT_MIN_BYTES < Threads)
+		Threads = (unsigned int)(bytes / SHA3_MT_MIN_BYTES);
+
+	if (Threads > 1)
+	{
+		per = job->count / Threads;
+		for (ii = 0, start = 0; ii < Threads; ii++, start += per)
+		{
+			range[ii].job = job;
+			range[ii].first = start;
+			range[ii].count = (ii == Threads - 1) ? (job->count - start) : per;
+		}
+
+		for (started = 1; started < Threads; started++)
+		{
+			if (pthread_create(&tid[started], NULL, Tree_Worker, &range[started]) != 0)
+				break;
+		}
+		Tree_Worker(&range[0]);
+		// Anything that failed to start is done on this thread
+		for (ii = started; ii < Threads; ii++)
+			Tree_Worker(&range[ii]);
+		for (ii = 1; ii < started; ii++)
+			pthread_join(tid[ii], NULL);
+		return;
+	}
+#endif
+	Tree_Hash_Range(job, 0, job->count);
+}